@@ -1,13 +1,20 @@
 #ifndef _ACTIVATE_FUNCTION_HPP_
 #define _ACTIVATE_FUNCTION_HPP_
 #include <math.h>
+#include <cmath>
+#include <type_traits>
 #include "base_logic.hpp"
 #include "mat.hpp"
+#include "dmat.hpp"
 
 template<typename val_t = double>
 val_t f_sigmoid(const val_t& v)
 {
-	return 1. / (1. + exp(-1. * v));
+	/* 按元素类型计算，float不会提升成double再算exp */
+	if constexpr (std::is_arithmetic<val_t>::value)
+		return val_t(1.) / (val_t(1.) + std::exp(val_t(-1.) * v));
+	else
+		return 1. / (1. + exp(-1. * v));
 }
 
 template<int r, int c>
@@ -25,7 +32,7 @@ template<typename target_t>
 inline target_t sigmoidm(const target_t& mt_input) 
 {
 	target_t mt_ret;
-	col_loop<target_t::c - 1, n_sigmoid>(mt_ret, mt_input);
+	elem_map<n_sigmoid>(mt_ret, mt_input);
 	return mt_ret;
 }
 
@@ -35,7 +42,7 @@ struct sigmoid
 	target_t mt_pre_output;
 	inline target_t forward(const target_t& mt_input)
 	{
-		col_loop<target_t::c - 1, n_sigmoid>(mt_pre_output, mt_input);
+		elem_map<n_sigmoid>(mt_pre_output, mt_input);
 		return mt_pre_output;
 	}
 
@@ -46,23 +53,30 @@ struct sigmoid
 	}
 };
 
-template<>
-struct sigmoid<double>
+/* 标量版本，double与float共用 */
+template<typename val_t>
+struct sigmoid_scalar
 {
-	double mt_pre_output;
-	inline double forward(const double& mt_input)
+	val_t mt_pre_output;
+	inline val_t forward(const val_t& mt_input)
 	{
 		//col_loop<target_t::c - 1, n_sigmoid>(mt_pre_output, mt_input);
 		mt_pre_output = f_sigmoid(mt_input);
 		return mt_pre_output;
 	}
 
-	inline double backward()
+	inline val_t backward()
 	{
-		return mt_pre_output * (1. - mt_pre_output);
+		return mt_pre_output * (val_t(1.) - mt_pre_output);
 	}
 };
 
+template<>
+struct sigmoid<double> : sigmoid_scalar<double> {};
+
+template<>
+struct sigmoid<float> : sigmoid_scalar<float> {};
+
 template<int r, int c>
 class n_ReLu
 {
@@ -99,47 +113,96 @@ struct ReLu
 	{
 		mt_pre_input = mt_input;
 		target_t mt_output;
-		col_loop<target_t::c - 1, n_ReLu>(mt_output, mt_input);
+		elem_map<n_ReLu>(mt_output, mt_input);
 		return mt_output;
 	}
 
 	inline target_t backward()
 	{
 		target_t mt_output;
-		col_loop<target_t::c - 1, n_ReLu_back>(mt_output, mt_pre_input);
+		elem_map<n_ReLu_back>(mt_output, mt_pre_input);
 		return mt_output;
 	}
 };
 
-template<>
-struct ReLu<double>
+template<typename val_t>
+struct ReLu_scalar
 {
-	double mt_pre_input;
-	inline double forward(const double& mt_input)
+	val_t mt_pre_input;
+	inline val_t forward(const val_t& mt_input)
 	{
 		mt_pre_input = mt_input;
-		return mt_pre_input < 0 ? 0 : mt_pre_input;
+		return mt_pre_input < 0 ? val_t(0) : mt_pre_input;
 	}
 
-	inline double backward()
+	inline val_t backward()
 	{
-		return mt_pre_input < 0. ? 0. : 1.;
+		return mt_pre_input < val_t(0.) ? val_t(0.) : val_t(1.);
 	}
 };
 
-template<typename target_t>
-struct softmax 
+template<>
+struct ReLu<double> : ReLu_scalar<double> {};
+
+template<>
+struct ReLu<float> : ReLu_scalar<float> {};
+
+/* softmax的归一化方向：整个矩阵、每一列各自归一化、每一行各自归一化 */
+enum class softmax_axis
+{
+	all,
+	col,
+	row,
+};
+
+/*
+ * 对行主序rows*cols的连续内存做softmax，元素个数达到MAT_SIMD_MIN_SIZE时用SIMD内核，与mat其它运算的选择一致
+ * 按行时每行是一段连续内存，按列时内核一次处理多列
+ */
+template<typename val_t>
+inline void softmax_raw(const val_t* p_in, val_t* p_out, const int& rows, const int& cols, const softmax_axis& axis)
+{
+	const bool b_simd = rows * cols >= MAT_SIMD_MIN_SIZE;
+	const simd_kernels<val_t>& k = simd_kernels<val_t>::get();
+	switch (axis)
+	{
+	case softmax_axis::all:
+		(b_simd ? k.softmax : &simd_scalar<val_t>::softmax)(p_in, p_out, rows * cols);
+		break;
+	case softmax_axis::row:
+		for (int i = 0; i < rows; ++i)
+			(b_simd ? k.softmax : &simd_scalar<val_t>::softmax)(p_in + i * cols, p_out + i * cols, cols);
+		break;
+	case softmax_axis::col:
+		(b_simd ? k.softmax_cols : &simd_scalar<val_t>::softmax_cols)(p_in, p_out, rows, cols);
+		break;
+	}
+}
+
+/*
+ * 浮点元素的矩阵由融合的softmax内核直接写入mt_pre_output，不产生中间矩阵；元素本身是矩阵时按整体逐步计算
+ * backward()返回导数y*(1-y)，backward(mt_delta)把导数直接乘进mt_delta
+ */
+template<typename target_t, softmax_axis axis>
+struct softmax_t
 {
 	target_t mt_pre_output;
 	inline target_t forward(const target_t& mt_input)
 	{
-		/* ������е�����exp�� */
 		using val_t = typename target_t::type;
-		val_t d_max = mt_input.max();
-		auto mt1 = mt_input - d_max;
-		auto mt_exp = exp(mt1);
-		val_t d_sum = mt_exp.sum();
-		mt_pre_output = mt_exp / d_sum;
+		if constexpr (std::is_floating_point<val_t>::value)
+		{
+			softmax_raw(mt_input.pval->p, mt_pre_output.pval->p, target_t::r, target_t::c, axis);
+		}
+		else
+		{
+			static_assert(axis == softmax_axis::all, "softmax_t: elements that are not floating point only support softmax_axis::all");
+			/* ������е�����exp�� */
+			val_t d_max = mt_input.max();
+			target_t mt_exp = exp(mt_input - d_max);
+			val_t d_sum = mt_exp.sum();
+			mt_pre_output = mt_exp / d_sum;
+		}
 		return mt_pre_output;
 	}
 
@@ -150,8 +213,25 @@ struct softmax
 		return mt_pre_output * (one - mt_pre_output);
 		//return one;				// 使用交叉熵损失函数时，softmax的反向传播不需要乘以(1 - softmax)
 	}
+
+	inline void backward(target_t& mt_delta)
+	{
+		using val_t = typename target_t::type;
+		val_t one(1.);
+		mt_delta *= mt_pre_output * (one - mt_pre_output);
+	}
 };
 
+template<typename target_t>
+using softmax = softmax_t<target_t, softmax_axis::all>;
+
+/* 每一列是一个样本(例如batch_size大于1的bp输出)时使用 */
+template<typename target_t>
+using col_softmax = softmax_t<target_t, softmax_axis::col>;
+
+template<typename target_t>
+using row_softmax = softmax_t<target_t, softmax_axis::row>;
+
 
 template<typename target_t>
 struct no_activate
@@ -168,19 +248,125 @@ struct no_activate
 	}
 };
 
+template<typename val_t>
+struct no_activate_scalar
+{
+	val_t mt_pre_input;
+	inline val_t forward(const val_t& mt_input)
+	{
+		return mt_input;
+	}
+
+	inline val_t backward()
+	{
+		return val_t(1.);
+	}
+};
+
+template<>
+struct no_activate<double> : no_activate_scalar<double> {};
+
 template<>
-struct no_activate<double>
+struct no_activate<float> : no_activate_scalar<float> {};
+
+/*
+ * dmat的形状在运行时确定，不能用col_loop展开，直接对整块内存计算
+ */
+template<typename val_t>
+struct sigmoid<dmat<val_t> >
+{
+	dmat<val_t> mt_pre_output;
+	inline dmat<val_t> forward(const dmat<val_t>& mt_input)
+	{
+		mt_pre_output = val_t(1.) / (exp(val_t(-1.) * mt_input) + val_t(1.));
+		return mt_pre_output;
+	}
+
+	inline dmat<val_t> backward()
+	{
+		return mt_pre_output * (val_t(1.) - mt_pre_output);
+	}
+};
+
+template<typename val_t>
+struct ReLu<dmat<val_t> >
+{
+	dmat<val_t> mt_pre_input;
+	inline dmat<val_t> forward(const dmat<val_t>& mt_input)
+	{
+		mt_pre_input = mt_input;
+		dmat<val_t> mt_output(mt_input);
+		for (int i = 0; i < mt_output.size(); ++i)
+		{
+			mt_output[i] = max_and_choose(mt_output[i], val_t(0), val_t(0.), mt_output[i]);
+		}
+		return mt_output;
+	}
+
+	inline dmat<val_t> backward()
+	{
+		dmat<val_t> mt_output(mt_pre_input);
+		for (int i = 0; i < mt_output.size(); ++i)
+		{
+			mt_output[i] = max_and_choose(mt_output[i], val_t(0.), val_t(0.), val_t(1.));
+		}
+		return mt_output;
+	}
+};
+
+/* 转置过的dmat先复制成行主序再交给softmax内核 */
+template<typename val_t, softmax_axis axis>
+struct softmax_t<dmat<val_t>, axis>
 {
-	double mt_pre_input;
-	inline double forward(const double& mt_input)
+	dmat<val_t> mt_pre_output;
+	inline dmat<val_t> forward(const dmat<val_t>& mt_input)
 	{
+		if (mt_input.b_t)
+			return forward(mt_input.layout_as(false));
+		if (mt_pre_output.row_num != mt_input.row_num || mt_pre_output.col_num != mt_input.col_num || mt_pre_output.b_t || mt_pre_output.pm.use_count() != 1)
+			mt_pre_output = dmat<val_t>(mt_input.row_num, mt_input.col_num);
+		softmax_raw(mt_input.p, mt_pre_output.p, mt_input.row_num, mt_input.col_num, axis);
+		return mt_pre_output;
+	}
+
+	inline dmat<val_t> backward()
+	{
+		return mt_pre_output * (val_t(1.) - mt_pre_output);
+	}
+
+	inline void backward(dmat<val_t>& mt_delta)
+	{
+		mt_delta *= mt_pre_output * (val_t(1.) - mt_pre_output);
+	}
+};
+
+template<typename val_t>
+struct no_activate<dmat<val_t> >
+{
+	dmat<val_t> mt_pre_input;
+	inline dmat<val_t> forward(const dmat<val_t>& mt_input)
+	{
+		mt_pre_input = mt_input;
 		return mt_input;
 	}
 
-	inline double backward()
+	inline dmat<val_t> backward()
 	{
-		return 1.;
+		return dmat<val_t>(mt_pre_input.row_num, mt_pre_input.col_num, val_t(1.));
 	}
 };
 
+#include "ht_memory.h"
+
+/* softmax只缓存上次前向传播的输出，没有需要保存的参数。按字节写入会把mat内部的指针一起写进文件 */
+template<typename target_t, softmax_axis axis>
+void write_file(const softmax_t<target_t, axis>& /* act */, ht_memory& /* mry */)
+{
+}
+
+template<typename target_t, softmax_axis axis>
+void read_file(ht_memory& /* mry */, softmax_t<target_t, axis>& /* act */)
+{
+}
+
 #endif
@@ -4,6 +4,7 @@
 
 #include "base_logic.hpp"
 #include "mat.hpp"
+#include "conv.hpp"
 
 template<typename func_t>
 auto derivative(func_t&& f, const decltype(f(0))& v)
@@ -45,307 +46,507 @@ mat<row_num1, col_num2, val_t> dot(const mat<row_num1, col_num1, val_t>& mt1, co
 }
 #endif
 
-/* 加法运算 */
-template<typename mtt>
-inline typename mtt::type do_add(const int& r, const int& c, const mtt& mt1, const mtt& mt2)
-{
-	using ret_t = typename mtt::type;
-	ret_t ret = 0.0;
-	return mt1.get(r, c) + mt2.get(r, c);
-}
+/*
+ * 表达式模板：+ - * / exp sqrtl abs不再立即计算，而是返回记录了运算的表达式对象，
+ * 直到赋值给mat(或构造mat)时才在一个循环里逐元素算完，a - lr * m / (sqrtl(v) + eps)这样的式子
+ * 只遍历一次内存，也不产生中间矩阵
+ * 左值矩阵在表达式中按引用保存，右值矩阵(例如dot的结果)按值保存，因此auto保存表达式是安全的，
+ * 但表达式每次使用都会重新计算一遍，需要多次使用的结果应该显式地写成mat类型
+ */
+template<typename type>
+struct is_mat_operand
+{
+	static constexpr bool value = is_mat<std::decay_t<type> >::value || is_mat_expr<type>::value;
+};
 
-template<typename mtt>
-inline typename mtt::type do_add(const int& r, const int& c, const mtt& mt1, const typename mtt::type& v)
+/* 表达式的公共接口，需要整体结果的操作先求值再调用mat的版本 */
+template<typename expr_t>
+struct mat_expr :public mat_expr_tag
 {
-	using ret_t = typename mtt::type;
-	ret_t ret = 0.0;
-	return mt1.get(r, c) + v;
-}
+	const expr_t& self() const
+	{
+		return static_cast<const expr_t&>(*this);
+	}
 
-template<int row_num, int col_num, typename val_t = double>
-mat<row_num, col_num, val_t> operator+(const mat<row_num, col_num, val_t>& mt1, const mat<row_num, col_num, val_t>& mt2)
-{
-	using omatt = mat<row_num, col_num, val_t>;
-	omatt mt_ret;
-	for (int r = 0; r < omatt::r; ++r)
+	auto eval() const
 	{
-		for (int c = 0; c < omatt::c; ++c)
-		{
-			mt_ret.get(r, c) = do_add(r, c, mt1, mt2);
-		}
+		return mat<expr_t::r, expr_t::c, typename expr_t::type>(self());
 	}
-	return mt_ret;
-}
 
-template<int row_num, int col_num, typename val_t = double>
-mat<row_num, col_num, val_t> operator+(const val_t& v, const mat<row_num, col_num, val_t>& mt)
-{
-	using omatt = mat<row_num, col_num, val_t>;
-	omatt mt_ret;
-	for (int r = 0; r < omatt::r; ++r)
+	auto t() const
 	{
-		for (int c = 0; c < omatt::c; ++c)
-		{
-			mt_ret.get(r, c) = do_add(r, c, mt, v);
-		}
+		return eval().t();
 	}
-	return mt_ret;
-}
 
-template<int row_num, int col_num, typename val_t = double>
-mat<row_num, col_num, val_t> operator+(const mat<row_num, col_num, val_t>& mt, const val_t& v)
+	template<typename other_t>
+	auto dot(const other_t& other) const
+	{
+		return eval().dot(other);
+	}
+
+	auto max() const
+	{
+		return eval().max();
+	}
+
+	auto sum() const
+	{
+		return eval().sum();
+	}
+
+	auto max_abs() const
+	{
+		return eval().max_abs();
+	}
+
+	void print() const
+	{
+		eval().print();
+	}
+
+	auto operator[](const int& idx) const
+	{
+		return self().get(idx / expr_t::c, idx % expr_t::c);
+	}
+};
+
+/* 表达式的叶子节点，by_value为true时保存矩阵本身，否则保存引用 */
+template<typename mat_t, bool by_value>
+struct mat_leaf
 {
-	using omatt = mat<row_num, col_num, val_t>;
-	omatt mt_ret;
-	for (int r = 0; r < omatt::r; ++r)
+	using type = typename mat_t::type;
+	static constexpr int r = mat_t::r;
+	static constexpr int c = mat_t::c;
+	std::conditional_t<by_value, mat_t, const mat_t&> mt;
+
+	mat_leaf(const mat_t& m) :mt(m) {}
+	mat_leaf(mat_t&& m) :mt(std::move(m)) {}
+
+	type get(const int& i_row, const int& i_col) const
 	{
-		for (int c = 0; c < omatt::c; ++c)
+		return mt.get(i_row, i_col);
+	}
+
+	const type& at(const int& idx) const
+	{
+		return mt.pval->p[idx];
+	}
+
+	/* 分块求值：返回下标[i0, i0+n)的元素所在的地址，叶子节点直接返回自身的内存 */
+	const type* block(const int& i0, const int& /* n */, type* /* p_buf */) const
+	{
+		return mt.pval->p + i0;
+	}
+
+	/* mat总是行主序，可以按内存顺序线性访问 */
+	bool linear() const
+	{
+		return true;
+	}
+
+	/* 即使与目标共享内存，逐元素写回的也是同一个下标，不会覆盖还没读到的值 */
+	bool conflict(const void* /* p */) const
+	{
+		return false;
+	}
+
+	/* 按值保存的右值矩阵独占堆内存时，求值结果可以直接写回它的内存 */
+	template<typename target_t>
+	target_t* reuse_target()
+	{
+		if constexpr (by_value && std::is_same<mat_t, target_t>::value && target_t::storage_t::can_share)
 		{
-			mt_ret.get(r, c) = do_add(r, c, mt, v);
+			if (mt.pval.unique())
+				return &mt;
 		}
+		return nullptr;
 	}
-	return mt_ret;
-}
+};
 
-/* 减法运算 */
-template<typename mtt>
-inline typename mtt::type do_minus(const int& r, const int& c, const mtt& mt1, const mtt& mt2)
+/* 矩阵按引用或按值成为叶子节点，表达式按值嵌套 */
+template<typename type, bool is_expr = is_mat_expr<type>::value>
+struct mat_operand
 {
-	using ret_t = typename mtt::type;
-	ret_t ret = 0.0;
-	return mt1.get(r, c) - mt2.get(r, c);
-}
+	using node_t = mat_leaf<std::decay_t<type>, true>;
+};
 
-template<typename mtt>
-inline typename mtt::type do_minus(const int& r, const int& c, const mtt& mt1, const typename mtt::type& v)
+template<typename type>
+struct mat_operand<type&, false>
 {
-	using ret_t = typename mtt::type;
-	ret_t ret = 0.0;
-	return mt1.get(r, c) - v;
-}
+	using node_t = mat_leaf<std::decay_t<type>, false>;
+};
 
-template<int row_num, int col_num, typename val_t = double>
-mat<row_num, col_num, val_t> operator-(const mat<row_num, col_num, val_t>& mt1, const mat<row_num, col_num, val_t>& mt2)
+template<typename type>
+struct mat_operand<type, true>
 {
-	using omatt = mat<row_num, col_num, val_t>;
-	omatt mt_ret;
-	for (int r = 0; r < omatt::r; ++r)
+	using node_t = std::decay_t<type>;
+};
+
+template<typename type>
+using mat_node_t = typename mat_operand<type>::node_t;
+
+template<typename op_t, typename lhs_t, typename rhs_t>
+struct mat_binary_expr :public mat_expr<mat_binary_expr<op_t, lhs_t, rhs_t> >
+{
+	using type = typename lhs_t::type;
+	static constexpr int r = lhs_t::r;
+	static constexpr int c = lhs_t::c;
+	lhs_t lhs;
+	rhs_t rhs;
+
+	mat_binary_expr(lhs_t l, rhs_t r) :lhs(std::move(l)), rhs(std::move(r)) {}
+
+	type get(const int& i_row, const int& i_col) const
 	{
-		for (int c = 0; c < omatt::c; ++c)
-		{
-			mt_ret.get(r, c) = do_minus(r, c, mt1, mt2);
-		}
+		return static_cast<type>(op_t::cal(lhs.get(i_row, i_col), rhs.get(i_row, i_col)));
 	}
-	return mt_ret;
-}
 
-template<int row_num, int col_num, typename val_t = double>
-mat<row_num, col_num, val_t> operator-(const val_t& v, const mat<row_num, col_num, val_t>& mt)
-{
-	using omatt = mat<row_num, col_num, val_t>;
-	omatt mt_ret;
-	for (int r = 0; r < omatt::r; ++r)
+	type at(const int& idx) const
 	{
-		for (int c = 0; c < omatt::c; ++c)
-		{
-			mt_ret.get(r, c) = v - mt.get(r, c);
-		}
+		return static_cast<type>(op_t::cal(lhs.at(idx), rhs.at(idx)));
 	}
-	return mt_ret;
-}
 
-template<int row_num, int col_num, typename val_t = double>
-mat<row_num, col_num, val_t> operator-(const mat<row_num, col_num, val_t>& mt, const val_t& v)
-{
-	using omatt = mat<row_num, col_num, val_t>;
-	omatt mt_ret;
-	for (int r = 0; r < omatt::r; ++r)
+	const type* block(const int& i0, const int& n, type* p_buf) const
 	{
-		for (int c = 0; c < omatt::c; ++c)
-		{
-			mt_ret.get(r, c) = do_minus(r, c, mt, v);
-		}
+		alignas(MAT_ALIGN) type sz_lhs[MAT_EXPR_BLOCK];
+		alignas(MAT_ALIGN) type sz_rhs[MAT_EXPR_BLOCK];
+		op_t::vec(lhs.block(i0, n, sz_lhs), rhs.block(i0, n, sz_rhs), p_buf, n);
+		return p_buf;
 	}
-	return mt_ret;
-}
 
-/* 乘法运算 */
-template<int row_num, int col_num, typename val_t = double>
-mat<row_num, col_num, val_t> operator*(const val_t& v, const mat<row_num, col_num, val_t>& mt)
-{
-	using omatt = mat<row_num, col_num, val_t>;
-	omatt mt_ret;
-	for (int r = 0; r < omatt::r; ++r)
+	bool linear() const
 	{
-		for (int c = 0; c < omatt::c; ++c)
-		{
-			mt_ret.get(r, c) = v * mt.get(r, c);
-		}
+		return lhs.linear() && rhs.linear();
 	}
-	return mt_ret;
-}
 
-template<int row_num, int col_num, typename val_t = double>
-mat<row_num, col_num, val_t> operator*(const mat<row_num, col_num, val_t>& mt, const val_t& v)
-{
-	using omatt = mat<row_num, col_num, val_t>;
-	omatt mt_ret;
-	for (int r = 0; r < omatt::r; ++r)
+	bool conflict(const void* p) const
 	{
-		for (int c = 0; c < omatt::c; ++c)
-		{
-			mt_ret.get(r, c) = mt.get(r, c) * v;
-		}
+		return lhs.conflict(p) || rhs.conflict(p);
 	}
-	return mt_ret;
-}
 
-template<int row_num, int col_num, typename val_t = double>
-mat<row_num, col_num, val_t> operator*(const mat<row_num, col_num, val_t>& mt1, const mat<row_num, col_num, val_t>& mt2)
-{
-	using omatt = mat<row_num, col_num, val_t>;
-	omatt mt_ret;
-	for (int r = 0; r < omatt::r; ++r)
+	template<typename target_t>
+	target_t* reuse_target()
 	{
-		for (int c = 0; c < omatt::c; ++c)
-		{
-			mt_ret.get(r, c) = mt1.get(r, c) * mt2.get(r, c);
-		}
+		if (target_t* p = lhs.template reuse_target<target_t>())
+			return p;
+		return rhs.template reuse_target<target_t>();
 	}
-	return mt_ret;
-}
+};
 
-/* 除法 */
-template<int row_num, int col_num, typename val_t>
-mat<row_num, col_num, val_t> operator/(const mat<row_num, col_num, val_t>& mt, const val_t& v)
+/* 矩阵与标量的运算，scalar_left表示标量在运算符左边 */
+template<typename op_t, typename expr_t, bool scalar_left>
+struct mat_scalar_expr :public mat_expr<mat_scalar_expr<op_t, expr_t, scalar_left> >
 {
-	using omatt = mat<row_num, col_num, val_t>;
-	omatt mt_ret;
-	for (int r = 0; r < omatt::r; ++r)
+	using type = typename expr_t::type;
+	static constexpr int r = expr_t::r;
+	static constexpr int c = expr_t::c;
+	expr_t e;
+	type v;
+
+	mat_scalar_expr(expr_t e_in, const type& v_in) :e(std::move(e_in)), v(v_in) {}
+
+	type get(const int& i_row, const int& i_col) const
 	{
-		for (int c = 0; c < omatt::c; ++c)
-		{
-			mt_ret.get(r, c) = mt.get(r, c) / v;
-		}
+		if constexpr (scalar_left)
+			return static_cast<type>(op_t::cal(v, e.get(i_row, i_col)));
+		else
+			return static_cast<type>(op_t::cal(e.get(i_row, i_col), v));
 	}
-	return mt_ret;
-}
 
-template<int row_num, int col_num, typename val_t>
-mat<row_num, col_num, val_t> operator/(const val_t& v, const mat<row_num, col_num, val_t>& mt)
-{
-	using omatt = mat<row_num, col_num, val_t>;
-	omatt mt_ret;
-	for (int r = 0; r < omatt::r; ++r)
+	type at(const int& idx) const
 	{
-		for (int c = 0; c < omatt::c; ++c)
-		{
-			mt_ret.get(r, c) = v / mt.get(r, c);
-		}
+		if constexpr (scalar_left)
+			return static_cast<type>(op_t::cal(v, e.at(idx)));
+		else
+			return static_cast<type>(op_t::cal(e.at(idx), v));
 	}
-	return mt_ret;
-}
 
-template<int row_num, int col_num, typename vt>
-mat<row_num, col_num, vt> operator/(const mat<row_num, col_num, vt>& mt1, const mat<row_num, col_num, vt>& mt2)
-{
-	using omatt = mat<row_num, col_num, vt>;
-	omatt mt_ret;
-	for (int r = 0; r < omatt::r; ++r)
+	const type* block(const int& i0, const int& n, type* p_buf) const
 	{
-		for (int c = 0; c < omatt::c; ++c)
-		{
-			mt_ret.get(r, c) = mt1.get(r, c) / mt2.get(r, c);
-		}
+		alignas(MAT_ALIGN) type sz_e[MAT_EXPR_BLOCK];
+		op_t::vec_s(e.block(i0, n, sz_e), v, p_buf, n, scalar_left);
+		return p_buf;
 	}
-	return mt_ret;
-}
 
-template<int i1, int i2, typename val_t>
-mat<i1, i2, val_t> sqrtl(const mat<i1, i2, val_t>& mt)
-{
-	using type = mat<i1, i2, val_t>;
-	type ret;
-	for (int i = 0; i < i1; ++i) 
+	bool linear() const
 	{
-		for (int j = 0; j < i2; ++j) 
-		{
-			ret.get(i, j) = sqrtl(mt.get(i,j));
-		}
+		return e.linear();
 	}
-	return ret;
-}
 
-template<int row_num, int col_num, typename val_t = double>
-mat<row_num, col_num, val_t> sqrtm(const mat<row_num, col_num, val_t>& mt)
-{
-	using omatt = mat<row_num, col_num, val_t>;
-	omatt mt_ret;
-	for (int i = 0; i < row_num; ++i)
+	bool conflict(const void* p) const
 	{
-		for (int j = 0; j < col_num; ++j)
-		{
-			mt_ret.get(i, j) = sqrtl(mt.get(i, j));
-		}
+		return e.conflict(p);
 	}
-	return mt_ret;
-}
 
-/* exp运算 */
-template<int row_num, int col_num, typename val_t = double>
-mat<row_num, col_num, val_t> exp(const mat<row_num, col_num, val_t>& mt)
-{
-	using omatt = mat<row_num, col_num, val_t>;
-	omatt mt_ret;
-	for (int i = 0; i < row_num; ++i)
+	template<typename target_t>
+	target_t* reuse_target()
 	{
-		for (int j = 0; j < col_num; ++j)
-		{
-			mt_ret.get(i, j) = exp(mt.get(i, j));
-		}
+		return e.template reuse_target<target_t>();
 	}
-	return mt_ret;
-}
+};
 
-/* 卷积运算 */
-template<int row_base, int col_base, int row_delta, int col_delta, typename imat_origin, typename imat_tpl>
-inline auto col_loop_mul(const imat_origin& mt_origin, const imat_tpl& mt_tpl)
+template<typename op_t, typename expr_t>
+struct mat_unary_expr :public mat_expr<mat_unary_expr<op_t, expr_t> >
 {
-	if constexpr (col_delta != 0)
+	using type = typename expr_t::type;
+	static constexpr int r = expr_t::r;
+	static constexpr int c = expr_t::c;
+	expr_t e;
+
+	mat_unary_expr(expr_t e_in) :e(std::move(e_in)) {}
+
+	type get(const int& i_row, const int& i_col) const
 	{
-		return mt_origin.template get_val<row_base + row_delta, col_base + col_delta>() * mt_tpl.template get_val<row_delta, col_delta>()
-			+ col_loop_mul<row_base, col_base, row_delta, col_delta - 1, imat_origin, imat_tpl>(mt_origin, mt_tpl);
+		return static_cast<type>(op_t::cal(e.get(i_row, i_col)));
 	}
-	if constexpr (col_delta == 0)
+
+	type at(const int& idx) const
 	{
-		return mt_origin.template get_val<row_base + row_delta, col_base + col_delta>() * mt_tpl.template get_val<row_delta, col_delta>();
+		return static_cast<type>(op_t::cal(e.at(idx)));
 	}
-}
 
-template<int row_base, int col_base, int row_delta, int col_delta, typename imat_origin, typename imat_tpl>
-inline auto row_loop_add(const imat_origin& mt_origin, const imat_tpl& mt_tpl)
+	const type* block(const int& i0, const int& n, type* p_buf) const
+	{
+		alignas(MAT_ALIGN) type sz_e[MAT_EXPR_BLOCK];
+		op_t::vec(e.block(i0, n, sz_e), p_buf, n);
+		return p_buf;
+	}
+
+	bool linear() const
+	{
+		return e.linear();
+	}
+
+	bool conflict(const void* p) const
+	{
+		return e.conflict(p);
+	}
+
+	template<typename target_t>
+	target_t* reuse_target()
+	{
+		return e.template reuse_target<target_t>();
+	}
+};
+
+/* 逐元素运算，cal用于逐个元素计算，vec/vec_s用于分块求值时调用SIMD内核 */
+struct add_op
+{
+	template<typename t1, typename t2>
+	static auto cal(const t1& v1, const t2& v2) { return v1 + v2; }
+	template<typename val_t>
+	static void vec(const val_t* a, const val_t* b, val_t* o, int n) { simd_kernels<val_t>::get().add(a, b, o, n); }
+	template<typename val_t>
+	static void vec_s(const val_t* a, const val_t& v, val_t* o, int n, bool /* b_left */) { simd_kernels<val_t>::get().add_s(a, v, o, n); }
+};
+
+struct minus_op
+{
+	template<typename t1, typename t2>
+	static auto cal(const t1& v1, const t2& v2) { return v1 - v2; }
+	template<typename val_t>
+	static void vec(const val_t* a, const val_t* b, val_t* o, int n) { simd_kernels<val_t>::get().sub(a, b, o, n); }
+	template<typename val_t>
+	static void vec_s(const val_t* a, const val_t& v, val_t* o, int n, bool b_left)
+	{
+		if (b_left)
+			simd_kernels<val_t>::get().rsub_s(a, v, o, n);
+		else
+			simd_kernels<val_t>::get().sub_s(a, v, o, n);
+	}
+};
+
+struct mul_op
+{
+	template<typename t1, typename t2>
+	static auto cal(const t1& v1, const t2& v2) { return v1 * v2; }
+	template<typename val_t>
+	static void vec(const val_t* a, const val_t* b, val_t* o, int n) { simd_kernels<val_t>::get().mul(a, b, o, n); }
+	template<typename val_t>
+	static void vec_s(const val_t* a, const val_t& v, val_t* o, int n, bool /* b_left */) { simd_kernels<val_t>::get().mul_s(a, v, o, n); }
+};
+
+struct div_op
 {
-	if constexpr (row_delta != 0)
+	template<typename t1, typename t2>
+	static auto cal(const t1& v1, const t2& v2) { return v1 / v2; }
+	template<typename val_t>
+	static void vec(const val_t* a, const val_t* b, val_t* o, int n) { simd_kernels<val_t>::get().div(a, b, o, n); }
+	template<typename val_t>
+	static void vec_s(const val_t* a, const val_t& v, val_t* o, int n, bool b_left)
 	{
-		return col_loop_mul<row_base, col_base, row_delta, col_delta>(mt_origin, mt_tpl)
-			+ col_loop_mul<row_base, col_base, row_delta - 1, col_delta>(mt_origin, mt_tpl);
+		if (b_left)
+			simd_kernels<val_t>::get().rdiv_s(a, v, o, n);
+		else
+			simd_kernels<val_t>::get().div_s(a, v, o, n);
 	}
-	if constexpr (row_delta == 0)
+};
+
+struct exp_op
+{
+	template<typename t>
+	static auto cal(const t& v)
 	{
-		return col_loop_mul<row_base, col_base, row_delta, col_delta>(mt_origin, mt_tpl);
+		if constexpr (std::is_arithmetic<t>::value)
+			return static_cast<t>(std::exp(v));
+		else
+			return exp(v);
 	}
-}
+	template<typename val_t>
+	static void vec(const val_t* a, val_t* o, int n) { simd_kernels<val_t>::get().exp(a, o, n); }
+};
 
-template<int r, int c>
-struct v_inner_conv
+struct sqrtl_op
 {
-	template<typename imat_origin_t, typename imat_tpl_t>
-	inline static auto cal(const imat_origin_t& mt_origin, const imat_tpl_t& mt_tpl)
+	template<typename t>
+	static auto cal(const t& v)
 	{
-		return row_loop_add<r, c, imat_tpl_t::r - 1, imat_tpl_t::c - 1>(mt_origin, mt_tpl);
+		/* float不经过long double */
+		if constexpr (std::is_same<t, float>::value)
+			return std::sqrt(v);
+		else
+			return sqrtl(v);
 	}
+	template<typename val_t>
+	static void vec(const val_t* a, val_t* o, int n) { simd_kernels<val_t>::get().sqrt(a, o, n); }
+};
+
+struct abs_op
+{
+	template<typename t>
+	static auto cal(const t& v) { return abs(v); }
+	template<typename val_t>
+	static void vec(const val_t* a, val_t* o, int n) { simd_kernels<val_t>::get().abs(a, o, n); }
 };
 
+/* 两个操作数都是矩阵或表达式，且形状、元素类型一致 */
+template<typename type1, typename type2>
+using enable_mat_binary_t = std::enable_if_t<is_mat_operand<type1>::value && is_mat_operand<type2>::value
+	&& std::decay_t<type1>::r == std::decay_t<type2>::r && std::decay_t<type1>::c == std::decay_t<type2>::c
+	&& std::is_same<typename std::decay_t<type1>::type, typename std::decay_t<type2>::type>::value>;
+
+template<typename type>
+using enable_mat_unary_t = std::enable_if_t<is_mat_operand<type>::value>;
+
+template<typename op_t, typename type1, typename type2>
+inline auto make_binary_expr(type1&& v1, type2&& v2)
+{
+	return mat_binary_expr<op_t, mat_node_t<type1>, mat_node_t<type2> >(std::forward<type1>(v1), std::forward<type2>(v2));
+}
+
+template<typename op_t, bool scalar_left, typename type1>
+inline auto make_scalar_expr(type1&& v1, const typename std::decay_t<type1>::type& v)
+{
+	return mat_scalar_expr<op_t, mat_node_t<type1>, scalar_left>(std::forward<type1>(v1), v);
+}
+
+template<typename op_t, typename type1>
+inline auto make_unary_expr(type1&& v1)
+{
+	return mat_unary_expr<op_t, mat_node_t<type1> >(std::forward<type1>(v1));
+}
+
+/* 加法运算 */
+template<typename type1, typename type2, typename = enable_mat_binary_t<type1, type2> >
+inline auto operator+(type1&& mt1, type2&& mt2)
+{
+	return make_binary_expr<add_op>(std::forward<type1>(mt1), std::forward<type2>(mt2));
+}
+
+template<typename type1, typename = enable_mat_unary_t<type1> >
+inline auto operator+(const typename std::decay_t<type1>::type& v, type1&& mt)
+{
+	return make_scalar_expr<add_op, true>(std::forward<type1>(mt), v);
+}
+
+template<typename type1, typename = enable_mat_unary_t<type1> >
+inline auto operator+(type1&& mt, const typename std::decay_t<type1>::type& v)
+{
+	return make_scalar_expr<add_op, false>(std::forward<type1>(mt), v);
+}
+
+/* 减法运算 */
+template<typename type1, typename type2, typename = enable_mat_binary_t<type1, type2> >
+inline auto operator-(type1&& mt1, type2&& mt2)
+{
+	return make_binary_expr<minus_op>(std::forward<type1>(mt1), std::forward<type2>(mt2));
+}
+
+template<typename type1, typename = enable_mat_unary_t<type1> >
+inline auto operator-(const typename std::decay_t<type1>::type& v, type1&& mt)
+{
+	return make_scalar_expr<minus_op, true>(std::forward<type1>(mt), v);
+}
+
+template<typename type1, typename = enable_mat_unary_t<type1> >
+inline auto operator-(type1&& mt, const typename std::decay_t<type1>::type& v)
+{
+	return make_scalar_expr<minus_op, false>(std::forward<type1>(mt), v);
+}
+
+/* 乘法运算(逐元素) */
+template<typename type1, typename type2, typename = enable_mat_binary_t<type1, type2> >
+inline auto operator*(type1&& mt1, type2&& mt2)
+{
+	return make_binary_expr<mul_op>(std::forward<type1>(mt1), std::forward<type2>(mt2));
+}
+
+template<typename type1, typename = enable_mat_unary_t<type1> >
+inline auto operator*(const typename std::decay_t<type1>::type& v, type1&& mt)
+{
+	return make_scalar_expr<mul_op, true>(std::forward<type1>(mt), v);
+}
+
+template<typename type1, typename = enable_mat_unary_t<type1> >
+inline auto operator*(type1&& mt, const typename std::decay_t<type1>::type& v)
+{
+	return make_scalar_expr<mul_op, false>(std::forward<type1>(mt), v);
+}
+
+/* 除法 */
+template<typename type1, typename type2, typename = enable_mat_binary_t<type1, type2> >
+inline auto operator/(type1&& mt1, type2&& mt2)
+{
+	return make_binary_expr<div_op>(std::forward<type1>(mt1), std::forward<type2>(mt2));
+}
+
+template<typename type1, typename = enable_mat_unary_t<type1> >
+inline auto operator/(const typename std::decay_t<type1>::type& v, type1&& mt)
+{
+	return make_scalar_expr<div_op, true>(std::forward<type1>(mt), v);
+}
+
+template<typename type1, typename = enable_mat_unary_t<type1> >
+inline auto operator/(type1&& mt, const typename std::decay_t<type1>::type& v)
+{
+	return make_scalar_expr<div_op, false>(std::forward<type1>(mt), v);
+}
+
+template<typename type1, typename = enable_mat_unary_t<type1> >
+inline auto sqrtl(type1&& mt)
+{
+	return make_unary_expr<sqrtl_op>(std::forward<type1>(mt));
+}
+
+template<typename type1, typename = enable_mat_unary_t<type1> >
+inline auto sqrtm(type1&& mt)
+{
+	return make_unary_expr<sqrtl_op>(std::forward<type1>(mt));
+}
+
+/* exp运算 */
+template<typename type1, typename = enable_mat_unary_t<type1> >
+inline auto exp(type1&& mt)
+{
+	return make_unary_expr<exp_op>(std::forward<type1>(mt));
+}
+
+template<typename type1, typename = enable_mat_unary_t<type1> >
+inline auto abs(type1&& mt)
+{
+	return make_unary_expr<abs_op>(std::forward<type1>(mt));
+}
+
 constexpr int get_step_inner_size(int i_origin, int i_tpl, int i_step)
 {
 	return (i_origin - i_tpl) / i_step + 1;
@@ -370,16 +571,74 @@ struct pad_size_t
 	static constexpr int bottom = get_pad_size(input_row, tpl_row, row_step) - top;
 };
 
-template<int row_step, int col_step, int row_num, int col_num, int tpl_row, int tpl_col, typename val_t>
-inline mat<get_step_inner_size(row_num, tpl_row, row_step), get_step_inner_size(col_num, tpl_col, col_step), val_t>
-inner_conv(const mat<row_num, col_num, val_t>& mt_origin, const mat<tpl_row, tpl_col, val_t>& mt_tpl)
+/* 
+ * 卷积运算，由conv.hpp中的卷积引擎计算，模板参数只用来确定输出的形状
+ * b_pad为false时不补边；为true时按pad_size_t补0，使最后一步正好落在输入的边界上
+ */
+template<int row_step, int col_step, bool b_pad, int row_num, int col_num, int tpl_row, int tpl_col>
+struct conv_size_t
 {
-	using ret_type = mat<get_step_inner_size(row_num, tpl_row, row_step), get_step_inner_size(col_num, tpl_col, col_step), val_t>;
-	ret_type mt_ret;
-	col_loop<ret_type::c - 1, v_inner_conv>(mt_ret, mt_origin, mt_tpl);
+	using pad_t = pad_size_t<row_num, col_num, tpl_row, tpl_col, row_step, col_step>;
+	static constexpr int r = get_step_inner_size(row_num + (b_pad ? pad_t::top + pad_t::bottom : 0), tpl_row, row_step);
+	static constexpr int c = get_step_inner_size(col_num + (b_pad ? pad_t::left + pad_t::right : 0), tpl_col, col_step);
+
+	static conv_shape shape(const int& in_c, const int& out_c)
+	{
+		return conv_shape{ in_c, row_num, col_num, out_c, tpl_row, tpl_col, row_step, col_step
+			, b_pad ? pad_t::top : 0, b_pad ? pad_t::left : 0, b_pad ? pad_t::bottom : 0, b_pad ? pad_t::right : 0 };
+	}
+};
+
+template<int row_step, int col_step, bool b_pad, int row_num, int col_num, int tpl_row, int tpl_col, typename val_t>
+inline mat<conv_size_t<row_step, col_step, b_pad, row_num, col_num, tpl_row, tpl_col>::r, conv_size_t<row_step, col_step, b_pad, row_num, col_num, tpl_row, tpl_col>::c, val_t>
+conv_mat(const mat<row_num, col_num, val_t>& mt_origin, const mat<tpl_row, tpl_col, val_t>& mt_tpl)
+{
+	static_assert(std::is_arithmetic<val_t>::value, "conv: val_t must be arithmetic");
+	using conv_t = conv_size_t<row_step, col_step, b_pad, row_num, col_num, tpl_row, tpl_col>;
+	mat<conv_t::r, conv_t::c, val_t> mt_ret;
+	conv2d<val_t>(conv_t::shape(1, 1), 1
+		, [&](const int&, const int&) { return static_cast<const val_t*>(mt_origin.pval->p); }
+		, [&](const int&, const int&) { return static_cast<const val_t*>(mt_tpl.pval->p); }
+		, [&](const int&, const int&) { return mt_ret.pval->p; });
 	return mt_ret;
 }
 
+/* 
+ * 多通道、多批次：vec_in[n][ic]是第n个样本的第ic个通道，vec_tpl[oc][ic]是第oc个输出通道在第ic个输入通道上的卷积核
+ * 返回值的[n][oc]是第n个样本的第oc个输出通道，各输入通道的结果相加
+ */
+template<int row_step, int col_step, bool b_pad, int row_num, int col_num, int tpl_row, int tpl_col, typename val_t>
+inline std::vector<std::vector<mat<conv_size_t<row_step, col_step, b_pad, row_num, col_num, tpl_row, tpl_col>::r, conv_size_t<row_step, col_step, b_pad, row_num, col_num, tpl_row, tpl_col>::c, val_t> > >
+conv_mat(const std::vector<std::vector<mat<row_num, col_num, val_t> > >& vec_in, const std::vector<std::vector<mat<tpl_row, tpl_col, val_t> > >& vec_tpl)
+{
+	static_assert(std::is_arithmetic<val_t>::value, "conv: val_t must be arithmetic");
+	using conv_t = conv_size_t<row_step, col_step, b_pad, row_num, col_num, tpl_row, tpl_col>;
+	std::vector<std::vector<mat<conv_t::r, conv_t::c, val_t> > > vec_ret(vec_in.size());
+	if (vec_in.empty() || vec_tpl.empty())
+		return vec_ret;
+	for (auto& vec_out : vec_ret)
+		vec_out.resize(vec_tpl.size());
+	conv2d<val_t>(conv_t::shape(static_cast<int>(vec_in[0].size()), static_cast<int>(vec_tpl.size())), static_cast<int>(vec_in.size())
+		, [&](const int& n, const int& ic) { return static_cast<const val_t*>(vec_in[n][ic].pval->p); }
+		, [&](const int& oc, const int& ic) { return static_cast<const val_t*>(vec_tpl[oc][ic].pval->p); }
+		, [&](const int& n, const int& oc) { return vec_ret[n][oc].pval->p; });
+	return vec_ret;
+}
+
+/* 不补边的卷积：mt_tpl按步长在mt_origin上滑动(不翻转) */
+template<int row_step, int col_step, typename origin_t, typename tpl_t>
+inline auto inner_conv(const origin_t& mt_origin, const tpl_t& mt_tpl)
+{
+	return conv_mat<row_step, col_step, false>(mt_origin, mt_tpl);
+}
+
+/* 补边的卷积：四周按pad_size_t补0 */
+template<int row_step, int col_step, typename origin_t, typename tpl_t>
+inline auto pad_conv(const origin_t& mt_origin, const tpl_t& mt_tpl)
+{
+	return conv_mat<row_step, col_step, true>(mt_origin, mt_tpl);
+}
+
 template<typename mat_t, typename ...mat_ts>
 struct st_one_col 
 {
@@ -392,78 +651,235 @@ struct st_one_col<mat_t>
 	static constexpr int all_size = (mat_t::r*mat_t::c);
 };
 
+/* 按行主序依次写到p开始的内存，mat整块复制，transposed_mat、视图等按(i, j)逐个读取 */
 template<typename mat_t, typename ...mat_ts>
-void concat_mat(typename mat_t::type* p, const mat_t& mt, const mat_ts... mts) 
+void concat_mat(typename mat_t::type* p, const mat_t& mt, const mat_ts&... mts) 
 {
 	constexpr int cpy_size = mat_t::r*mat_t::c;
-	//memcpy(p, mt.pval->p, cpy_size*sizeof(mat_t::type));
-	for (int i = 0; i < cpy_size; ++i) 
+	if constexpr (is_mat<mat_t>::value)
+	{
+		std::copy(mt.pval->p, mt.pval->p + cpy_size, p);
+	}
+	else
 	{
-		p[i] = mt.pval->p[i];
+		for (int i = 0; i < mat_t::r; ++i)
+		{
+			for (int j = 0; j < mat_t::c; ++j)
+			{
+				p[i * mat_t::c + j] = mt.get(i, j);
+			}
+		}
 	}
 	if constexpr(0!=sizeof...(mat_ts))
 		concat_mat(p + cpy_size, mts...);
 }
 
 template<typename mat_t, typename ...mat_ts>
-mat<st_one_col<mat_t, mat_ts...>::all_size, 1> stretch_one_col(const mat_t& mt, const mat_ts&...mts)
+mat<st_one_col<mat_t, mat_ts...>::all_size, 1, typename mat_t::type> stretch_one_col(const mat_t& mt, const mat_ts&...mts)
 {
-	using ret_type = mat<st_one_col<mat_t, mat_ts...>::all_size, 1>;
+	using ret_type = mat<st_one_col<mat_t, mat_ts...>::all_size, 1, typename mat_t::type>;
 	ret_type ret;
 	concat_mat(ret.pval->p, mt, mts...);
 	return ret;
 }
 
-
-template<typename mat_t, typename ...mat_ts>
-void split_mat(typename mat_t::type* p, const mat_t& mt, const mat_ts... mts)
+/* 从p开始的内存按行主序依次写回各个矩阵，与concat_mat相反 */
+template<typename val_t, typename mat_t, typename ...mat_ts>
+void split_mat(const val_t* p, mat_t& mt, mat_ts&... mts)
 {
 	constexpr int cpy_size = mat_t::r*mat_t::c;
-	//memcpy(mt.pval->p, p, cpy_size * sizeof(mat_t::type));
-	for (int i = 0; i < cpy_size; ++i)
+	if constexpr (is_mat<mat_t>::value)
 	{
-		mt.pval->p[i] = p[i];
+		std::copy(p, p + cpy_size, mt.pval->p);
+	}
+	else
+	{
+		for (int i = 0; i < mat_t::r; ++i)
+		{
+			for (int j = 0; j < mat_t::c; ++j)
+			{
+				mt.get(i, j) = p[i * mat_t::c + j];
+			}
+		}
 	}
 	if constexpr (0 != sizeof...(mat_ts))
 		split_mat(p + cpy_size, mts...);
 }
 
+/* 把mt的元素依次分给mts，写入的是mts本身 */
 template<typename mat_t, typename ...mat_ts>
-void split_one_mat(const mat_t& mt, const mat_ts&...mts)
+void split_one_mat(const mat_t& mt, mat_ts&...mts)
 {
-	split_mat(mt.pval->p, mts...);
+	static_assert(st_one_col<mat_ts...>::all_size <= mat_t::r * mat_t::c, "split_one_mat: not enough elements");
+	if constexpr (is_mat<mat_t>::value)
+	{
+		split_mat(static_cast<const typename mat_t::type*>(mt.pval->p), mts...);
+	}
+	else
+	{
+		mat<mat_t::r, mat_t::c, typename mat_t::type> mt_dense(mt);
+		split_mat(static_cast<const typename mat_t::type*>(mt_dense.pval->p), mts...);
+	}
 }
 
-template<int i1, int i2, typename val_t>
-mat<i1, i2, val_t> abs(const mat<i1, i2, val_t>& mt)
-{
-	mat<i1, i2, val_t> ret;
-	for (int i = 0; i < i1; ++i) 
+/*
+ * 把若干mat按stretch_one_col的顺序看作一个列向量，不复制数据，只记录各个mat的首地址
+ * 与mat_view一样是表达式的叶子节点，可以参与逐元素运算，也可以构造mat
+ * 下游层需要的是W.dot(x)时用left_dot按段读取，累加顺序与W.dot(stretch_one_col(...))相同
+ * 视图只保存地址，被引用的mat要比视图活得久
+ */
+template<typename val_t, int... sizes>
+struct concat_col_view :public mat_expr<concat_col_view<val_t, sizes...> >
+{
+	using type = val_t;
+	static constexpr int r = (sizes + ...);
+	static constexpr int c = 1;
+	static constexpr int part_num = sizeof...(sizes);
+	static constexpr int sz_size[part_num] = { sizes... };
+	const val_t* sz_p[part_num];
+
+	template<typename... ptr_ts>
+	explicit concat_col_view(ptr_ts... ps) :sz_p{ ps... }
 	{
-		for (int j = 0; j < i2; ++j) 
+	}
+
+	type get(const int& i_row, const int& i_col) const
+	{
+		return at(i_row);
+	}
+
+	const type& at(int idx) const
+	{
+		int k = 0;
+		for (; k < part_num - 1 && idx >= sz_size[k]; ++k)
+			idx -= sz_size[k];
+		return sz_p[k][idx];
+	}
+
+	/* 整段落在一个mat里时直接返回它的内存，跨越多个mat时复制到p_buf */
+	const type* block(int i0, const int& n, type* p_buf) const
+	{
+		int k = 0;
+		for (; k < part_num - 1 && i0 >= sz_size[k]; ++k)
+			i0 -= sz_size[k];
+		if (i0 + n <= sz_size[k])
+			return sz_p[k] + i0;
+		for (int i_done = 0; i_done < n; ++k, i0 = 0)
 		{
-			ret.get(i, j) = abs(mt.get(i, j));
+			const int i_cpy = std::min(n - i_done, sz_size[k] - i0);
+			std::copy(sz_p[k] + i0, sz_p[k] + i0 + i_cpy, p_buf + i_done);
+			i_done += i_cpy;
 		}
+		return p_buf;
 	}
-	return ret;
+
+	bool linear() const
+	{
+		return true;
+	}
+
+	bool conflict(const void* p_dst) const
+	{
+		for (int k = 0; k < part_num; ++k)
+		{
+			if (sz_p[k] == p_dst)
+				return true;
+		}
+		return false;
+	}
+
+	void copy_to(type* p) const
+	{
+		for (int k = 0; k < part_num; ++k)
+		{
+			std::copy(sz_p[k], sz_p[k] + sz_size[k], p);
+			p += sz_size[k];
+		}
+	}
+
+	/* mt_lhs.dot(*this)，按k从小到大累加 */
+	template<typename lhs_t>
+	mat<lhs_t::r, 1, val_t> left_dot(const lhs_t& mt_lhs) const
+	{
+		static_assert(is_mat<lhs_t>::value && lhs_t::c == r, "concat_col_view::left_dot: lhs must be a mat with r columns");
+		mat<lhs_t::r, 1, val_t> mt_ret;
+		const val_t* p_lhs = mt_lhs.pval->p;
+		for (int i = 0; i < lhs_t::r; ++i)
+		{
+			const val_t* p_row = p_lhs + i * r;
+			val_t v = 0;
+			for (int k = 0; k < part_num; ++k)
+			{
+				const val_t* p_part = sz_p[k];
+				for (int j = 0; j < sz_size[k]; ++j)
+				{
+					v = v + p_row[j] * p_part[j];
+				}
+				p_row += sz_size[k];
+			}
+			mt_ret.pval->p[i] = v;
+		}
+		return mt_ret;
+	}
+};
+
+/* 不复制数据的stretch_one_col */
+template<typename mat_t, typename ...mat_ts>
+concat_col_view<typename mat_t::type, mat_t::r * mat_t::c, mat_ts::r * mat_ts::c...> concat_col(const mat_t& mt, const mat_ts&...mts)
+{
+	static_assert(is_mat<mat_t>::value && (is_mat<mat_ts>::value && ...), "concat_col: operands must be mat");
+	static_assert((std::is_same<typename mat_t::type, typename mat_ts::type>::value && ...), "concat_col: operands must have the same element type");
+	return concat_col_view<typename mat_t::type, mat_t::r * mat_t::c, mat_ts::r * mat_ts::c...>(static_cast<const typename mat_t::type*>(mt.pval->p), static_cast<const typename mat_t::type*>(mts.pval->p)...);
 }
 
 #include "ht_memory.h"
+#include "ht_mapped_memory.h"
 
 template<typename val_t>
 void write_file(const val_t& vt, ht_memory& mry) 
 {
+	static_assert(std::is_trivially_copyable<val_t>::value, "write_file: type need its own write_file");
 	mry << vt;
 }
 
-template<int row_num, int col_num, typename val_t>
-void write_file(const mat<row_num, col_num, val_t>& mt, ht_memory& mry)
+/*
+ * mry.tensor_align()非0时，堆上(heap/cow存储)的算术类型矩阵先写对齐值和元素字节数，再补齐到tensor_align的倍数写元素，
+ * 这样从ht_mapped_memory读取时矩阵可以直接指向文件中的元素
+ * 内联存储的小矩阵总是紧密排列；读取时核对对齐值和字节数，与写入时不同则标记读取失败
+ */
+template<typename mat_t>
+struct is_mappable_mat
 {
-	for (int r = 0; r < row_num; ++r)
+	static constexpr bool value = std::is_arithmetic<typename mat_t::type>::value && mat_t::storage_t::can_share;
+};
+
+template<int row_num, int col_num, typename val_t, template<int, typename> class storage_tpl>
+void write_file(const mat<row_num, col_num, val_t, storage_tpl>& mt, ht_memory& mry)
+{
+	using mat_t = mat<row_num, col_num, val_t, storage_tpl>;
+	if constexpr (is_mappable_mat<mat_t>::value)
 	{
-		for (int c = 0; c < col_num; ++c)
+		if (mry.tensor_align() != 0)
 		{
-			write_file(mt.get(r, c), mry);
+			mry << static_cast<unsigned int>(mry.tensor_align()) << static_cast<unsigned long long>(sizeof(val_t) * row_num * col_num);
+			mry.align_write(mry.tensor_align());
+			mry.write_array(mt.pval->p, row_num * col_num);
+			return;
+		}
+	}
+	if constexpr (std::is_arithmetic<val_t>::value)
+	{
+		/* 元素按行主序连续存放，与逐个写入的顺序相同 */
+		mry.write_array(mt.pval->p, row_num * col_num);
+	}
+	else
+	{
+		for (int r = 0; r < row_num; ++r)
+		{
+			for (int c = 0; c < col_num; ++c)
+			{
+				write_file(mt.get(r, c), mry);
+			}
 		}
 	}
 }
@@ -471,17 +887,60 @@ void write_file(const mat<row_num, col_num, val_t>& mt, ht_memory& mry)
 template<typename val_t>
 void read_file(ht_memory& mry, val_t& vt) 
 {
+	static_assert(std::is_trivially_copyable<val_t>::value, "read_file: type need its own read_file");
 	mry >> vt;
 }
 
-template<int row_num, int col_num, typename val_t>
-void read_file(ht_memory& mry, mat<row_num, col_num, val_t>& mt)
+/* 映射的内存区端序与本机相同且地址满足mat_m的对齐时，矩阵直接引用映射中的数据，否则逐元素复制 */
+template<int row_num, int col_num, typename val_t, template<int, typename> class storage_tpl>
+void read_file(ht_memory& mry, mat<row_num, col_num, val_t, storage_tpl>& mt)
 {
-	for (int r = 0; r < row_num; ++r)
+	using mat_t = mat<row_num, col_num, val_t, storage_tpl>;
+	if constexpr (is_mappable_mat<mat_t>::value)
+	{
+		if (mry.tensor_align() != 0)
+		{
+			constexpr size_t u_bytes = sizeof(val_t) * row_num * col_num;
+			unsigned int u_align = 0;
+			unsigned long long ull_bytes = 0;
+			if (!mry.try_get(u_align) || !mry.try_get(ull_bytes) || u_align != mry.tensor_align() || ull_bytes != u_bytes)
+			{
+				mry.set_read_fail();
+				return;
+			}
+			mry.align_read(u_align);
+			if (mry.size() < u_bytes)
+			{
+				mry.set_read_fail();
+				return;
+			}
+			std::shared_ptr<void> sp_owner = mry.buf_owner();
+			unsigned char* p = mry.buf();
+			if (sp_owner && !mry.need_swap() && reinterpret_cast<uintptr_t>(p) % mat_t::mat_m_t::alignment == 0)
+			{
+				mt.pval = typename mat_t::storage_t(mat_m_ref<row_num * col_num, val_t>::make(reinterpret_cast<val_t*>(p), std::move(sp_owner)));
+				mry.skip(u_bytes);
+				return;
+			}
+			if (mry.read_array(mt.pval->p, row_num * col_num) != static_cast<size_t>(row_num * col_num))
+				mry.set_read_fail();
+			return;
+		}
+	}
+	if constexpr (std::is_arithmetic<val_t>::value)
+	{
+		/* 剩余数据不够一个矩阵时标记读取失败 */
+		if (mry.read_array(mt.pval->p, row_num * col_num) != static_cast<size_t>(row_num * col_num))
+			mry.set_read_fail();
+	}
+	else
 	{
-		for (int c = 0; c < col_num; ++c)
+		for (int r = 0; r < row_num; ++r)
 		{
-			read_file(mry, mt.get(r, c));
+			for (int c = 0; c < col_num; ++c)
+			{
+				read_file(mry, mt.get(r, c));
+			}
 		}
 	}
 }
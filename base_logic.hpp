@@ -1,26 +1,161 @@
 #ifndef _BASE_LOGIC_HPP_
 #define _BASE_LOGIC_HPP_
+#include <utility>
+#include "mat.hpp"
 
 /* ����������� */
 
-template<int r, int c, template<int, int> class op, typename omatt, typename... imatts>
-inline void row_loop(omatt& omt, const imatts&...imts)
+/*
+ * 逐元素映射：omt的(r, c)元素 = op<r, c>::cal(imts...)
+ * 元素个数不超过MAT_LOOP_UNROLL_MAX时按行主序完全展开，每个元素调用各自的op<r, c>::cal
+ * 更大的矩阵是一个运行时循环：mat参数换成指向当前元素的elem_view(表达式换成elem_expr_view)，调用op<0, 0>::cal，
+ * 因此op只能通过get(r, c)或get_val<r, c>()读取矩阵参数，与位置本身有关的计算要自己写循环
+ * 循环按MAT_LOOP_BLOCK个元素分段，段内循环次数是常数，不开-O3时编译器也能向量化
+ */
+#ifndef MAT_LOOP_UNROLL_MAX
+#define MAT_LOOP_UNROLL_MAX 16
+#endif
+
+#ifndef MAT_LOOP_BLOCK
+#define MAT_LOOP_BLOCK 8
+#endif
+
+/* 指向mat中某个元素的视图，get(r, c)读取相对该元素偏移(r, c)的元素 */
+template<typename mat_t>
+struct elem_view
+{
+	using type = typename mat_t::type;
+	static constexpr int r = mat_t::r;
+	static constexpr int c = mat_t::c;
+	const type* p;
+
+	const type& get(const int& i_row, const int& i_col) const
+	{
+		return p[i_row * c + i_col];
+	}
+
+	template<int i_row, int i_col>
+	const type& get_val() const
+	{
+		return p[i_row * c + i_col];
+	}
+};
+
+/* 表达式(转置、视图、表达式节点等)没有连续的内存，按行列下标读取 */
+template<typename expr_t>
+struct elem_expr_view
+{
+	using type = typename expr_t::type;
+	static constexpr int r = expr_t::r;
+	static constexpr int c = expr_t::c;
+	const expr_t& e;
+	int i_row;
+	int i_col;
+
+	type get(const int& i_row_delta, const int& i_col_delta) const
+	{
+		return e.get(i_row + i_row_delta, i_col + i_col_delta);
+	}
+
+	template<int i_row_delta, int i_col_delta>
+	type get_val() const
+	{
+		return e.get(i_row + i_row_delta, i_col + i_col_delta);
+	}
+};
+
+/* 循环中传给op的参数：mat换成第i_idx个元素的视图，表达式换成按下标读取的视图，其它参数原样传入 */
+template<typename arg_t, bool b_expr = is_mat_expr<arg_t>::value>
+struct elem_loop_arg
+{
+	template<int row_num, int col_num>
+	static constexpr bool fits = true;
+
+	template<int col_num>
+	static const arg_t& at(const arg_t& arg, const int&)
+	{
+		return arg;
+	}
+};
+
+template<typename arg_t>
+struct elem_loop_arg<arg_t, true>
 {
-	omt.template get_val<r, c>() = op<r, c>::cal(imts...);
-	if constexpr (r != 0)
+	template<int row_num, int col_num>
+	static constexpr bool fits = (row_num == arg_t::r && col_num == arg_t::c);
+
+	template<int col_num>
+	static elem_expr_view<arg_t> at(const arg_t& e, const int& i_idx)
 	{
-		row_loop<r - 1, c, op>(omt, imts...);
+		return elem_expr_view<arg_t>{ e, i_idx / col_num, i_idx % col_num };
 	}
+};
+
+template<int mat_row, int mat_col, typename val_t, template<int, typename> class storage_tpl>
+struct elem_loop_arg<mat<mat_row, mat_col, val_t, storage_tpl>, false>
+{
+	using mat_t = mat<mat_row, mat_col, val_t, storage_tpl>;
+
+	template<int row_num, int col_num>
+	static constexpr bool fits = (row_num == mat_row && col_num == mat_col);
+
+	template<int col_num>
+	static elem_view<mat_t> at(const mat_t& mt, const int& i_idx)
+	{
+		return elem_view<mat_t>{ mt.pval->p + i_idx };
+	}
+};
+
+/* 展开计算从第col_base列开始、每行col_num个元素的区域，序号idx对应(idx / col_num, col_base + idx % col_num) */
+template<template<int, int> class op, int col_num, int col_base, typename omatt, int... idx, typename... imatts>
+inline void elem_unroll(omatt& omt, std::integer_sequence<int, idx...>, const imatts&...imts)
+{
+	((omt.template get_val<idx / col_num, col_base + idx % col_num>() = op<idx / col_num, col_base + idx % col_num>::cal(imts...)), ...);
 }
 
-template<int c, template<int, int> class op, typename omatt, typename...imatts>
-inline void col_loop(omatt& omt, const imatts&...imts)
+template<template<int, int> class op, typename omatt, typename... imatts>
+inline void elem_map(omatt& omt, const imatts&...imts)
 {
-	row_loop<omt.r - 1, c, op>(omt, imts...);
-	if constexpr (c != 0)
+	constexpr int i_size = omatt::r * omatt::c;
+	/* 形状不同的mat参数无法按同一个序号访问，只能展开 */
+	if constexpr (i_size <= MAT_LOOP_UNROLL_MAX || !(elem_loop_arg<imatts>::template fits<omatt::r, omatt::c> && ...))
 	{
-		col_loop<c - 1, op>(omt, imts...);
+		elem_unroll<op, omatt::c, 0>(omt, std::make_integer_sequence<int, i_size>(), imts...);
 	}
+	else
+	{
+		auto* p_out = omt.pval->p;
+		int i = 0;
+		using type = typename omatt::type;
+		for (; i + MAT_LOOP_BLOCK <= i_size; i += MAT_LOOP_BLOCK)
+		{
+			/* 先写到局部数组，输出可能与输入是同一块内存，直接写回时编译器不敢向量化 */
+			type sz_block[MAT_LOOP_BLOCK];
+			for (int k = 0; k < MAT_LOOP_BLOCK; ++k)
+				sz_block[k] = op<0, 0>::cal(elem_loop_arg<imatts>::template at<omatt::c>(imts, i + k)...);
+			for (int k = 0; k < MAT_LOOP_BLOCK; ++k)
+				p_out[i + k] = sz_block[k];
+		}
+		for (; i < i_size; ++i)
+			p_out[i] = op<0, 0>::cal(elem_loop_arg<imatts>::template at<omatt::c>(imts, i)...);
+	}
+}
+
+/* 计算第c列的第0~r行 */
+template<int r, int c, template<int, int> class op, typename omatt, typename... imatts>
+inline void row_loop(omatt& omt, const imatts&...imts)
+{
+	elem_unroll<op, 1, c>(omt, std::make_integer_sequence<int, r + 1>(), imts...);
+}
+
+/* 计算第0~c列，覆盖整个矩阵时就是elem_map */
+template<int c, template<int, int> class op, typename omatt, typename...imatts>
+inline void col_loop(omatt& omt, const imatts&...imts)
+{
+	if constexpr (c == omatt::c - 1)
+		elem_map<op>(omt, imts...);
+	else
+		elem_unroll<op, c + 1, 0>(omt, std::make_integer_sequence<int, omatt::r * (c + 1)>(), imts...);
 }
 
 #endif
@@ -3,8 +3,11 @@
 
 #include <initializer_list>
 #include <iomanip>
+#include <string>
+#include <vector>
 
 #include "mat.hpp"
+#include "dmat.hpp"
 #include "base_function.hpp"
 #include "base_logic.hpp"
 #include "update_methods.hpp"
@@ -38,19 +41,22 @@ struct bp
 		return net_next.forward(act_func.forward(mt_weight.dot(mt_input) + mt_b));
 	}
 
-	inline auto update(const mat<i2, batch_size, val_t>& mt_delta)
+	/* mt_delta可以是mat、表达式或mat_view(例如上一层输出的某一列)，只在与激活函数导数相乘时读取一次，不必先复制成mat */
+	template<typename delta_t>
+	inline auto update(const delta_t& mt_delta)
 	{
 		/*����Ȩֵ����*/
 		auto mt_desig_origin = act_func.backward();
-		auto mt_desig = mt_desig_origin * mt_delta;							// �ش������sigmoid������˵�ֵ
+		mat<i2, batch_size, val_t> mt_desig = mt_desig_origin * mt_delta;							// �ش������sigmoid������˵�ֵ
 		auto mt_update = mt_desig.dot(mt_in.t());							// ����Ȩֵ�仯����
 		auto mt_ret = mt_weight.t().dot(mt_desig);
-		mt_weight = ad.update(mt_weight, mt_update);
-		mt_b = adb.update(mt_b, mt_desig);									// ����ƫ����
+		ad.step(mt_weight, mt_update);
+		adb.step(mt_b, mt_desig);									// ����ƫ����
 		return mt_ret;
 	}
 
-	inline auto backward(const mat<out_dim, batch_size, val_t>& mt_pre_delta)
+	template<typename delta_t>
+	inline auto backward(const delta_t& mt_pre_delta)
 	{
 		auto mt_delta = net_next.backward(mt_pre_delta);
 		return update(mt_delta);
@@ -103,19 +109,21 @@ struct bp<val_t, batch_size, update_method_templ, activate_func, init_name_t, i1
 		return mt_out;
 	}
 
-	inline auto update(const mat<i2, batch_size, val_t>& mt_delta)
+	template<typename delta_t>
+	inline auto update(const delta_t& mt_delta)
 	{
 		/*����Ȩֵ����*/
 		auto mt_desig_origin = act_func.backward();
-		auto mt_desig = mt_desig_origin * mt_delta;			// �ش������sigmoid������˵�ֵ
+		mat<i2, batch_size, val_t> mt_desig = mt_desig_origin * mt_delta;			// �ش������sigmoid������˵�ֵ
 		auto mt_update = mt_desig.dot(mt_in.t());
 		auto mt_ret = mt_weight.t().dot(mt_desig);
-		mt_weight = ad.update(mt_weight, mt_update);
-		mt_b = adb.update(mt_b, mt_desig);
+		ad.step(mt_weight, mt_update);
+		adb.step(mt_b, mt_desig);
 		return mt_ret;
 	}
 
-	inline auto backward(const mat<i2, batch_size, val_t>& mt_delta)
+	template<typename delta_t>
+	inline auto backward(const delta_t& mt_delta)
 	{
 		//mt_delta = mt_out - mt_expected
 		return update(mt_delta);
@@ -138,6 +146,81 @@ struct bp<val_t, batch_size, update_method_templ, activate_func, init_name_t, i1
 	}
 };
 
+/*
+ * 拓扑在运行时给出的bp网络，vec_dim = {输入维数, 隐层1, ..., 输出维数}
+ * 每层的权值、偏置都是dmat，所有层共用同一份gemm和SIMD内核，修改层数或神经元个数不需要重新编译
+ * 每层的计算与bp相同
+ */
+template<typename val_t, template<typename> class update_method_templ, template<typename> class activate_func, typename init_name_t>
+struct dbp
+{
+	using mat_t = dmat<val_t>;
+	struct layer
+	{
+		mat_t mt_weight;
+		mat_t mt_in;
+		mat_t mt_b;
+		update_method_templ<mat_t> ad;
+		update_method_templ<mat_t> adb;
+		activate_func<mat_t> act_func;
+	};
+	std::vector<layer> vec_layer;
+	int batch_size;
+
+	dbp(const std::vector<int>& vec_dim, const int& batch_size_i = 1) :vec_layer(vec_dim.size() - 1), batch_size(batch_size_i)
+	{
+		for (size_t i = 0; i < vec_layer.size(); ++i)
+		{
+			vec_layer[i].mt_weight = mat_t(vec_dim[i + 1], vec_dim[i]);
+			vec_layer[i].mt_b = mat_t(vec_dim[i + 1], batch_size);
+			weight_initilizer<init_name_t>::cal(vec_layer[i].mt_weight);
+		}
+	}
+
+	mat_t forward(const mat_t& mt_input)
+	{
+		mat_t mt_out = mt_input;
+		for (auto& l : vec_layer)
+		{
+			l.mt_in = mt_out;
+			mt_out = l.act_func.forward(l.mt_weight.dot(mt_out) + l.mt_b);
+		}
+		return mt_out;
+	}
+
+	mat_t backward(const mat_t& mt_delta)
+	{
+		mat_t mt_ret = mt_delta;
+		for (auto itr = vec_layer.rbegin(); itr != vec_layer.rend(); ++itr)
+		{
+			layer& l = *itr;
+			mat_t mt_desig = l.act_func.backward() * mt_ret;
+			mat_t mt_update = mt_desig.dot(l.mt_in.t());
+			mt_ret = l.mt_weight.t().dot(mt_desig);
+			l.ad.step(l.mt_weight, mt_update);
+			l.adb.step(l.mt_b, mt_desig);
+		}
+		return mt_ret;
+	}
+
+	void print() const
+	{
+		for (auto& l : vec_layer)
+		{
+			l.mt_weight.print();
+		}
+	}
+
+	void update_inert()
+	{
+		for (auto& l : vec_layer)
+		{
+			l.ad.update_inert();
+			l.adb.update_inert();
+		}
+	}
+};
+
 template<typename val_t, int batch_size, template<typename> class update_method_templ, template<typename> class activate_func, typename init_name_t, int i1, int i2, int...is>
 void write_file(const bp<val_t, batch_size, update_method_templ, activate_func, init_name_t, i1, i2, is...>& b, ht_memory& mry)
 {
@@ -160,4 +243,42 @@ void read_file(ht_memory& mry, bp<val_t, batch_size, update_method_templ, activa
 	}
 }
 
+/* 第i层的矩阵名为prefix + "{i}.weight"、"{i}.bias"(见tensor_file.hpp) */
+template<typename val_t, int batch_size, template<typename> class update_method_templ, template<typename> class activate_func, typename init_name_t, int i1, int i2, int...is, typename visitor_t>
+void visit_tensors(bp<val_t, batch_size, update_method_templ, activate_func, init_name_t, i1, i2, is...>& b, const std::string& prefix, visitor_t&& v, const int& i_layer = 0)
+{
+	const std::string str_layer = prefix + std::to_string(i_layer) + ".";
+	visit_tensors(b.mt_weight, str_layer + "weight", v);
+	visit_tensors(b.mt_b, str_layer + "bias", v);
+	if constexpr (0 != sizeof...(is))
+	{
+		visit_tensors(b.net_next, prefix, v, i_layer + 1);
+	}
+}
+
+template<typename val_t, template<typename> class update_method_templ, template<typename> class activate_func, typename init_name_t>
+void write_file(const dbp<val_t, update_method_templ, activate_func, init_name_t>& b, ht_memory& mry)
+{
+	mry << static_cast<int>(b.vec_layer.size()) << b.batch_size;
+	for (auto& l : b.vec_layer)
+	{
+		write_file(l.mt_weight, mry);
+		write_file(l.mt_b, mry);
+	}
+}
+
+/* 层数和每层的形状都从文件中读取 */
+template<typename val_t, template<typename> class update_method_templ, template<typename> class activate_func, typename init_name_t>
+void read_file(ht_memory& mry, dbp<val_t, update_method_templ, activate_func, init_name_t>& b)
+{
+	int i_layer_num = 0;
+	mry >> i_layer_num >> b.batch_size;
+	b.vec_layer.assign(i_layer_num, typename dbp<val_t, update_method_templ, activate_func, init_name_t>::layer());
+	for (auto& l : b.vec_layer)
+	{
+		read_file(mry, l.mt_weight);
+		read_file(mry, l.mt_b);
+	}
+}
+
 #endif
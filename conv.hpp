@@ -0,0 +1,179 @@
+#ifndef _CONV_HPP_
+#define _CONV_HPP_
+#include <algorithm>
+#include <cstring>
+#include "gemm.hpp"
+#include "simd_kernel.hpp"
+
+/*
+ * 二维卷积引擎(与inner_conv一样不翻转卷积核，即互相关)：
+ *   out(n, oc, i, j) = sum_{ic, a, b} in(n, ic, i*stride_h + a - pad_top, j*stride_w + b - pad_left) * kernel(oc, ic, a, b)
+ * 落在输入之外(补边)的位置按0计算；所有尺寸都是运行时参数，循环不再随卷积核和输出的大小展开成模板
+ * 每个通道是一个行主序的连续平面，plane_in(n, ic)、plane_kernel(oc, ic)、plane_out(n, oc)给出平面首地址，
+ * 因此通道之间不要求连续，mat、dmat或一整块内存都可以直接传入
+ * 两种计算方式：
+ *   im2col：把每个输出位置用到的in_c*k_h*k_w个输入排成col的一列，卷积变成kernel(out_c*CKK) * col(CKK*OHW)，交给gemm
+ *   直接卷积：对卷积核的每个元素，把输出的一行加上输入对应的一行乘以该元素，步长为1时这一行交给simd_kernels::mul_add_s
+ * 两种方式都按(ic, a, b)从小到大累加，直接卷积的乘加可能合成fma，两者只差舍入误差
+ * conv2d在gemm能走打包路径时用im2col，否则直接卷积
+ */
+struct conv_shape
+{
+	int in_c;
+	int in_h;
+	int in_w;
+	int out_c;
+	int k_h;
+	int k_w;
+	int stride_h = 1;
+	int stride_w = 1;
+	int pad_top = 0;
+	int pad_left = 0;
+	int pad_bottom = 0;
+	int pad_right = 0;
+
+	int out_h() const { return (in_h + pad_top + pad_bottom - k_h) / stride_h + 1; }
+	int out_w() const { return (in_w + pad_left + pad_right - k_w) / stride_w + 1; }
+	/* im2col后每一列的长度 */
+	int col_size() const { return in_c * k_h * k_w; }
+};
+
+/* 输出下标i在[i_begin, i_end)内时，输入下标i*i_step + i_off落在[0, i_in)内 */
+inline void conv_valid_range(const int& i_out, const int& i_step, const int& i_off, const int& i_in, int& i_begin, int& i_end)
+{
+	i_begin = i_off >= 0 ? 0 : (-i_off + i_step - 1) / i_step;
+	i_end = i_in - 1 - i_off < 0 ? 0 : std::min(i_out, (i_in - 1 - i_off) / i_step + 1);
+	if (i_begin > i_end)
+		i_begin = i_end;
+}
+
+/* 卷积用的缓冲区按线程复用，与gemm的打包缓冲区分开，计算gemm时不会被覆盖 */
+template<typename val_t>
+inline val_t* conv_buffer(const int& i_idx, const size_t& siz)
+{
+	thread_local gemm_aligned_buffer<val_t> sz_buf[3];
+	return sz_buf[i_idx].reserve(siz);
+}
+
+/* 第n张图的im2col：col的第(ic*k_h + a)*k_w + b行、第i*OW + j列是in(n, ic, i*stride_h + a - pad_top, j*stride_w + b - pad_left) */
+template<typename val_t, typename plane_in_t>
+void conv_im2col(const conv_shape& s, const int& n, const plane_in_t& plane_in, val_t* p_col)
+{
+	const int OH = s.out_h(), OW = s.out_w();
+	for (int ic = 0; ic < s.in_c; ++ic)
+	{
+		const val_t* p_in = plane_in(n, ic);
+		for (int a = 0; a < s.k_h; ++a)
+		{
+			int i0 = 0, i1 = 0;
+			conv_valid_range(OH, s.stride_h, a - s.pad_top, s.in_h, i0, i1);
+			for (int b = 0; b < s.k_w; ++b)
+			{
+				int j0 = 0, j1 = 0;
+				conv_valid_range(OW, s.stride_w, b - s.pad_left, s.in_w, j0, j1);
+				val_t* p_dst = p_col + static_cast<size_t>((ic * s.k_h + a) * s.k_w + b) * OH * OW;
+				std::fill(p_dst, p_dst + i0 * OW, val_t(0));
+				for (int i = i0; i < i1; ++i)
+				{
+					const val_t* p_row = p_in + (i * s.stride_h + a - s.pad_top) * s.in_w;
+					val_t* p_out = p_dst + i * OW;
+					const int i_off = b - s.pad_left;
+					std::fill(p_out, p_out + j0, val_t(0));
+					if (s.stride_w == 1)
+						std::copy(p_row + j0 + i_off, p_row + j1 + i_off, p_out + j0);
+					else
+						for (int j = j0; j < j1; ++j)
+							p_out[j] = p_row[j * s.stride_w + i_off];
+					std::fill(p_out + j1, p_out + OW, val_t(0));
+				}
+				std::fill(p_dst + i1 * OW, p_dst + OH * OW, val_t(0));
+			}
+		}
+	}
+}
+
+/* im2col + gemm，卷积核先按(oc, ic, a, b)打包成out_c*CKK的行主序矩阵，每张图共用 */
+template<typename val_t, typename plane_in_t, typename plane_kernel_t, typename plane_out_t>
+void conv2d_im2col(const conv_shape& s, const int& i_batch, const plane_in_t& plane_in, const plane_kernel_t& plane_kernel, const plane_out_t& plane_out)
+{
+	const int OHW = s.out_h() * s.out_w(), CKK = s.col_size(), KK = s.k_h * s.k_w;
+	val_t* p_kernel = conv_buffer<val_t>(0, static_cast<size_t>(s.out_c) * CKK);
+	val_t* p_col = conv_buffer<val_t>(1, static_cast<size_t>(CKK) * OHW);
+	val_t* p_ret = conv_buffer<val_t>(2, static_cast<size_t>(s.out_c) * OHW);
+	for (int oc = 0; oc < s.out_c; ++oc)
+	{
+		for (int ic = 0; ic < s.in_c; ++ic)
+		{
+			const val_t* p_src = plane_kernel(oc, ic);
+			std::copy(p_src, p_src + KK, p_kernel + oc * CKK + ic * KK);
+		}
+	}
+	for (int n = 0; n < i_batch; ++n)
+	{
+		conv_im2col(s, n, plane_in, p_col);
+		gemm<false, false>(s.out_c, OHW, CKK, p_kernel, p_col, p_ret);
+		for (int oc = 0; oc < s.out_c; ++oc)
+		{
+			std::memcpy(plane_out(n, oc), p_ret + oc * OHW, OHW * sizeof(val_t));
+		}
+	}
+}
+
+/* 直接卷积：不需要额外的缓冲区，适合单通道、小卷积核 */
+template<typename val_t, typename plane_in_t, typename plane_kernel_t, typename plane_out_t>
+void conv2d_direct(const conv_shape& s, const int& i_batch, const plane_in_t& plane_in, const plane_kernel_t& plane_kernel, const plane_out_t& plane_out)
+{
+	const int OH = s.out_h(), OW = s.out_w();
+	const simd_kernels<val_t>& k = simd_kernels<val_t>::get();
+	for (int n = 0; n < i_batch; ++n)
+	{
+		for (int oc = 0; oc < s.out_c; ++oc)
+		{
+			val_t* p_out = plane_out(n, oc);
+			std::fill(p_out, p_out + OH * OW, val_t(0));
+			for (int ic = 0; ic < s.in_c; ++ic)
+			{
+				const val_t* p_in = plane_in(n, ic);
+				const val_t* p_k = plane_kernel(oc, ic);
+				for (int a = 0; a < s.k_h; ++a)
+				{
+					int i0 = 0, i1 = 0;
+					conv_valid_range(OH, s.stride_h, a - s.pad_top, s.in_h, i0, i1);
+					for (int b = 0; b < s.k_w; ++b)
+					{
+						int j0 = 0, j1 = 0;
+						conv_valid_range(OW, s.stride_w, b - s.pad_left, s.in_w, j0, j1);
+						const val_t v = p_k[a * s.k_w + b];
+						const int i_off = b - s.pad_left;
+						for (int i = i0; i < i1; ++i)
+						{
+							const val_t* p_row = p_in + (i * s.stride_h + a - s.pad_top) * s.in_w;
+							val_t* p_dst = p_out + i * OW;
+							if (s.stride_w == 1)
+							{
+								k.mul_add_s(p_row + j0 + i_off, v, p_dst + j0, j1 - j0);
+							}
+							else
+							{
+								for (int j = j0; j < j1; ++j)
+									p_dst[j] = p_dst[j] + v * p_row[j * s.stride_w + i_off];
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+/* im2col的代价是把输入复制k_h*k_w遍，只有gemm能走打包路径(三个维度都不小于16)时才划算 */
+template<typename val_t, typename plane_in_t, typename plane_kernel_t, typename plane_out_t>
+void conv2d(const conv_shape& s, const int& i_batch, const plane_in_t& plane_in, const plane_kernel_t& plane_kernel, const plane_out_t& plane_out)
+{
+	if (s.out_c >= 16 && s.col_size() >= 16 && s.out_h() * s.out_w() >= 16)
+		conv2d_im2col<val_t>(s, i_batch, plane_in, plane_kernel, plane_out);
+	else
+		conv2d_direct<val_t>(s, i_batch, plane_in, plane_kernel, plane_out);
+}
+
+#endif
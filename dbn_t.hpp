@@ -1,6 +1,7 @@
 #ifndef _DBN_HPP_
 #define _DBN_HPP_
 
+#include <string>
 #include "mat.hpp"
 #include "restricked_boltzman_machine.hpp"
 #include "loss_function.hpp"
@@ -19,7 +20,7 @@ struct dbn_t
 	using pretrain_ret_type = typename next_type::pretrain_ret_type;
 
 
-	void pretrain(const std::vector<mat<iv, 1> >& vec, const int& i_epochs = 100, const bool& sample = true) 
+	void pretrain(const std::vector<mat<iv, 1, val_t> >& vec, const int& i_epochs = 100, const bool& sample = true) 
 	{
 		/* 训练当前层 */
 		for (int i = 0; i < i_epochs; ++i)
@@ -54,11 +55,26 @@ struct dbn_t
 		dbn_next.template finetune<loss_func_t>(vec_expected, i_epochs);              // 让最后一层bp层进行训练
 	}
 
-	auto forward(const mat<iv, 1>& v1, const bool& sample = true)
+	auto forward(const mat<iv, 1, val_t>& v1, const bool& sample = true)
 	{
 		return dbn_next.forward(rbm.forward(v1, sample), sample);
 	}
 
+	/* 第i_layer层的RBM，可以单独从张量目录文件中读取(见tensor_file.hpp) */
+	template<int i_layer>
+	auto& layer()
+	{
+		if constexpr (i_layer == 0)
+			return rbm;
+		else
+			return dbn_next.template layer<i_layer - 1>();
+	}
+
+	/* 最后的预测网络 */
+	auto& predict()
+	{
+		return dbn_next.predict();
+	}
 };
 
 template<template<int> class predict_t, typename val_t, int iv, int ih>
@@ -72,7 +88,7 @@ struct dbn_t<predict_t, val_t, iv, ih>
 	using ret_type = typename predict_t<ih>::ret_type;	// 预测结果类型
 	using pretrain_ret_type = mat<ih, 1, val_t>;
 
-	void pretrain(const std::vector<mat<iv, 1> >& vec, const int& i_epochs = 100, const bool& sample = true)
+	void pretrain(const std::vector<mat<iv, 1, val_t> >& vec, const int& i_epochs = 100, const bool& sample = true)
 	{
 		/* 训练当前层 */
 		for (int i = 0; i < i_epochs; ++i)
@@ -108,10 +124,22 @@ struct dbn_t<predict_t, val_t, iv, ih>
 		vec_pretrain_result.clear(); // 清空预训练结果
 	}
 
-	auto forward(const mat<iv, 1>& v1, const bool& sample = true)
+	auto forward(const mat<iv, 1, val_t>& v1, const bool& sample = true)
 	{
 		return predict_net.forward(rbm.forward(v1, sample));
 	}
+
+	template<int i_layer>
+	auto& layer()
+	{
+		static_assert(i_layer == 0, "dbn_t::layer: layer index out of range");
+		return rbm;
+	}
+
+	predict_t<ih>& predict()
+	{
+		return predict_net;
+	}
 };
 
 
@@ -141,5 +169,20 @@ void read_file(ht_memory& mry, dbn_t<predict_t, val_t, iv, ih, is...>& dbn)
 	}
 }
 
+/* 第i层RBM的矩阵名以prefix + "rbm{i}."开头，最后的预测网络以prefix + "predict."开头(见tensor_file.hpp) */
+template<template<int> class predict_t, typename val_t, int iv, int ih, int...is, typename visitor_t>
+void visit_tensors(dbn_t<predict_t, val_t, iv, ih, is...>& dbn, const std::string& prefix, visitor_t&& v, const int& i_layer = 0)
+{
+	visit_tensors(dbn.rbm, prefix + "rbm" + std::to_string(i_layer) + ".", v);
+	if constexpr (0 != sizeof...(is))
+	{
+		visit_tensors(dbn.dbn_next, prefix, v, i_layer + 1);
+	}
+	if constexpr (0 == sizeof...(is))
+	{
+		visit_tensors(dbn.predict_net, prefix + "predict.", v);
+	}
+}
+
 
 #endif
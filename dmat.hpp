@@ -0,0 +1,584 @@
+#ifndef _DMAT_HPP_
+#define _DMAT_HPP_
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <iostream>
+#include <iomanip>
+#include "mat.hpp"
+
+/*
+ * 行列数在运行时确定的矩阵
+ * gemm和SIMD内核本来就以(指针, 长度, 步长)为参数，dmat直接调用它们，任意形状都只有一份内核代码
+ * 内存由pm持有，可能是dmat自己分配的缓冲区(按MAT_ALIGN对齐)，也可能是mat堆存储里的mat_m：
+ *   由mat构造dmat时复制元素；dmat::share(mt)与mt共享内存，不复制，之后通过dmat写入会改变mt
+ *   (inline_storage的小矩阵在mat对象内部，share也只能复制)
+ *   to_mat()在内存本来就来自同样大小的mat_m时原样交还，否则复制
+ * 拷贝构造、拷贝赋值是深拷贝(与mat的默认存储一致)；t()与mat::t()一样共享内存，形状在运行时确定，转置用b_t标记
+ * 形状不匹配时抛出std::runtime_error
+ */
+template<typename val_t = double>
+struct dmat
+{
+	static_assert(std::is_arithmetic<val_t>::value, "dmat: only arithmetic types are supported");
+	using type = val_t;
+	typedef val_t vt;
+	int row_num;
+	int col_num;
+	bool b_t;
+	std::shared_ptr<void> pm;
+	val_t* p;
+	int i_mat_size;					// pm是mat_m<i_mat_size, val_t>时记录其大小，否则为0
+
+	dmat() :row_num(0), col_num(0), b_t(false), p(nullptr), i_mat_size(0)
+	{
+	}
+	dmat(const int& rows, const int& cols, const val_t& v = val_t(0)) :row_num(rows), col_num(cols), b_t(false), p(nullptr), i_mat_size(0)
+	{
+		alloc();
+		std::fill(p, p + size(), v);
+	}
+	dmat(const dmat& other) :row_num(other.row_num), col_num(other.col_num), b_t(other.b_t), p(nullptr), i_mat_size(0)
+	{
+		alloc();
+		std::copy(other.p, other.p + size(), p);
+	}
+	dmat(dmat&& other) noexcept :row_num(other.row_num), col_num(other.col_num), b_t(other.b_t), pm(std::move(other.pm)), p(other.p), i_mat_size(other.i_mat_size)
+	{
+		other.row_num = other.col_num = other.i_mat_size = 0;
+		other.p = nullptr;
+	}
+
+	/* 复制mat的元素 */
+	template<int r, int c, template<int, typename> class storage_tpl>
+	dmat(const mat<r, c, val_t, storage_tpl>& mt) :row_num(r), col_num(c), b_t(false), p(nullptr), i_mat_size(0)
+	{
+		alloc();
+		std::copy(mt.pval->p, mt.pval->p + r * c, p);
+	}
+
+	/* 与mt共享内存，不复制；cow_storage先与其它副本分开，之后的写入只影响mt和返回的dmat */
+	template<int r, int c, template<int, typename> class storage_tpl>
+	static dmat share(mat<r, c, val_t, storage_tpl>& mt)
+	{
+		if constexpr (mat<r, c, val_t, storage_tpl>::storage_t::can_share)
+		{
+			mt.pval.operator->();
+			dmat ret;
+			ret.row_num = r;
+			ret.col_num = c;
+			auto pm_m = mt.pval.owner();
+			ret.p = pm_m->p;
+			ret.pm = std::move(pm_m);
+			ret.i_mat_size = r * c;
+			return ret;
+		}
+		else
+		{
+			return dmat(mt);
+		}
+	}
+
+	/* mat::t()的结果，复制元素后用b_t标记转置 */
+	template<int r, int c, template<int, typename> class storage_tpl>
+	dmat(const transposed_mat<r, c, val_t, storage_tpl>& mt) :dmat(dmat(mt.t()).t())
+	{
+	}
+
+	/* 与heap_storage一样，自身内存被共享(例如来自mat或t())时换一块新内存，不改动共享方 */
+	dmat& operator=(const dmat& other)
+	{
+		if (this == &other)
+			return *this;
+		if (p == other.p || size() != other.size() || pm.use_count() != 1)
+		{
+			*this = dmat(other);
+			return *this;
+		}
+		row_num = other.row_num;
+		col_num = other.col_num;
+		b_t = other.b_t;
+		std::copy(other.p, other.p + size(), p);
+		return *this;
+	}
+	dmat& operator=(dmat&& other) noexcept
+	{
+		if (this == &other)
+			return *this;
+		row_num = other.row_num;
+		col_num = other.col_num;
+		b_t = other.b_t;
+		pm = std::move(other.pm);
+		p = other.p;
+		i_mat_size = other.i_mat_size;
+		other.row_num = other.col_num = other.i_mat_size = 0;
+		other.p = nullptr;
+		return *this;
+	}
+
+	template<int r, int c, template<int, typename> class storage_tpl = MAT_DEFAULT_STORAGE>
+	mat<r, c, val_t, storage_tpl> to_mat() const
+	{
+		using ret_t = mat<r, c, val_t, storage_tpl>;
+		check_shape(r, c, "dmat::to_mat");
+		if constexpr (ret_t::storage_t::can_share)
+		{
+			if (i_mat_size == r * c && !b_t)
+			{
+				auto pm_m = std::static_pointer_cast<typename ret_t::mat_m_t>(pm);
+				if (pm_m->p == p)
+					return ret_t(typename ret_t::storage_t(pm_m));
+			}
+		}
+		/* mat总是行主序，转置过的dmat按元素复制 */
+		ret_t ret;
+		if (!b_t)
+		{
+			std::copy(p, p + size(), ret.pval->p);
+			return ret;
+		}
+		for (int i = 0; i < r; ++i)
+		{
+			for (int j = 0; j < c; ++j)
+			{
+				ret.get(i, j) = get(i, j);
+			}
+		}
+		return ret;
+	}
+
+	int size() const
+	{
+		return row_num * col_num;
+	}
+
+	void check_shape(const int& rows, const int& cols, const char* sz_op) const
+	{
+		if (rows != row_num || cols != col_num)
+		{
+			throw std::runtime_error(std::string(sz_op) + ": 形状不匹配(" + std::to_string(row_num) + "*" + std::to_string(col_num)
+				+ " vs " + std::to_string(rows) + "*" + std::to_string(cols) + ")");
+		}
+	}
+
+	val_t& get(const int& i_row, const int& i_col)
+	{
+		if (!b_t)
+			return p[i_row * col_num + i_col];
+		else
+			return p[i_col * row_num + i_row];
+	}
+
+	val_t get(const int& i_row, const int& i_col) const
+	{
+		if (!b_t)
+			return p[i_row * col_num + i_col];
+		else
+			return p[i_col * row_num + i_row];
+	}
+
+	const val_t& operator[](const int& idx) const
+	{
+		return p[idx];
+	}
+
+	val_t& operator[](const int& idx)
+	{
+		return p[idx];
+	}
+
+	dmat t() const
+	{
+		dmat ret;
+		ret.row_num = col_num;
+		ret.col_num = row_num;
+		ret.b_t = !b_t;
+		ret.pm = pm;
+		ret.p = p;
+		ret.i_mat_size = i_mat_size;
+		return ret;
+	}
+
+	/* 按bt指定的内存布局复制一份，逐元素运算的两个操作数布局不同时使用 */
+	dmat layout_as(const bool& bt) const
+	{
+		dmat ret(row_num, col_num);
+		ret.b_t = bt;
+		for (int i = 0; i < row_num; ++i)
+		{
+			for (int j = 0; j < col_num; ++j)
+			{
+				ret.get(i, j) = get(i, j);
+			}
+		}
+		return ret;
+	}
+
+	gemm_operand<val_t> gemm_arg() const
+	{
+		if (!b_t)
+			return gemm_operand<val_t>{ p, col_num, 1 };
+		return gemm_operand<val_t>{ p, 1, row_num };
+	}
+
+	dmat dot(const dmat& mt) const
+	{
+		if (col_num != mt.row_num)
+		{
+			throw std::runtime_error(std::string("dmat::dot: 形状不匹配(") + std::to_string(row_num) + "*" + std::to_string(col_num)
+				+ " dot " + std::to_string(mt.row_num) + "*" + std::to_string(mt.col_num) + ")");
+		}
+		dmat ret(row_num, mt.col_num);
+		gemm(row_num, mt.col_num, col_num, gemm_arg(), mt.gemm_arg(), ret.p);
+		return ret;
+	}
+
+	val_t sum() const
+	{
+		return simd_kernels<val_t>::get().sum(p, size());
+	}
+
+	val_t max() const
+	{
+		return simd_kernels<val_t>::get().max(p, size());
+	}
+
+	val_t max_abs() const
+	{
+		return simd_kernels<val_t>::get().max_abs(p, size());
+	}
+
+	val_t argmax(int& i_row, int& i_col) const
+	{
+		const int idx = simd_kernels<val_t>::get().argmax(p, size());
+		const int i_ld = b_t ? row_num : col_num;
+		i_row = idx / i_ld;
+		i_col = idx % i_ld;
+		if (b_t)
+			std::swap(i_row, i_col);
+		return p[idx];
+	}
+
+	void print() const
+	{
+		std::cout << "[" << std::endl;
+		for (int i = 0; i < row_num; ++i)
+		{
+			std::cout << std::setw(3) << "[";
+			for (int j = 0; j < col_num; ++j)
+			{
+				std::cout << (j != 0 ? "," : "") << std::setw(10) << get(i, j);
+			}
+			std::cout << std::setw(3) << "]" << std::endl;
+		}
+		std::cout << "]" << std::endl;
+	}
+
+	/* 复合赋值：内存独占且与other布局相同时直接写回自身，否则与operator=一样换一块新内存 */
+	dmat& operator+=(const dmat& other) { return compound(other, simd_kernels<val_t>::get().add, "dmat::operator+="); }
+	dmat& operator-=(const dmat& other) { return compound(other, simd_kernels<val_t>::get().sub, "dmat::operator-="); }
+	dmat& operator*=(const dmat& other) { return compound(other, simd_kernels<val_t>::get().mul, "dmat::operator*="); }
+	dmat& operator/=(const dmat& other) { return compound(other, simd_kernels<val_t>::get().div, "dmat::operator/="); }
+	dmat& operator+=(const val_t& v) { return compound_s(v, simd_kernels<val_t>::get().add_s); }
+	dmat& operator-=(const val_t& v) { return compound_s(v, simd_kernels<val_t>::get().sub_s); }
+	dmat& operator*=(const val_t& v) { return compound_s(v, simd_kernels<val_t>::get().mul_s); }
+	dmat& operator/=(const val_t& v) { return compound_s(v, simd_kernels<val_t>::get().div_s); }
+
+	/* 逐元素运算：布局(b_t)相同时整块内存交给SIMD内核，否则先把rhs复制成lhs的布局 */
+	template<typename kernel_t>
+	static dmat binary(const dmat& a, const dmat& b, kernel_t kernel, const char* sz_op)
+	{
+		a.check_shape(b.row_num, b.col_num, sz_op);
+		if (a.b_t != b.b_t)
+			return binary(a, b.layout_as(a.b_t), kernel, sz_op);
+		dmat ret(a.row_num, a.col_num);
+		ret.b_t = a.b_t;
+		kernel(a.p, b.p, ret.p, a.size());
+		return ret;
+	}
+
+	/* lhs是即将销毁的临时矩阵时结果写回它的内存 */
+	template<typename kernel_t>
+	static dmat binary(dmat&& a, const dmat& b, kernel_t kernel, const char* sz_op)
+	{
+		a.compound(b, kernel, sz_op);
+		return std::move(a);
+	}
+
+	template<typename kernel_t>
+	static dmat scalar(const dmat& a, const val_t& v, kernel_t kernel)
+	{
+		dmat ret(a.row_num, a.col_num);
+		ret.b_t = a.b_t;
+		kernel(a.p, v, ret.p, a.size());
+		return ret;
+	}
+
+	template<typename kernel_t>
+	static dmat scalar(dmat&& a, const val_t& v, kernel_t kernel)
+	{
+		a.compound_s(v, kernel);
+		return std::move(a);
+	}
+
+	template<typename kernel_t>
+	static dmat unary(const dmat& a, kernel_t kernel)
+	{
+		dmat ret(a.row_num, a.col_num);
+		ret.b_t = a.b_t;
+		kernel(a.p, ret.p, a.size());
+		return ret;
+	}
+
+	template<typename kernel_t>
+	static dmat unary(dmat&& a, kernel_t kernel)
+	{
+		if (a.pm.use_count() != 1)
+			return unary(static_cast<const dmat&>(a), kernel);
+		kernel(a.p, a.p, a.size());
+		return std::move(a);
+	}
+
+private:
+	template<typename kernel_t>
+	dmat& compound(const dmat& other, kernel_t kernel, const char* sz_op)
+	{
+		check_shape(other.row_num, other.col_num, sz_op);
+		if (pm.use_count() != 1 || b_t != other.b_t)
+			return *this = binary(*this, other, kernel, sz_op);
+		kernel(p, other.p, p, size());
+		return *this;
+	}
+
+	template<typename kernel_t>
+	dmat& compound_s(const val_t& v, kernel_t kernel)
+	{
+		if (pm.use_count() != 1)
+			return *this = scalar(*this, v, kernel);
+		kernel(p, v, p, size());
+		return *this;
+	}
+
+	void alloc()
+	{
+		const size_t siz = static_cast<size_t>(size()) * sizeof(val_t);
+		mat_count_alloc(2);		// 缓冲区和shared_ptr的控制块
+		val_t* p_buf = static_cast<val_t*>(::operator new(siz ? siz : 1, std::align_val_t(MAT_ALIGN)));
+		pm = std::shared_ptr<void>(p_buf, [](void* p_del) { ::operator delete(p_del, std::align_val_t(MAT_ALIGN)); });
+		p = p_buf;
+	}
+};
+
+template<typename val_t>
+dmat<val_t> operator+(const dmat<val_t>& a, const dmat<val_t>& b)
+{
+	return dmat<val_t>::binary(a, b, simd_kernels<val_t>::get().add, "dmat::operator+");
+}
+
+template<typename val_t>
+dmat<val_t> operator+(dmat<val_t>&& a, const dmat<val_t>& b)
+{
+	return dmat<val_t>::binary(std::move(a), b, simd_kernels<val_t>::get().add, "dmat::operator+");
+}
+
+template<typename val_t>
+dmat<val_t> operator-(const dmat<val_t>& a, const dmat<val_t>& b)
+{
+	return dmat<val_t>::binary(a, b, simd_kernels<val_t>::get().sub, "dmat::operator-");
+}
+
+template<typename val_t>
+dmat<val_t> operator-(dmat<val_t>&& a, const dmat<val_t>& b)
+{
+	return dmat<val_t>::binary(std::move(a), b, simd_kernels<val_t>::get().sub, "dmat::operator-");
+}
+
+template<typename val_t>
+dmat<val_t> operator*(const dmat<val_t>& a, const dmat<val_t>& b)
+{
+	return dmat<val_t>::binary(a, b, simd_kernels<val_t>::get().mul, "dmat::operator*");
+}
+
+template<typename val_t>
+dmat<val_t> operator*(dmat<val_t>&& a, const dmat<val_t>& b)
+{
+	return dmat<val_t>::binary(std::move(a), b, simd_kernels<val_t>::get().mul, "dmat::operator*");
+}
+
+template<typename val_t>
+dmat<val_t> operator/(const dmat<val_t>& a, const dmat<val_t>& b)
+{
+	return dmat<val_t>::binary(a, b, simd_kernels<val_t>::get().div, "dmat::operator/");
+}
+
+template<typename val_t>
+dmat<val_t> operator/(dmat<val_t>&& a, const dmat<val_t>& b)
+{
+	return dmat<val_t>::binary(std::move(a), b, simd_kernels<val_t>::get().div, "dmat::operator/");
+}
+
+template<typename val_t>
+dmat<val_t> operator+(const dmat<val_t>& a, const typename dmat<val_t>::type& v)
+{
+	return dmat<val_t>::scalar(a, v, simd_kernels<val_t>::get().add_s);
+}
+
+template<typename val_t>
+dmat<val_t> operator+(dmat<val_t>&& a, const typename dmat<val_t>::type& v)
+{
+	return dmat<val_t>::scalar(std::move(a), v, simd_kernels<val_t>::get().add_s);
+}
+
+template<typename val_t>
+dmat<val_t> operator+(const typename dmat<val_t>::type& v, const dmat<val_t>& a)
+{
+	return dmat<val_t>::scalar(a, v, simd_kernels<val_t>::get().add_s);
+}
+
+template<typename val_t>
+dmat<val_t> operator+(const typename dmat<val_t>::type& v, dmat<val_t>&& a)
+{
+	return dmat<val_t>::scalar(std::move(a), v, simd_kernels<val_t>::get().add_s);
+}
+
+template<typename val_t>
+dmat<val_t> operator-(const dmat<val_t>& a, const typename dmat<val_t>::type& v)
+{
+	return dmat<val_t>::scalar(a, v, simd_kernels<val_t>::get().sub_s);
+}
+
+template<typename val_t>
+dmat<val_t> operator-(dmat<val_t>&& a, const typename dmat<val_t>::type& v)
+{
+	return dmat<val_t>::scalar(std::move(a), v, simd_kernels<val_t>::get().sub_s);
+}
+
+template<typename val_t>
+dmat<val_t> operator-(const typename dmat<val_t>::type& v, const dmat<val_t>& a)
+{
+	return dmat<val_t>::scalar(a, v, simd_kernels<val_t>::get().rsub_s);
+}
+
+template<typename val_t>
+dmat<val_t> operator-(const typename dmat<val_t>::type& v, dmat<val_t>&& a)
+{
+	return dmat<val_t>::scalar(std::move(a), v, simd_kernels<val_t>::get().rsub_s);
+}
+
+template<typename val_t>
+dmat<val_t> operator*(const dmat<val_t>& a, const typename dmat<val_t>::type& v)
+{
+	return dmat<val_t>::scalar(a, v, simd_kernels<val_t>::get().mul_s);
+}
+
+template<typename val_t>
+dmat<val_t> operator*(dmat<val_t>&& a, const typename dmat<val_t>::type& v)
+{
+	return dmat<val_t>::scalar(std::move(a), v, simd_kernels<val_t>::get().mul_s);
+}
+
+template<typename val_t>
+dmat<val_t> operator*(const typename dmat<val_t>::type& v, const dmat<val_t>& a)
+{
+	return dmat<val_t>::scalar(a, v, simd_kernels<val_t>::get().mul_s);
+}
+
+template<typename val_t>
+dmat<val_t> operator*(const typename dmat<val_t>::type& v, dmat<val_t>&& a)
+{
+	return dmat<val_t>::scalar(std::move(a), v, simd_kernels<val_t>::get().mul_s);
+}
+
+template<typename val_t>
+dmat<val_t> operator/(const dmat<val_t>& a, const typename dmat<val_t>::type& v)
+{
+	return dmat<val_t>::scalar(a, v, simd_kernels<val_t>::get().div_s);
+}
+
+template<typename val_t>
+dmat<val_t> operator/(dmat<val_t>&& a, const typename dmat<val_t>::type& v)
+{
+	return dmat<val_t>::scalar(std::move(a), v, simd_kernels<val_t>::get().div_s);
+}
+
+template<typename val_t>
+dmat<val_t> operator/(const typename dmat<val_t>::type& v, const dmat<val_t>& a)
+{
+	return dmat<val_t>::scalar(a, v, simd_kernels<val_t>::get().rdiv_s);
+}
+
+template<typename val_t>
+dmat<val_t> operator/(const typename dmat<val_t>::type& v, dmat<val_t>&& a)
+{
+	return dmat<val_t>::scalar(std::move(a), v, simd_kernels<val_t>::get().rdiv_s);
+}
+
+template<typename val_t>
+dmat<val_t> exp(const dmat<val_t>& a)
+{
+	return dmat<val_t>::unary(a, simd_kernels<val_t>::get().exp);
+}
+
+template<typename val_t>
+dmat<val_t> exp(dmat<val_t>&& a)
+{
+	return dmat<val_t>::unary(std::move(a), simd_kernels<val_t>::get().exp);
+}
+
+template<typename val_t>
+dmat<val_t> sqrtl(const dmat<val_t>& a)
+{
+	return dmat<val_t>::unary(a, simd_kernels<val_t>::get().sqrt);
+}
+
+template<typename val_t>
+dmat<val_t> sqrtl(dmat<val_t>&& a)
+{
+	return dmat<val_t>::unary(std::move(a), simd_kernels<val_t>::get().sqrt);
+}
+
+template<typename val_t>
+dmat<val_t> abs(const dmat<val_t>& a)
+{
+	return dmat<val_t>::unary(a, simd_kernels<val_t>::get().abs);
+}
+
+template<typename val_t>
+dmat<val_t> abs(dmat<val_t>&& a)
+{
+	return dmat<val_t>::unary(std::move(a), simd_kernels<val_t>::get().abs);
+}
+
+#include "ht_memory.h"
+
+/* 先写行列数，读取时按文件中的形状重新分配，拓扑改变后不需要重新编译读取代码 */
+template<typename val_t>
+void write_file(const dmat<val_t>& mt, ht_memory& mry)
+{
+	mry << mt.row_num << mt.col_num;
+	for (int r = 0; r < mt.row_num; ++r)
+	{
+		for (int c = 0; c < mt.col_num; ++c)
+		{
+			mry << mt.get(r, c);
+		}
+	}
+}
+
+template<typename val_t>
+void read_file(ht_memory& mry, dmat<val_t>& mt)
+{
+	int rows = 0, cols = 0;
+	mry >> rows >> cols;
+	mt = dmat<val_t>(rows, cols);
+	for (int r = 0; r < rows; ++r)
+	{
+		for (int c = 0; c < cols; ++c)
+		{
+			mry >> mt.get(r, c);
+		}
+	}
+}
+
+#endif
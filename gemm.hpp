@@ -0,0 +1,552 @@
+#ifndef _GEMM_HPP_
+#define _GEMM_HPP_
+#include <new>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "mat_alloc.hpp"
+
+/*
+ * mat::dot使用的矩阵乘法引擎：C(M*N) = A(M*K) * B(K*N)
+ * 矩阵以(首地址, 行步长, 列步长)描述，元素(i, k)位于p[i*rs + k*cs]，转置只是交换两个步长
+ * 操作数有两种：gemm_operand的步长在运行时给出(mat_view、dmat)；gemm_fixed_operand的转置与否是模板参数，
+ * mat与transposed_mat相乘时走gemm<a_t, b_t>，NN/NT/TN/TT在编译期确定，打包和循环顺序的选择都不再有运行时判断
+ * 三个维度都足够大时走分块打包的路径：
+ *   B按KC*NC分块，打包成NR列宽的条带；A按MC*KC分块，打包成MR行高的条带；
+ *   微内核用MR*NR个累加器计算一个C的小块，打包后的数据在内核中都是连续访问
+ * 其余情况(矩阵向量乘、外积、小矩阵)按步长挑选最内层连续的循环顺序直接计算
+ * 足够大的乘法按二维分块交给线程池并行计算(见gemm_dispatch)
+ * 每个C元素都按k从小到大依次累加，结果与逐元素do_dot完全一致
+ */
+/* MR*NR取2*4：不开-O3时编译器只把最内层的NR循环向量化，更大的小块会让累加器溢出到栈上 */
+template<typename val_t>
+struct gemm_blocking
+{
+	static constexpr int MR = 2;
+	static constexpr int NR = 4;
+	static constexpr int MC = 64;
+	static constexpr int KC = 256;
+	static constexpr int NC = 512;
+};
+
+/* float的NR取8，最内层循环仍然正好占满同样宽度的向量寄存器 */
+template<>
+struct gemm_blocking<float>
+{
+	static constexpr int MR = 2;
+	static constexpr int NR = 8;
+	static constexpr int MC = 64;
+	static constexpr int KC = 256;
+	static constexpr int NC = 512;
+};
+
+template<typename val_t>
+struct gemm_operand
+{
+	const val_t* p;
+	int rs;
+	int cs;
+
+	val_t get(const int& i, const int& j) const
+	{
+		return p[i * rs + j * cs];
+	}
+
+	/* 同一列(或同一行)的元素是否连续，以及第k列(第k行)的首地址 */
+	bool col_contiguous() const { return rs == 1; }
+	bool row_contiguous() const { return cs == 1; }
+	const val_t* col_ptr(const int& k) const { return p + k * cs; }
+	const val_t* row_ptr(const int& k) const { return p + k * rs; }
+
+	/* 以(i0, j0)为左上角的子矩阵，多线程时每个线程只看到自己的分块 */
+	gemm_operand sub(const int& i0, const int& j0) const { return { p + i0 * rs + j0 * cs, rs, cs }; }
+};
+
+/* 行主序矩阵(b_trans为false)或其转置，ld是原矩阵的列数，连续的方向在编译期已知(ld为1的向量两个方向都连续) */
+template<typename val_t, bool b_trans>
+struct gemm_fixed_operand
+{
+	const val_t* p;
+	int ld;
+
+	val_t get(const int& i, const int& j) const
+	{
+		if constexpr (b_trans)
+			return p[j * ld + i];
+		else
+			return p[i * ld + j];
+	}
+
+	bool col_contiguous() const { return b_trans || ld == 1; }
+	bool row_contiguous() const { return !b_trans || ld == 1; }
+	const val_t* col_ptr(const int& k) const { return p + k * ld; }
+	const val_t* row_ptr(const int& k) const { return p + k * ld; }
+
+	gemm_fixed_operand sub(const int& i0, const int& j0) const { return { p + (b_trans ? j0 * ld + i0 : i0 * ld + j0), ld }; }
+};
+
+/* 打包后的缓冲区按线程复用，只在第一次遇到更大的分块时分配，按64字节对齐，每个条带都从缓存行开始 */
+template<typename val_t>
+struct gemm_aligned_buffer
+{
+	val_t* p;
+	size_t siz;
+
+	gemm_aligned_buffer() :p(nullptr), siz(0) {}
+	~gemm_aligned_buffer()
+	{
+		if (p)
+			::operator delete(p, std::align_val_t(64));
+	}
+
+	val_t* reserve(const size_t& siz_need)
+	{
+		if (siz < siz_need)
+		{
+			if (p)
+				::operator delete(p, std::align_val_t(64));
+			mat_count_alloc();
+			p = static_cast<val_t*>(::operator new(siz_need * sizeof(val_t), std::align_val_t(64)));
+			siz = siz_need;
+		}
+		return p;
+	}
+};
+
+template<typename val_t>
+inline val_t* gemm_buffer(const int& i_idx, const size_t& siz)
+{
+	thread_local gemm_aligned_buffer<val_t> sz_buf[2];
+	return sz_buf[i_idx].reserve(siz);
+}
+
+/* 把A的mc*kc块打包成MR行高的条带，每个条带内按k排列，不足MR的行补0 */
+template<typename val_t, typename operand_t>
+inline void gemm_pack_a(const operand_t& a, const int& i0, const int& k0, const int& mc, const int& kc, val_t* p_buf)
+{
+	constexpr int MR = gemm_blocking<val_t>::MR;
+	for (int ir = 0; ir < mc; ir += MR)
+	{
+		const int mr = std::min(MR, mc - ir);
+		for (int k = 0; k < kc; ++k)
+		{
+			for (int i = 0; i < MR; ++i)
+			{
+				p_buf[i] = i < mr ? a.get(i0 + ir + i, k0 + k) : val_t(0);
+			}
+			p_buf += MR;
+		}
+	}
+}
+
+/* 把B的kc*nc块打包成NR列宽的条带，每个条带内按k排列，不足NR的列补0 */
+template<typename val_t, typename operand_t>
+inline void gemm_pack_b(const operand_t& b, const int& k0, const int& j0, const int& kc, const int& nc, val_t* p_buf)
+{
+	constexpr int NR = gemm_blocking<val_t>::NR;
+	for (int jr = 0; jr < nc; jr += NR)
+	{
+		const int nr = std::min(NR, nc - jr);
+		for (int k = 0; k < kc; ++k)
+		{
+			for (int j = 0; j < NR; ++j)
+			{
+				p_buf[j] = j < nr ? b.get(k0 + k, j0 + jr + j) : val_t(0);
+			}
+			p_buf += NR;
+		}
+	}
+}
+
+/* 微内核：C的mr*nr小块 (+)= 打包A条带 * 打包B条带，b_first为true时从0开始累加 */
+template<typename val_t>
+inline void gemm_micro_kernel(const int& kc, const val_t* pa, const val_t* pb, val_t* pc, const int& ldc, const int& mr, const int& nr, const bool& b_first)
+{
+	constexpr int MR = gemm_blocking<val_t>::MR;
+	constexpr int NR = gemm_blocking<val_t>::NR;
+	val_t acc[MR][NR];
+	for (int i = 0; i < MR; ++i)
+	{
+		for (int j = 0; j < NR; ++j)
+		{
+			acc[i][j] = (b_first || i >= mr || j >= nr) ? val_t(0) : pc[i * ldc + j];
+		}
+	}
+	for (int k = 0; k < kc; ++k)
+	{
+		for (int i = 0; i < MR; ++i)
+		{
+			const val_t v = pa[i];
+			for (int j = 0; j < NR; ++j)
+			{
+				acc[i][j] = acc[i][j] + v * pb[j];
+			}
+		}
+		pa += MR;
+		pb += NR;
+	}
+	for (int i = 0; i < mr; ++i)
+	{
+		for (int j = 0; j < nr; ++j)
+		{
+			pc[i * ldc + j] = acc[i][j];
+		}
+	}
+}
+
+template<typename val_t, typename operand_a_t, typename operand_b_t>
+void gemm_packed(const int& M, const int& N, const int& K, const operand_a_t& a, const operand_b_t& b, val_t* pc, const int& ldc)
+{
+	using blk = gemm_blocking<val_t>;
+	val_t* p_pack_a = gemm_buffer<val_t>(0, static_cast<size_t>(blk::MC + blk::MR) * blk::KC);
+	val_t* p_pack_b = gemm_buffer<val_t>(1, static_cast<size_t>(blk::NC + blk::NR) * blk::KC);
+	for (int jc = 0; jc < N; jc += blk::NC)
+	{
+		const int nc = std::min(blk::NC, N - jc);
+		for (int kc0 = 0; kc0 < K; kc0 += blk::KC)
+		{
+			const int kc = std::min(blk::KC, K - kc0);
+			gemm_pack_b<val_t>(b, kc0, jc, kc, nc, p_pack_b);
+			for (int ic = 0; ic < M; ic += blk::MC)
+			{
+				const int mc = std::min(blk::MC, M - ic);
+				gemm_pack_a<val_t>(a, ic, kc0, mc, kc, p_pack_a);
+				for (int jr = 0; jr < nc; jr += blk::NR)
+				{
+					for (int ir = 0; ir < mc; ir += blk::MR)
+					{
+						gemm_micro_kernel(kc, p_pack_a + ir * kc, p_pack_b + jr * kc, pc + (ic + ir) * ldc + jc + jr, ldc
+							, std::min(blk::MR, mc - ir), std::min(blk::NR, nc - jr), kc0 == 0);
+					}
+				}
+			}
+		}
+	}
+}
+
+/* 不打包的直接计算，按步长让最内层循环尽量连续，k == 0时直接写入(0 + a*b，与do_dot的累加顺序相同) */
+template<typename val_t, typename operand_a_t, typename operand_b_t>
+void gemm_direct(const int& M, const int& N, const int& K, const operand_a_t& a, const operand_b_t& b, val_t* pc, const int& ldc)
+{
+	if (a.col_contiguous() && N < 8)
+	{
+		/* A按列连续(例如W.t())：C的一列 += A的第k列 * B(k,j) */
+		for (int j = 0; j < N; ++j)
+		{
+			for (int k = 0; k < K; ++k)
+			{
+				const val_t v = b.get(k, j);
+				const val_t* pa = a.col_ptr(k);
+				val_t* p_col = pc + j;
+				if (k == 0)
+				{
+					for (int i = 0; i < M; ++i)
+						p_col[i * ldc] = val_t(0) + pa[i] * v;
+					continue;
+				}
+				for (int i = 0; i < M; ++i)
+				{
+					p_col[i * ldc] = p_col[i * ldc] + pa[i] * v;
+				}
+			}
+		}
+		return;
+	}
+	if (b.row_contiguous() && N >= 8)
+	{
+		/* B按行连续：C的一行 += A(i,k) * B的第k行 */
+		for (int i = 0; i < M; ++i)
+		{
+			val_t* p_row = pc + i * ldc;
+			for (int k = 0; k < K; ++k)
+			{
+				const val_t v = a.get(i, k);
+				const val_t* pb = b.row_ptr(k);
+				if (k == 0)
+				{
+					for (int j = 0; j < N; ++j)
+						p_row[j] = val_t(0) + v * pb[j];
+					continue;
+				}
+				for (int j = 0; j < N; ++j)
+				{
+					p_row[j] = p_row[j] + v * pb[j];
+				}
+			}
+		}
+		return;
+	}
+	/* 其余情况(例如W.dot(h))逐元素做内积，累加值留在寄存器里 */
+	for (int i = 0; i < M; ++i)
+	{
+		for (int j = 0; j < N; ++j)
+		{
+			val_t ret = 0;
+			for (int k = 0; k < K; ++k)
+			{
+				ret = ret + a.get(i, k) * b.get(k, j);
+			}
+			pc[i * ldc + j] = ret;
+		}
+	}
+}
+
+template<typename val_t, typename operand_a_t, typename operand_b_t>
+void gemm_single(const int& M, const int& N, const int& K, const operand_a_t& a, const operand_b_t& b, val_t* pc, const int& ldc)
+{
+	if (M >= 16 && N >= 16 && K >= 16)
+		gemm_packed(M, N, K, a, b, pc, ldc);
+	else
+		gemm_direct(M, N, K, a, b, pc, ldc);
+}
+
+/*
+ * 乘加次数M*N*K达到MAT_GEMM_PARALLEL_MIN的乘法把C按二维分块交给常驻的线程池，每个线程独立打包、计算自己的分块
+ * 每个C元素仍由一个线程按k从小到大累加，结果与单线程完全一致
+ * MAT_GEMM_THREADS为0时线程数取硬件线程数，运行时可以用gemm_thread_pool::get().set_thread_num修改
+ */
+#ifndef MAT_GEMM_THREADS
+#define MAT_GEMM_THREADS 0
+#endif
+
+#ifndef MAT_GEMM_PARALLEL_MIN
+#define MAT_GEMM_PARALLEL_MIN (1 << 18)
+#endif
+
+class gemm_thread_pool
+{
+public:
+	static gemm_thread_pool& get()
+	{
+		static gemm_thread_pool pool;
+		return pool;
+	}
+
+	/* 没有加锁，可能与set_thread_num同时调用；需要用同一个线程数分配和分段时只读一次 */
+	int thread_num() const { return i_thread_num.load(); }
+
+	/* 修改线程数(包括调用线程在内)，小于1时取硬件线程数 */
+	void set_thread_num(int i_num)
+	{
+		std::lock_guard<std::mutex> lk_run(mtx_run);
+		stop_workers();
+		if (i_num < 1)
+			i_num = static_cast<int>(std::thread::hardware_concurrency());
+		i_num = i_num < 1 ? 1 : i_num;
+		i_thread_num = i_num;
+		b_stop = false;
+		for (int i = 1; i < i_num; ++i)
+		{
+			vec_workers.emplace_back([this]() { worker_loop(); });
+		}
+	}
+
+	/*
+	 * 把i_task_num个任务分给工作线程和调用线程，全部完成后返回
+	 * 线程池正被其它线程使用，或者在工作线程里再次调用时，直接在当前线程依次执行
+	 */
+	template<typename func_t>
+	void run(const int& i_task_num, func_t&& f)
+	{
+		std::unique_lock<std::mutex> lk_run(mtx_run, std::try_to_lock);
+		if (!lk_run.owns_lock() || b_in_worker() || vec_workers.empty())
+		{
+			for (int i = 0; i < i_task_num; ++i)
+				f(i);
+			return;
+		}
+		std::function<void(int)> fn_task(std::forward<func_t>(f));
+		unsigned long long ull_cur = 0;
+		{
+			std::lock_guard<std::mutex> lk(mtx);
+			p_task = &fn_task;
+			i_total = i_task_num;
+			i_next = 0;
+			i_done = 0;
+			ull_cur = ++ull_generation;
+		}
+		cv_task.notify_all();
+		work_on_tasks(ull_cur);
+		std::unique_lock<std::mutex> lk(mtx);
+		cv_done.wait(lk, [this]() { return i_done == i_total; });
+		p_task = nullptr;
+	}
+
+	~gemm_thread_pool()
+	{
+		stop_workers();
+	}
+
+private:
+	std::vector<std::thread>		vec_workers;
+	std::mutex						mtx_run;			// 同一时刻只有一个乘法使用线程池
+	std::mutex						mtx;
+	std::condition_variable			cv_task;
+	std::condition_variable			cv_done;
+	const std::function<void(int)>*	p_task = nullptr;
+	int								i_total = 0;
+	int								i_next = 0;
+	int								i_done = 0;
+	unsigned long long				ull_generation = 0;
+	bool							b_stop = false;
+	std::atomic<int>				i_thread_num{ 1 };
+
+	gemm_thread_pool()
+	{
+		set_thread_num(MAT_GEMM_THREADS);
+	}
+
+	static bool& b_in_worker()
+	{
+		thread_local bool b = false;
+		return b;
+	}
+
+	/* 任务数不超过线程数，领取任务时加锁即可；只领取ull_gen这一轮的任务，醒得晚的线程不会碰到下一轮 */
+	void work_on_tasks(const unsigned long long& ull_gen)
+	{
+		std::unique_lock<std::mutex> lk(mtx);
+		while (ull_generation == ull_gen && i_next < i_total)
+		{
+			const int i_task = i_next++;
+			const std::function<void(int)>* p_cur = p_task;
+			lk.unlock();
+			(*p_cur)(i_task);
+			lk.lock();
+			if (++i_done == i_total)
+				cv_done.notify_one();
+		}
+	}
+
+	void worker_loop()
+	{
+		b_in_worker() = true;
+		unsigned long long ull_seen = 0;
+		while (true)
+		{
+			{
+				std::unique_lock<std::mutex> lk(mtx);
+				cv_task.wait(lk, [&]() { return b_stop || ull_generation != ull_seen; });
+				if (b_stop)
+					return;
+				ull_seen = ull_generation;
+			}
+			work_on_tasks(ull_seen);
+		}
+	}
+
+	void stop_workers()
+	{
+		{
+			std::lock_guard<std::mutex> lk(mtx);
+			b_stop = true;
+		}
+		cv_task.notify_all();
+		for (auto& th : vec_workers)
+			th.join();
+		vec_workers.clear();
+	}
+};
+
+/* 把C分成i_row_part*i_col_part块，块数等于线程数，按块的形状尽量接近正方形挑选行列的分法；N太小时只按行分 */
+inline void gemm_partition(const int& M, const int& N, const int& i_thread_num, int& i_row_part, int& i_col_part)
+{
+	i_row_part = i_thread_num;
+	i_col_part = 1;
+	if (N < 32)
+		return;
+	double d_best = -1.;
+	for (int i_col = 1; i_col <= i_thread_num; ++i_col)
+	{
+		if (i_thread_num % i_col != 0)
+			continue;
+		const int i_row = i_thread_num / i_col;
+		const double d_h = static_cast<double>(M) / i_row, d_w = static_cast<double>(N) / i_col;
+		const double d_score = d_h < d_w ? d_h / d_w : d_w / d_h;
+		if (d_score > d_best)
+		{
+			d_best = d_score;
+			i_row_part = i_row;
+			i_col_part = i_col;
+		}
+	}
+}
+
+template<typename val_t, typename operand_a_t, typename operand_b_t>
+void gemm_dispatch(const int& M, const int& N, const int& K, const operand_a_t& a, const operand_b_t& b, val_t* pc)
+{
+	gemm_thread_pool& pool = gemm_thread_pool::get();
+	const int i_thread_num = pool.thread_num();
+	if (i_thread_num <= 1 || static_cast<double>(M) * N * K < MAT_GEMM_PARALLEL_MIN)
+	{
+		gemm_single(M, N, K, a, b, pc, N);
+		return;
+	}
+	int i_row_part = 1, i_col_part = 1;
+	gemm_partition(M, N, i_thread_num, i_row_part, i_col_part);
+	/* 分块的边界按微内核的MR、NR对齐，只有最后一块可能不满 */
+	constexpr int MR = gemm_blocking<val_t>::MR;
+	constexpr int NR = gemm_blocking<val_t>::NR;
+	const int i_tile_m = ((M + i_row_part - 1) / i_row_part + MR - 1) / MR * MR;
+	const int i_tile_n = i_col_part == 1 ? N : ((N + i_col_part - 1) / i_col_part + NR - 1) / NR * NR;
+	pool.run(i_row_part * i_col_part, [&](const int& i_task) {
+		const int i0 = (i_task / i_col_part) * i_tile_m;
+		const int j0 = (i_task % i_col_part) * i_tile_n;
+		if (i0 >= M || j0 >= N)
+			return;
+		gemm_single(std::min(i_tile_m, M - i0), std::min(i_tile_n, N - j0), K, a.sub(i0, 0), b.sub(0, j0), pc + i0 * N + j0, N);
+	});
+}
+
+/* 步长在运行时给出 */
+template<typename val_t>
+void gemm(const int& M, const int& N, const int& K, const gemm_operand<val_t>& a, const gemm_operand<val_t>& b, val_t* pc)
+{
+	gemm_dispatch(M, N, K, a, b, pc);
+}
+
+/* A、B都是行主序的连续内存，a_t/b_t表示取其转置，pa指向的原矩阵是M*K(a_t时为K*M)，pb同理 */
+template<bool a_t, bool b_t, typename val_t>
+void gemm(const int& M, const int& N, const int& K, const val_t* pa, const val_t* pb, val_t* pc)
+{
+	gemm_dispatch(M, N, K, gemm_fixed_operand<val_t, a_t>{ pa, a_t ? M : K }, gemm_fixed_operand<val_t, b_t>{ pb, b_t ? K : N }, pc);
+}
+
+/*
+ * 元素本身是矩阵的乘法：C(i,j) = sum_k A(i,k) (*) B(k,j)，(*)为逐元素乘，每个元素有P个数
+ * 元素内的每个位置各是一次M*N*K的乘法，P次乘法共用一套下标，即一次batched GEMM
+ * elem_a(i, k)、elem_b(k, j)、elem_c(i, j)给出元素数据的首地址，最内层沿元素内的P个数连续计算
+ * k == 0时直接写入(0 + a*b)，累加顺序与逐元素的do_dot相同
+ */
+template<typename val_t, typename elem_a_t, typename elem_b_t, typename elem_c_t>
+void gemm_batched_hadamard(const int& M, const int& N, const int& K, const int& P, const elem_a_t& elem_a, const elem_b_t& elem_b, const elem_c_t& elem_c)
+{
+	for (int i = 0; i < M; ++i)
+	{
+		for (int j = 0; j < N; ++j)
+		{
+			val_t* pc = elem_c(i, j);
+			for (int k = 0; k < K; ++k)
+			{
+				const val_t* pa = elem_a(i, k);
+				const val_t* pb = elem_b(k, j);
+				if (k == 0)
+				{
+					for (int x = 0; x < P; ++x)
+						pc[x] = val_t(0) + pa[x] * pb[x];
+				}
+				else
+				{
+					for (int x = 0; x < P; ++x)
+						pc[x] = pc[x] + pa[x] * pb[x];
+				}
+			}
+		}
+	}
+}
+
+#endif
@@ -24,10 +24,11 @@
 template<int dim_size>
 double poss(const mat<dim_size, 1, double>& x, const mat<dim_size, 1, double>& u, const mat<dim_size, dim_size, double>& sigma)
 {
-	mat<dim_size, dim_size, double> E_1 = inverse(sigma);
+	// sigma只分解一次，行列式和sigma^-1(x-u)都从同一个LU得到，不再显式求逆
+	lu_t<dim_size, double> lu_sigma(sigma);
 	mat<dim_size, 1, double> x_u = x - u;
-	double _E_1_2 = (sqrt(det(sigma))*pow(2.*3.1415926535897932384626, dim_size / 2.));
-	return exp(x_u.t().dot(E_1.dot(x_u))*-0.5)[0] / _E_1_2;
+	double _E_1_2 = (sqrt(lu_sigma.det())*pow(2.*3.1415926535897932384626, dim_size / 2.));
+	return exp(x_u.t().dot(lu_sigma.solve(x_u))*-0.5)[0] / _E_1_2;
 }
 
 template<int dim_size>
@@ -0,0 +1,82 @@
+#pragma once
+#include <memory>
+#include "ht_memory.h"
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+ * 把模型文件映射为只读的ht_memory(buf_stable，不能写入)，打开文件的耗时与文件大小无关
+ * 映射是MAP_PRIVATE的：没有修改过的页与其它进程共享page cache，修改矩阵时只复制被写的页，不会写回文件
+ * 写入时设置了tensor_align的文件，read_file(mry, mat)让堆上的算术类型矩阵直接指向映射中的数据，
+ * 矩阵持有映射的引用，本对象析构后矩阵仍然有效
+ * 不支持mmap的平台上退化为把整个文件读进一块对齐的内存
+ */
+class ht_mapped_memory : public ht_memory
+{
+	std::shared_ptr<void> m_sp_map;
+public:
+	explicit ht_mapped_memory(const endian& e_endian) :ht_memory(e_endian)
+	{
+	}
+	ht_mapped_memory(const ht_mapped_memory&) = delete;
+	ht_mapped_memory& operator=(const ht_mapped_memory&) = delete;
+
+	int map_file(const char* cstr_file_path)
+	{
+#if defined(_WIN32) || defined(_WIN64)
+		std::ifstream ifs(cstr_file_path, std::ifstream::binary);
+		if (!ifs.is_open())
+		{
+			return -1;
+		}
+		ifs.seekg(0, ifs.end);
+		size_t u_len = static_cast<size_t>(ifs.tellg());
+		ifs.seekg(0, ifs.beg);
+		if (u_len == 0)
+		{
+			return -1;
+		}
+		void* p = _aligned_malloc(u_len, 4096);
+		if (!p)
+		{
+			return -1;
+		}
+		ifs.read(static_cast<char*>(p), u_len);
+		m_sp_map = std::shared_ptr<void>(p, [](void* p_del) { _aligned_free(p_del); });
+#else
+		int fd = open(cstr_file_path, O_RDONLY);
+		if (fd < 0)
+		{
+			return -1;
+		}
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size == 0)
+		{
+			close(fd);
+			return -1;
+		}
+		size_t u_len = static_cast<size_t>(st.st_size);
+		void* p = mmap(nullptr, u_len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (p == MAP_FAILED)
+		{
+			return -1;
+		}
+		m_sp_map = std::shared_ptr<void>(p, [u_len](void* p_del) { munmap(p_del, u_len); });
+#endif
+		load(p, u_len, buf_stable);
+		return 0;
+	}
+
+	std::shared_ptr<void> buf_owner() const override
+	{
+		return m_sp_map;
+	}
+};
@@ -3,6 +3,7 @@
 #include <string>
 #include <fstream>
 #include "ht_memory.h"
+#include "simd_kernel.hpp"
 
 #define nullptr 0
 
@@ -14,9 +15,10 @@ union endian_check
 
 union endian_check const g_ec = {0x0001};
 
-inline unsigned int get_trimmed_size(const unsigned int& u_expect_size, const unsigned int& u_trim_size) 
+/* u_expect_sizeȡu_trim_sizeı */
+inline size_t get_trimmed_size(const size_t& u_expect_size, const size_t& u_trim_size) 
 {
-	return (u_expect_size / u_trim_size + u_expect_size % u_trim_size == 0 ? 0 : 1)*u_trim_size;
+	return (u_expect_size / u_trim_size + (u_expect_size % u_trim_size == 0 ? 0 : 1))*u_trim_size;
 }
 
 ht_memory::endian system_endian() 
@@ -24,7 +26,7 @@ ht_memory::endian system_endian()
 	return g_ec.sz[0] == 0x01 ? ht_memory::little_endian : ht_memory::big_endian;
 }
 
-ht_memory::ht_memory(const endian& e_endian, const unsigned int& u_expand_size)
+ht_memory::ht_memory(const endian& e_endian, const size_t& u_expand_size)
 	:m_sz_buf(nullptr)
 	, m_u_buf_len(0u)
 	, m_u_read_idx(0u)
@@ -32,6 +34,8 @@ ht_memory::ht_memory(const endian& e_endian, const unsigned int& u_expand_size)
 	, m_e_endian(e_endian)
 	, m_e_strategy(buf_flexable)
 	, m_u_expand_size((u_expand_size==0||u_expand_size>1024*1024*128)?512:u_expand_size)
+	, m_u_tensor_align(0u)
+	, m_b_read_fail(false)
 {
 }
 
@@ -43,6 +47,8 @@ ht_memory::ht_memory(const ht_memory & other)
 	, m_e_endian(other.m_e_endian)
 	, m_e_strategy(other.m_e_strategy)
 	, m_u_expand_size(other.m_u_expand_size)
+	, m_u_tensor_align(other.m_u_tensor_align)
+	, m_b_read_fail(other.m_b_read_fail)
 {
 	/* ǹ̶ڴԵֵָ뼴ɣǿչ洢ƴ洢 */
 	if (other.m_e_strategy == buf_stable) 
@@ -71,6 +77,8 @@ ht_memory & ht_memory::operator=(const ht_memory & other)
 	m_e_endian = other.m_e_endian;
 	m_e_strategy = other.m_e_strategy;
 	m_u_expand_size = other.m_u_expand_size;
+	m_u_tensor_align = other.m_u_tensor_align;
+	m_b_read_fail = other.m_b_read_fail;
 	if (other.m_e_strategy == buf_stable)
 	{
 		m_sz_buf = other.m_sz_buf;
@@ -98,6 +106,8 @@ void ht_memory::clone(const ht_memory & other)
 	m_e_endian = other.m_e_endian;
 	//m_e_strategy = other.m_e_strategy;
 	m_u_expand_size = other.m_u_expand_size;
+	m_u_tensor_align = other.m_u_tensor_align;
+	m_b_read_fail = other.m_b_read_fail;
 }
 
 void ht_memory::get_buf_from(ht_memory & other)
@@ -105,6 +115,7 @@ void ht_memory::get_buf_from(ht_memory & other)
 	ht_free(m_sz_buf);
 	m_u_buf_len = m_u_read_idx = m_u_write_idx = 0u;
 	m_u_buf_len = other.m_u_buf_len;
+	m_b_read_fail = false;
 	m_e_endian = other.m_e_endian;
 	m_e_strategy = other.m_e_strategy;
 	m_u_expand_size = other.m_u_expand_size;
@@ -119,7 +130,7 @@ ht_memory::~ht_memory()
 	}
 }
 
-void * ht_memory::ht_realloc(void* p, const unsigned int& u_expected_size)
+void * ht_memory::ht_realloc(void* p, const size_t& u_expected_size)
 {
 	if (m_e_strategy == buf_flexable)
 	{
@@ -135,26 +146,63 @@ void ht_memory::ht_free(void * p)
 		free(p);
 }
 
-unsigned char & ht_memory::operator[](const unsigned int & idx) const
+/* m_u_expand_sizeȡΪԭ2дʱreallocƵճȳ */
+bool ht_memory::grow(const size_t & u_expected_size)
+{
+	if (u_expected_size <= m_u_buf_len)
+	{
+		return true;
+	}
+	if (m_e_strategy != buf_flexable)
+	{
+		return false;
+	}
+	size_t u_len = get_trimmed_size(u_expected_size, m_u_expand_size);
+	if (u_len < m_u_buf_len * 2)
+	{
+		u_len = m_u_buf_len * 2;
+	}
+	unsigned char* p = reinterpret_cast<unsigned char*>(ht_realloc(m_sz_buf, u_len));
+	if (!p)
+	{
+		/* ڴʧܣԭռȻЧڴѾ */
+		return false;
+	}
+	m_sz_buf = p;
+	m_u_buf_len = u_len;
+	return true;
+}
+
+unsigned char & ht_memory::operator[](const size_t & idx) const
 {
 	if (idx >= m_u_buf_len) 
 	{
-		throw std::runtime_error(std::string("ht_memory::operator[](const unsigned int&) constԽ"));
+		throw std::runtime_error(std::string("ht_memory::operator[](const size_t&) constԽ"));
 	}
 	return m_sz_buf[idx];
 }
 
-unsigned int ht_memory::read_size() const
+size_t ht_memory::read_size() const
 {
 	return m_u_read_idx;
 }
 
-unsigned int ht_memory::write_size() const
+size_t ht_memory::write_size() const
 {
 	return m_u_write_idx;
 }
 
-unsigned int ht_memory::size() const
+ht_memory::endian ht_memory::get_endian() const
+{
+	return m_e_endian;
+}
+
+std::shared_ptr<void> ht_memory::buf_owner() const
+{
+	return std::shared_ptr<void>();
+}
+
+size_t ht_memory::size() const
 {
 	if (m_u_read_idx > m_u_write_idx) 
 	{
@@ -163,11 +211,12 @@ unsigned int ht_memory::size() const
 	return m_u_write_idx - m_u_read_idx;
 }
 
-void ht_memory::load(void * p, const unsigned int & u_len, const strategy& e_strategy)
+void ht_memory::load(void * p, const size_t & u_len, const strategy& e_strategy)
 {
 	m_e_strategy = e_strategy;
 	m_u_write_idx = u_len;
 	m_u_read_idx = 0;
+	m_b_read_fail = false;
 	if (e_strategy == buf_flexable)
 	{
 		/* жϳǷ񳬱 */
@@ -200,11 +249,12 @@ void ht_memory::load(void * p, const unsigned int & u_len, const strategy& e_str
 	}
 }
 
-void ht_memory::cload(const void * p, const unsigned int & u_len)
+void ht_memory::cload(const void * p, const size_t & u_len)
 {
 	m_e_strategy = buf_flexable;
 	m_u_write_idx = u_len;
 	m_u_read_idx = 0;
+	m_b_read_fail = false;
 	/* жϳǷ񳬱 */
 	if (u_len > m_u_buf_len)
 	{
@@ -228,7 +278,56 @@ void ht_memory::cload(const void * p, const unsigned int & u_len)
 	m_u_write_idx = u_len;
 }
 
-void ht_memory::skip(const unsigned int & u_len) const
+void ht_memory::set_tensor_align(const size_t & u_align)
+{
+	m_u_tensor_align = u_align;
+}
+
+size_t ht_memory::tensor_align() const
+{
+	return m_u_tensor_align;
+}
+
+void ht_memory::align_write(const size_t & u_align)
+{
+	static const char sz_zero[64] = { 0 };
+	size_t u_pad = u_align == 0 ? 0 : (u_align - m_u_write_idx % u_align) % u_align;
+	while (u_pad > 0)
+	{
+		size_t u_len = u_pad < sizeof(sz_zero) ? u_pad : sizeof(sz_zero);
+		write(sz_zero, u_len);
+		u_pad -= u_len;
+	}
+}
+
+void ht_memory::align_read(const size_t & u_align) const
+{
+	if (u_align != 0)
+		skip((u_align - m_u_read_idx % u_align) % u_align);
+}
+
+bool ht_memory::need_swap() const
+{
+	return m_e_endian != system_endian();
+}
+
+void ht_memory::swap_elements(void * p, const size_t & u_num, const int & i_width)
+{
+	simd_bswap(p, u_num, i_width);
+}
+
+void ht_memory::set_read_fail() const
+{
+	m_b_read_fail = true;
+	m_u_read_idx = m_u_write_idx;
+}
+
+bool ht_memory::read_fail() const
+{
+	return m_b_read_fail;
+}
+
+void ht_memory::skip(const size_t & u_len) const
 {
 	if (m_u_write_idx < m_u_read_idx + u_len)
 	{
@@ -238,7 +337,7 @@ void ht_memory::skip(const unsigned int & u_len) const
 	m_u_read_idx += u_len;
 }
 
-void ht_memory::operator+=(const unsigned int & u_len) const
+void ht_memory::operator+=(const size_t & u_len) const
 {
 	skip(u_len);
 }
@@ -252,6 +351,12 @@ ht_memory & ht_memory::operator++()
 void ht_memory::reset_read()
 {
 	m_u_read_idx = 0u;
+	m_b_read_fail = false;
+}
+
+unsigned char * ht_memory::origin_buf() const
+{
+	return m_sz_buf;
 }
 
 unsigned char * ht_memory::buf() const
@@ -259,49 +364,27 @@ unsigned char * ht_memory::buf() const
 	return m_sz_buf + m_u_read_idx;
 }
 
-unsigned int ht_memory::read(char * sz_buf, const unsigned int & u_len) const
+size_t ht_memory::read(char * sz_buf, const size_t & u_len) const
 {
-	unsigned int u_left = m_u_write_idx - m_u_read_idx;
-	unsigned int u_read_len = u_left < u_len ? u_left : u_len;
+	size_t u_left = m_u_write_idx - m_u_read_idx;
+	size_t u_read_len = u_left < u_len ? u_left : u_len;
 	memcpy(sz_buf, m_sz_buf + m_u_read_idx, u_read_len);
 	m_u_read_idx += u_read_len;
 	return u_read_len;
 }
 
-unsigned int ht_memory::write(const char * sz_buf, const unsigned int & u_len)
+size_t ht_memory::write(const char * sz_buf, const size_t & u_len)
 {
 	/* жϳǷ񳬱 */
-	unsigned int u_expected_size = m_u_write_idx + u_len;
-	u_expected_size = (u_expected_size / m_u_expand_size + ((u_expected_size%m_u_expand_size != 0) ? 1 : 0))*m_u_expand_size;
-	if (u_expected_size > m_u_buf_len)
+	if (u_len == 0 || !grow(m_u_write_idx + u_len))
 	{
-		if (m_e_strategy == buf_stable)
-		{
-			return 0;
-		}
-		else if (m_e_strategy == buf_flexable)
-		{
-			unsigned char* p = reinterpret_cast<unsigned char*>(ht_realloc(m_sz_buf, u_expected_size));
-			if (u_expected_size == 0)
-			{
-				/* ԭָʧЧδΪǳ */
-				return 0;
-			}
-			if (!p)
-			{
-				/* ڴʧܣԭռȻЧڴѾ */
-				return 0;
-			}
-			m_sz_buf = p;
-			m_u_buf_len = u_expected_size;
-		}
-		else {}
+		return 0;
 	}
 	/* writeλд */
 	unsigned char* p_w = m_sz_buf + m_u_write_idx;
 	memcpy(p_w, sz_buf, u_len);
 	m_u_write_idx += u_len;
-	return 0;
+	return u_len;
 }
 
 void ht_memory::reset()
@@ -310,6 +393,7 @@ void ht_memory::reset()
 		memset(m_sz_buf, 0, m_u_buf_len);
 	m_u_read_idx = 0;
 	m_u_write_idx = 0;
+	m_b_read_fail = false;
 }
 
 void ht_memory::trim_read()
@@ -318,7 +402,7 @@ void ht_memory::trim_read()
 	m_u_write_idx -= m_u_read_idx;
 	m_u_read_idx = 0u;
 	memset(m_sz_buf+m_u_write_idx, 0, m_u_buf_len - m_u_write_idx);
-	unsigned int u_free_len = m_u_buf_len - m_u_write_idx;
+	size_t u_free_len = m_u_buf_len - m_u_write_idx;
 	if (u_free_len > m_u_expand_size && m_e_strategy == buf_flexable) 
 	{
 		m_u_buf_len = get_trimmed_size(m_u_write_idx, m_u_expand_size);
@@ -326,7 +410,17 @@ void ht_memory::trim_read()
 	}
 }
 
-void * ht_memory::abort_memory(unsigned int & u_read_idx, unsigned int & u_write_idx)
+void ht_memory::rewind_write(const size_t & u_write_idx)
+{
+	if (u_write_idx < m_u_read_idx || u_write_idx >= m_u_write_idx)
+	{
+		return;
+	}
+	memset(m_sz_buf + u_write_idx, 0, m_u_write_idx - u_write_idx);
+	m_u_write_idx = u_write_idx;
+}
+
+void * ht_memory::abort_memory(size_t & u_read_idx, size_t & u_write_idx)
 {
 	trim_read();
 	void* p_ret = m_sz_buf;
@@ -336,18 +430,28 @@ void * ht_memory::abort_memory(unsigned int & u_read_idx, unsigned int & u_write
 	return p_ret;
 }
 
-void ht_memory::set_capacity(const unsigned int & u_buf_len)
+void ht_memory::set_capacity(const size_t & u_buf_len)
 {
-	unsigned int u_expect_len = m_u_read_idx + u_buf_len;
-	if (m_u_buf_len > u_expect_len || m_e_strategy == buf_stable) 
+	size_t u_expect_len = m_u_read_idx + u_buf_len;
+	if (m_u_buf_len >= u_expect_len || m_e_strategy == buf_stable) 
 	{
 		return;
 	}
-	unsigned int u_len = get_trimmed_size(u_expect_len, m_u_expand_size);
-	m_sz_buf = reinterpret_cast<unsigned char*>(ht_realloc(m_sz_buf, u_len));
+	size_t u_len = get_trimmed_size(u_expect_len, m_u_expand_size);
+	unsigned char* p = reinterpret_cast<unsigned char*>(ht_realloc(m_sz_buf, u_len));
+	if (!p)
+	{
+		return;
+	}
+	m_sz_buf = p;
 	m_u_buf_len = u_len;
 }
 
+void ht_memory::reserve(const size_t & u_len)
+{
+	set_capacity(m_u_write_idx - m_u_read_idx + u_len);
+}
+
 int ht_memory::read_file(const char* cstr_file_path)
 {
 	std::ifstream ifs(cstr_file_path, std::ifstream::binary);
@@ -358,13 +462,14 @@ int ht_memory::read_file(const char* cstr_file_path)
 	ifs.seekg(0, ifs.end);
 	auto length = ifs.tellg();
 	ifs.seekg(0, ifs.beg);
-	unsigned int u_expected_size = length;
+	size_t u_expected_size = static_cast<size_t>(length);
 	u_expected_size = (u_expected_size / m_u_expand_size + ((u_expected_size%m_u_expand_size != 0) ? 1 : 0))*m_u_expand_size;
 	m_sz_buf = (unsigned char*)ht_realloc(m_sz_buf, u_expected_size);
 	m_u_buf_len = u_expected_size;
 	memset(m_sz_buf, 0, m_u_buf_len);
 	m_u_read_idx = 0;
 	m_u_write_idx = length;
+	m_b_read_fail = false;
 	ifs.read((char*)m_sz_buf, length);
 	ifs.close();
 	return 0;
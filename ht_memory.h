@@ -1,6 +1,8 @@
 #pragma once
 #include <memory.h>
 #include <stdlib.h>
+#include <memory>
+#include <type_traits>
 
 class ht_memory 
 {
@@ -17,19 +19,22 @@ public:
 	};
 protected:
 	unsigned char*			m_sz_buf;				// 指向的内存区
-	unsigned int				m_u_buf_len;				// 内存区长度
-	mutable unsigned int		m_u_read_idx;				// 下一个将读到的位置
-	unsigned int				m_u_write_idx;			// 下次将写到的位置
+	size_t					m_u_buf_len;				// 内存区长度
+	mutable size_t			m_u_read_idx;				// 下一个将读到的位置
+	size_t					m_u_write_idx;			// 下次将写到的位置
 	
 	endian					m_e_endian;				// m_sz_buf内存端序
 	strategy					m_e_strategy;				// 内存管理策略
 
-	unsigned int				m_u_expand_size;			// 单次的扩充长度
+	size_t					m_u_expand_size;			// 扩充长度的粒度，每次扩充至少为原长度的2倍
+	size_t					m_u_tensor_align;			// 大矩阵的数据按此对齐(相对内存区起点)，0表示紧密排列
+	mutable bool				m_b_read_fail;			// 读到的数据与期望的格式不符
 protected:
-	virtual void* ht_realloc(void* p, const unsigned int& u_expected_size);
+	virtual void* ht_realloc(void* p, const size_t& u_expected_size);
 	virtual void ht_free(void* p);
+	bool grow(const size_t& u_expected_size);			// 保证内存区不小于u_expected_size，不能扩充时返回false
 public:
-	ht_memory(const endian& e_endian, const unsigned int& u_expand_size = 512);
+	ht_memory(const endian& e_endian, const size_t& u_expand_size = 512);
 	virtual ~ht_memory();
 
 	/* 复制操作 */
@@ -39,40 +44,83 @@ public:
 	void get_buf_from(ht_memory& other);			// 获取other的内存，并使other失去其对内存的控制
 
 	/* 读移动操作 */
-	void skip(const unsigned int& u_len) const;
-	void operator+=(const unsigned int& u_len) const;
+	void skip(const size_t& u_len) const;
+	void operator+=(const size_t& u_len) const;
 	ht_memory& operator++();
 	void reset_read();
 
 	/* 查询操作 */
 	unsigned char* origin_buf() const;
 	unsigned char* buf() const;
-	unsigned int size() const;
-	unsigned char& operator[](const unsigned int& idx) const;
-	unsigned int read_size() const;
-	unsigned int write_size() const;
+	size_t size() const;
+	unsigned char& operator[](const size_t& idx) const;
+	size_t read_size() const;
+	size_t write_size() const;
+	endian get_endian() const;
+	/* 内存区的所有者，矩阵可以直接引用内存区中的数据时非空(见ht_mapped_memory) */
+	virtual std::shared_ptr<void> buf_owner() const;
 
 	/* 读写操作 */
-	unsigned int read(char* sz_buf, const unsigned int& u_len) const;
-	unsigned int write(const char* sz_buf, const unsigned int& u_len);
+	size_t read(char* sz_buf, const size_t& u_len) const;
+	size_t write(const char* sz_buf, const size_t& u_len);
 	void reset();
-	void load(void* p, const unsigned int& u_len, const strategy& e_strategy);
-	void cload(const void* p, const unsigned int& u_len);
+	void load(void* p, const size_t& u_len, const strategy& e_strategy);
+	void cload(const void* p, const size_t& u_len);
+
+	/* 张量对齐：写入时补0、读取时跳过，使写/读位置是u_align的倍数 */
+	void set_tensor_align(const size_t& u_align);
+	size_t tensor_align() const;
+	void align_write(const size_t& u_align);
+	void align_read(const size_t& u_align) const;
+	bool need_swap() const;							// 内存区端序与本机不同
+	static void swap_elements(void* p, const size_t& u_num, const int& i_width);	// u_num个i_width字节的元素原地翻转字节序
+
+	/* 读取失败：read_file等发现数据不完整或格式不符时标记，同时把读位置移到末尾，之后的读取都得不到数据 */
+	void set_read_fail() const;
+	bool read_fail() const;
+
+	/* 整块读写算术类型的数组：一次扩充、memcpy，端序不同时整块翻转字节序，结果与逐个operator<< / >>相同 */
+	template<typename T>
+	size_t write_array(const T* p, const size_t& u_num)
+	{
+		static_assert(std::is_arithmetic<T>::value, "write_array: T must be arithmetic");
+		size_t u_begin = m_u_write_idx;
+		write(reinterpret_cast<const char*>(p), u_num * sizeof(T));
+		if (m_u_write_idx == u_begin)
+			return 0;
+		if (sizeof(T) > 1 && need_swap())
+			swap_elements(m_sz_buf + u_begin, u_num, sizeof(T));
+		return u_num;
+	}
+	template<typename T>
+	size_t read_array(T* p, const size_t& u_num) const
+	{
+		static_assert(std::is_arithmetic<T>::value, "read_array: T must be arithmetic");
+		size_t u_left = (m_u_write_idx - m_u_read_idx) / sizeof(T);
+		size_t u_read_num = u_left < u_num ? u_left : u_num;
+		memcpy(p, m_sz_buf + m_u_read_idx, u_read_num * sizeof(T));
+		if (sizeof(T) > 1 && need_swap())
+			swap_elements(p, u_read_num, sizeof(T));
+		m_u_read_idx += u_read_num * sizeof(T);
+		return u_read_num;
+	}
 
 	/* 修改对象 */
 	void trim_read();
-	void* abort_memory(unsigned int& u_read_idx, unsigned int& u_write_idx);
-	void set_capacity(const unsigned int& u_buf_len);
+	void rewind_write(const size_t& u_write_idx);	// 写位置退回到u_write_idx，丢弃之后写入的数据
+	void* abort_memory(size_t& u_read_idx, size_t& u_write_idx);
+	void set_capacity(const size_t& u_buf_len);		// 保证从读位置起至少有u_buf_len字节的空间
+	void reserve(const size_t& u_len);				// 预计还要写入u_len字节时一次扩充到位
 
 	/* 适用于容器 */
 	template<typename T>
-	unsigned int read(T& t, const unsigned int& u_len) const 
+	size_t read(T& t, const size_t& u_len) const 
 	{
-		unsigned int u_left = m_u_write_idx - m_u_read_idx;
-		unsigned int u_read_len = u_left < u_len ? u_left : u_len;
+		size_t u_left = m_u_write_idx - m_u_read_idx;
+		size_t u_read_len = u_left < u_len ? u_left : u_len;
 		typedef typename T::value_type ElemType;
 		ElemType ele;
-		for (unsigned int i = 0; i < u_read_len; ++i)
+		for (size_t i = 0; i < u_read_len; ++i)
 		{
 			operator>>(ele);
 			t.push_back(ele);
@@ -88,31 +136,9 @@ public:
 		T t1(t);
 		swap_endian(t1, m_e_endian);
 		/* 判断长度是否超标 */
-		unsigned int u_expected_size = m_u_write_idx + sizeof(t);
-		u_expected_size = (u_expected_size / m_u_expand_size + ((u_expected_size%m_u_expand_size != 0) ? 1 : 0))*m_u_expand_size;
-		if (u_expected_size > m_u_buf_len)
+		if (!grow(m_u_write_idx + sizeof(t)))
 		{
-			if (m_e_strategy == buf_stable)
-			{
-				return *this;
-			}
-			else if (m_e_strategy == buf_flexable)
-			{
-				unsigned char* p = reinterpret_cast<unsigned char*>(ht_realloc(m_sz_buf, u_expected_size));
-				if (u_expected_size == 0) 
-				{
-					/* 原指针失效，属于未定义行为，可能是程序有问题 */
-					return *this;
-				}
-				if (!p)
-				{
-					/* 内存分配失败，原空间依然有效，但是内存已经不足 */
-					return *this;
-				}
-				m_sz_buf = p;
-				m_u_buf_len = u_expected_size;
-			}
-			else {}
+			return *this;
 		}
 		/* 在write位置写入数据 */
 		unsigned char* p_w = m_sz_buf + m_u_write_idx;
@@ -146,7 +172,7 @@ public:
 	}
 
 	template<typename T>
-	bool try_read(T& t, const unsigned int& u_len) const
+	bool try_read(T& t, const size_t& u_len) const
 	{
 		if (m_u_write_idx < m_u_read_idx + u_len)
 		{
@@ -191,9 +217,15 @@ DECLARE_SWAP_TYPE(int)
 DECLARE_SWAP_TYPE(unsigned int)
 DECLARE_SWAP_TYPE(long)
 DECLARE_SWAP_TYPE(unsigned long)
+DECLARE_SWAP_TYPE(float)
+DECLARE_SWAP_TYPE(double)
 
 #if defined(_WIN32) || defined(_WIN64)
 #	if(_MSC_VER >= 1600)
 DECLARE_SWAP_TYPE(long long)
+DECLARE_SWAP_TYPE(unsigned long long)
 #	endif
+#else
+DECLARE_SWAP_TYPE(long long)
+DECLARE_SWAP_TYPE(unsigned long long)
 #endif
@@ -0,0 +1,373 @@
+#ifndef _IDX_READER_HPP_
+#define _IDX_READER_HPP_
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "mat.hpp"
+#include "simd_kernel.hpp"
+
+/*
+ * IDX格式(MNIST等数据集使用)：4字节magic(0, 0, 元素类型, 维数) + 每一维的长度(大端int32) + 数据
+ * 这里只读取元素类型为0x08(uint8)的文件
+ */
+struct idx_header
+{
+	int					i_type = 0;
+	std::vector<int>	vec_dims;
+	/* 数据部分在文件中的偏移 */
+	std::streamoff		off_data = 0;
+
+	/* 除第一维(样本数)外各维长度之积，即每个样本的元素个数 */
+	int sample_size() const
+	{
+		int n = 1;
+		for (size_t i = 1; i < vec_dims.size(); ++i)
+			n *= vec_dims[i];
+		return n;
+	}
+};
+
+inline int read_idx_header(std::ifstream& ifs, idx_header& h)
+{
+	unsigned char sz_magic[4] = { 0 };
+	if (!ifs.read(reinterpret_cast<char*>(sz_magic), sizeof(sz_magic)) || sz_magic[0] != 0 || sz_magic[1] != 0 || sz_magic[3] == 0)
+		return -1;
+	h.i_type = sz_magic[2];
+	h.vec_dims.resize(sz_magic[3]);
+	for (int& i_dim : h.vec_dims)
+	{
+		unsigned char sz_dim[4] = { 0 };
+		if (!ifs.read(reinterpret_cast<char*>(sz_dim), sizeof(sz_dim)))
+			return -1;
+		i_dim = static_cast<int>((uint32_t(sz_dim[0]) << 24) | (uint32_t(sz_dim[1]) << 16) | (uint32_t(sz_dim[2]) << 8) | uint32_t(sz_dim[3]));
+		if (i_dim < 0)
+			return -1;
+	}
+	h.off_data = ifs.tellg();
+	return h.i_type == 0x08 ? 0 : -1;
+}
+
+/*
+ * 流式读取IDX格式的图片和标签，按mini-batch输出：
+ *   后台线程每次从两个文件各读chunk_batches个batch的原始字节，两块缓冲区轮流使用(一块被转换时读下一块)
+ *   调用线程把uint8像素乘以scale用simd_kernels::from_u8转换，按列写入batch的矩阵(不经过中间矩阵)，标签转成one-hot
+ * 常驻内存只有两块原始数据和一个batch的矩阵，与数据集的大小无关
+ * mt_image的第k列是一个batch中的第k张图，mt_label的第k列是它的one-hot标签；
+ * 最后一个batch不满时，多出的列为0，i_count是实际的样本数
+ * 没有打开文件或打开失败时next()直接返回false；读取中途发现文件比头部声明的短时next()返回false，failed()为true
+ * 用法：
+ *   idx_batch_reader<784, 10, 64> reader;
+ *   reader.open("train-images.idx3-ubyte", "train-labels.idx1-ubyte");
+ *   for (auto& batch : reader) { ... }	// 每次begin()从头开始一个epoch
+ */
+template<int pixel_num, int label_num, int batch_size, typename val_t = double>
+class idx_batch_reader
+{
+public:
+	using image_type = mat<pixel_num, batch_size, val_t>;
+	using label_type = mat<label_num, batch_size, val_t>;
+
+	struct batch_t
+	{
+		image_type	mt_image;
+		label_type	mt_label;
+		int			sz_label[batch_size];
+		int			i_count = 0;
+	};
+
+	class iterator
+	{
+		idx_batch_reader*	p_reader;
+	public:
+		using iterator_category = std::input_iterator_tag;
+		using value_type = batch_t;
+		using difference_type = std::ptrdiff_t;
+		using pointer = batch_t*;
+		using reference = batch_t&;
+
+		explicit iterator(idx_batch_reader* p) :p_reader(p)
+		{
+		}
+		batch_t& operator*() const { return p_reader->batch; }
+		batch_t* operator->() const { return &p_reader->batch; }
+		iterator& operator++()
+		{
+			if (!p_reader->next(p_reader->batch))
+				p_reader = nullptr;
+			return *this;
+		}
+		bool operator==(const iterator& other) const { return p_reader == other.p_reader; }
+		bool operator!=(const iterator& other) const { return p_reader != other.p_reader; }
+	};
+
+	explicit idx_batch_reader(const int& i_chunk_batches = 64, const val_t& scale = val_t(1) / val_t(256))
+		:i_chunk_samples(std::max(1, i_chunk_batches) * batch_size), v_scale(scale)
+	{
+	}
+	idx_batch_reader(const idx_batch_reader&) = delete;
+	idx_batch_reader& operator=(const idx_batch_reader&) = delete;
+
+	~idx_batch_reader()
+	{
+		stop();
+	}
+
+	/* 打开图片和标签文件，检查每个样本的大小、样本数以及文件长度，随即开始预读 */
+	int open(const char* cstr_images_path, const char* cstr_labels_path)
+	{
+		stop();
+		b_end = true;
+		b_error = false;
+		ifs_image.close();
+		ifs_label.close();
+		ifs_image.open(cstr_images_path, std::ifstream::binary);
+		ifs_label.open(cstr_labels_path, std::ifstream::binary);
+		i_num = 0;
+		if (!ifs_image.is_open() || !ifs_label.is_open())
+			return -1;
+		if (read_idx_header(ifs_image, h_image) != 0 || read_idx_header(ifs_label, h_label) != 0)
+			return -1;
+		if (h_image.vec_dims.size() < 2 || h_image.sample_size() != pixel_num || h_label.vec_dims.size() != 1
+			|| h_image.vec_dims[0] != h_label.vec_dims[0])
+			return -1;
+		if (!has_bytes(ifs_image, h_image, static_cast<long long>(h_image.vec_dims[0]) * pixel_num)
+			|| !has_bytes(ifs_label, h_label, h_label.vec_dims[0]))
+			return -1;
+		i_num = h_image.vec_dims[0];
+		for (auto& ck : sz_chunk)
+		{
+			ck.vec_image.resize(static_cast<size_t>(i_chunk_samples) * pixel_num);
+			ck.vec_label.resize(i_chunk_samples);
+		}
+		start();
+		return 0;
+	}
+
+	/* 样本总数 */
+	int size() const
+	{
+		return i_num;
+	}
+
+	/* 读取中途发现文件比头部声明的短 */
+	bool failed() const
+	{
+		return b_error;
+	}
+
+	/* 两块原始数据缓冲区占用的字节数 */
+	size_t buffer_bytes() const
+	{
+		return 2 * static_cast<size_t>(i_chunk_samples) * (pixel_num + 1);
+	}
+
+	/* 回到第一个样本 */
+	void rewind()
+	{
+		if (i_num == 0)
+			return;
+		stop();
+		start();
+	}
+
+	/* 取下一个batch，数据已经读完、没有打开文件或读取出错时返回false */
+	bool next(batch_t& b)
+	{
+		if (b_end || !th_reader.joinable())
+			return false;
+		chunk_t& ck = sz_chunk[i_consume];
+		if (i_offset == 0)
+		{
+			std::unique_lock<std::mutex> lk(mtx);
+			cv.wait(lk, [&ck]() { return ck.b_ready; });
+		}
+		if (ck.i_count <= 0)
+		{
+			b_end = true;
+			b_error = ck.i_count < 0;
+			return false;
+		}
+		const int n = std::min(batch_size, ck.i_count - i_offset);
+		convert(ck, i_offset, n, b);
+		i_offset += n;
+		if (i_offset == ck.i_count)
+		{
+			{
+				std::lock_guard<std::mutex> lk(mtx);
+				ck.b_ready = false;
+			}
+			cv.notify_all();
+			i_consume ^= 1;
+			i_offset = 0;
+		}
+		return true;
+	}
+
+	iterator begin()
+	{
+		rewind();
+		iterator it(this);
+		return ++it;
+	}
+
+	iterator end()
+	{
+		return iterator(nullptr);
+	}
+
+private:
+	struct chunk_t
+	{
+		std::vector<unsigned char>	vec_image;
+		std::vector<unsigned char>	vec_label;
+		int							i_count = 0;		// 0表示文件已经读完，-1表示读取出错
+		bool						b_ready = false;	// 后台线程已填好，等待转换
+	};
+
+	const int					i_chunk_samples;
+	const val_t					v_scale;
+	std::ifstream				ifs_image;
+	std::ifstream				ifs_label;
+	idx_header					h_image;
+	idx_header					h_label;
+	int							i_num = 0;
+	chunk_t						sz_chunk[2];
+	std::thread					th_reader;
+	std::mutex					mtx;
+	std::condition_variable		cv;
+	bool						b_stop = false;
+	int							i_consume = 0;
+	int							i_offset = 0;
+	bool						b_end = true;
+	bool						b_error = false;
+	/* 迭代器使用的batch */
+	batch_t						batch;
+
+	void start()
+	{
+		ifs_image.clear();
+		ifs_label.clear();
+		ifs_image.seekg(h_image.off_data);
+		ifs_label.seekg(h_label.off_data);
+		for (auto& ck : sz_chunk)
+			ck.b_ready = false;
+		b_stop = false;
+		i_consume = 0;
+		i_offset = 0;
+		b_end = false;
+		b_error = false;
+		th_reader = std::thread([this]() { reader_loop(); });
+	}
+
+	void stop()
+	{
+		if (!th_reader.joinable())
+			return;
+		{
+			std::lock_guard<std::mutex> lk(mtx);
+			b_stop = true;
+		}
+		cv.notify_all();
+		th_reader.join();
+	}
+
+	/*
+	 * 后台线程：等一块缓冲区空出来，读满后交给调用线程；读到文件末尾时交出一块i_count为0的缓冲区后退出，
+	 * 文件比头部声明的短(打开后被截断)时交出i_count为-1的缓冲区
+	 */
+	void reader_loop()
+	{
+		int i_read = 0;
+		for (int i_slot = 0; ; i_slot ^= 1)
+		{
+			chunk_t& ck = sz_chunk[i_slot];
+			{
+				std::unique_lock<std::mutex> lk(mtx);
+				cv.wait(lk, [&]() { return b_stop || !ck.b_ready; });
+				if (b_stop)
+					return;
+			}
+			int n = std::min(i_chunk_samples, i_num - i_read);
+			if (n > 0 && (!ifs_image.read(reinterpret_cast<char*>(ck.vec_image.data()), static_cast<std::streamsize>(n) * pixel_num)
+				|| !ifs_label.read(reinterpret_cast<char*>(ck.vec_label.data()), n)))
+			{
+				n = -1;
+			}
+			i_read += std::max(n, 0);
+			{
+				std::lock_guard<std::mutex> lk(mtx);
+				ck.i_count = n;
+				ck.b_ready = true;
+			}
+			cv.notify_all();
+			if (n <= 0)
+				return;
+		}
+	}
+
+	/* 从数据部分开始至少还有ll_bytes字节 */
+	static bool has_bytes(std::ifstream& ifs, const idx_header& h, const long long& ll_bytes)
+	{
+		ifs.seekg(0, std::ifstream::end);
+		const std::streamoff off_end = ifs.tellg();
+		return off_end >= h.off_data && off_end - h.off_data >= ll_bytes;
+	}
+
+	void convert(const chunk_t& ck, const int& i_begin, const int& n, batch_t& b)
+	{
+		const simd_kernels<val_t>& k = simd_kernels<val_t>::get();
+		const unsigned char* p_src = ck.vec_image.data() + static_cast<size_t>(i_begin) * pixel_num;
+		if constexpr (batch_size == 1)
+		{
+			k.from_u8(p_src, v_scale, b.mt_image.pval->p, pixel_num);
+		}
+		else
+		{
+			/*
+			 * 第c张图是mt_image的第c列(步长为batch_size)：按i_tile_rows个像素 * i_tile_cols张图分块，
+			 * 每张图的一段像素先用from_u8转换到栈上小块的一行，再转置写入mt_image，
+			 * 写入时mt_image的每一行是连续的i_tile_cols个元素
+			 */
+			constexpr int i_tile_rows = 64;
+			constexpr int i_tile_cols = batch_size < 32 ? batch_size : 32;
+			val_t sz_tile[i_tile_cols][i_tile_rows];
+			val_t* p_image = b.mt_image.pval->p;
+			for (int i_pixel = 0; i_pixel < pixel_num; i_pixel += i_tile_rows)
+			{
+				const int i_rows = pixel_num - i_pixel < i_tile_rows ? pixel_num - i_pixel : i_tile_rows;
+				val_t* p_dst = p_image + static_cast<size_t>(i_pixel) * batch_size;
+				for (int c0 = 0; c0 < n; c0 += i_tile_cols)
+				{
+					const int i_cols = n - c0 < i_tile_cols ? n - c0 : i_tile_cols;
+					for (int c = 0; c < i_cols; ++c)
+						k.from_u8(p_src + static_cast<size_t>(c0 + c) * pixel_num + i_pixel, v_scale, sz_tile[c], i_rows);
+					for (int i = 0; i < i_rows; ++i)
+					{
+						val_t* p_row = p_dst + static_cast<size_t>(i) * batch_size + c0;
+						for (int c = 0; c < i_cols; ++c)
+							p_row[c] = sz_tile[c][i];
+					}
+				}
+				/* 最后一个batch不满时，多出的列置0 */
+				for (int i = 0; i < i_rows && n < batch_size; ++i)
+					std::fill(p_dst + static_cast<size_t>(i) * batch_size + n, p_dst + static_cast<size_t>(i + 1) * batch_size, val_t(0));
+			}
+		}
+		val_t* p_label = b.mt_label.pval->p;
+		std::fill(p_label, p_label + label_num * batch_size, val_t(0));
+		for (int i = 0; i < batch_size; ++i)
+		{
+			b.sz_label[i] = i < n ? ck.vec_label[i_begin + i] : -1;
+			if (b.sz_label[i] >= 0 && b.sz_label[i] < label_num)
+				b.mt_label.get(b.sz_label[i], i) = 1;
+		}
+		b.i_count = n;
+	}
+};
+
+#endif
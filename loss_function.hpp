@@ -22,7 +22,7 @@ struct loss_function<class mse>
         // 计算均方误差
         output_t diff = output - expected;
         // 返回偏导数
-        constexpr double factor = 2.0 / (output_t::r * output_t::c);
+        constexpr typename output_t::type factor = static_cast<typename output_t::type>(2.0 / (output_t::r * output_t::c));
         return diff * factor;
     }
 };
@@ -38,7 +38,7 @@ struct loss_function<class cross_entropy>
         // 计算交叉熵损失
         output_t diff = output - expected;
         // 返回偏导数
-        return diff / (output * (1.0 - output));
+        return diff / (output * (typename output_t::type(1.0) - output));
     }
 };
 
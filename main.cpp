@@ -2,6 +2,23 @@
 #include <iostream>
 #include "base_function.hpp"
 
+// 执行i_loop次f，打印每次的耗时和矩阵内存的分配次数(g_mat_alloc_count)，返回每次的耗时(ns)
+template<typename func_t>
+double run_bench(const char* name, const int& i_loop, func_t&& f)
+{
+    f();                                                    // 预热
+    long long alloc_begin = g_mat_alloc_count;
+    auto start_time = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < i_loop; ++i)
+    {
+        f();
+    }
+    auto end_time = std::chrono::high_resolution_clock::now();
+    double ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end_time - start_time).count();
+    printf("%-40s %12.1lf ns/op %10.2lf allocs/op\r\n", name, ns / i_loop, double(g_mat_alloc_count - alloc_begin) / i_loop);
+    return ns / i_loop;
+}
+
 void test_base_ops()
 {
     mat<3, 1, double> mt1 = { 1, 2, 3 };
@@ -61,6 +78,581 @@ void test_bp()
     net.forward(mt_input).print();
 }
 
+// 存储策略的对比：默认编译为inline/cow混合策略，使用-DMAT_DEFAULT_STORAGE=cow_storage编译可得到全部共享堆内存时的基准
+#define BENCH_STR(x) #x
+#define BENCH_XSTR(x) BENCH_STR(x)
+void bench_mat_storage()
+{
+    printf("storage policy: %s\r\n", BENCH_XSTR(MAT_DEFAULT_STORAGE));
+    using net_t = bp<double, 1, nadam, softmax, HeMean, 3, 10>;
+    net_t net;
+    typename net_t::input_type mt_input = { .1, .2, .3 };
+    typename net_t::ret_type mt_expected = { 0, 1., 0, 0, 0, 0, 0, 0, 0, 0 };
+    run_bench("bp<3,10> forward", 200000, [&]() {
+        net.forward(mt_input);
+    });
+    run_bench("bp<3,10> forward/backward", 200000, [&]() {
+        auto mt_out = net.forward(mt_input);
+        net.backward(mt_out - mt_expected);
+    });
+    using deep_net_t = bp<double, 1, nadam, ReLu, HeMean, 3, 10, 10, 3>;
+    deep_net_t deep_net;
+    typename deep_net_t::ret_type mt_deep_expected = { 0, 1., 0 };
+    run_bench("bp<3,10,10,3> forward/backward", 200000, [&]() {
+        auto mt_out = deep_net.forward(mt_input);
+        deep_net.backward(mt_out - mt_deep_expected);
+    });
+}
+
+// 逐个operator<<写出n个double：扩充是几何增长时每个元素的耗时与n无关，预先reserve时只分配一次
+void bench_ht_memory_growth()
+{
+	for (int n : { 1 << 16, 1 << 19, 1 << 22 })
+	{
+		char sz_name[64];
+		const int i_loop = (1 << 23) / n;
+		snprintf(sz_name, sizeof(sz_name), "operator<< %d doubles", n);
+		double ns = run_bench(sz_name, i_loop, [&]() {
+			ht_memory mry(system_endian());
+			for (int i = 0; i < n; ++i)
+				mry << double(i);
+		});
+		printf("%40s %12.2lf ns/element\r\n", "", ns / n);
+		snprintf(sz_name, sizeof(sz_name), "reserve + operator<< %d doubles", n);
+		ns = run_bench(sz_name, i_loop, [&]() {
+			ht_memory mry(system_endian());
+			mry.reserve(n * sizeof(double));
+			for (int i = 0; i < n; ++i)
+				mry << double(i);
+		});
+		printf("%40s %12.2lf ns/element\r\n", "", ns / n);
+	}
+}
+
+// 784*392的权重矩阵序列化：逐元素operator<< / >>与整块write_array/read_array，本机端序和相反端序
+void bench_serialize()
+{
+	mat<784, 392, double> W(.01), W2;
+	for (int i = 0; i < 784 * 392; ++i)
+		W.pval->p[i] = i * 1e-3;
+	const double d_mb = 784. * 392 * sizeof(double) / (1024. * 1024.);
+	auto report = [&](const double& ns) { printf("%40s %12.1lf MB/s\r\n", "", d_mb / (ns * 1e-9)); };
+	const ht_memory::endian e_other = system_endian() == ht_memory::little_endian ? ht_memory::big_endian : ht_memory::little_endian;
+	for (const ht_memory::endian& e : { system_endian(), e_other })
+	{
+		printf("%s endian\r\n", e == system_endian() ? "native" : "swapped");
+		report(run_bench("write per element", 20, [&]() {
+			ht_memory mry(e);
+			for (int i = 0; i < 784 * 392; ++i)
+				mry << W.pval->p[i];
+		}));
+		report(run_bench("write_file(mat)", 20, [&]() {
+			ht_memory mry(e);
+			write_file(W, mry);
+		}));
+		ht_memory mry(e);
+		write_file(W, mry);
+		report(run_bench("read per element", 20, [&]() {
+			mry.reset_read();
+			for (int i = 0; i < 784 * 392; ++i)
+				mry >> W2.pval->p[i];
+		}));
+		report(run_bench("read_file(mat)", 20, [&]() {
+			mry.reset_read();
+			read_file(mry, W2);
+		}));
+		printf("%40s %s\r\n", "", memcmp(W.pval->p, W2.pval->p, sizeof(double) * 784 * 392) == 0 ? "round trip ok" : "round trip FAILED");
+	}
+}
+
+// 模型加载：整个文件读进ht_memory再逐元素复制，与映射文件后矩阵直接引用映射中的数据
+void bench_mmap()
+{
+	using net_t = bp<double, 1, gd, sigmoid, XavierGaussian, 1568, 784, 392, 10>;
+	auto p_net = std::make_unique<net_t>();
+	mat<1568, 1, double> mt_input(.5);
+	{
+		ht_memory mry(system_endian());
+		write_file(*p_net, mry);
+		mry.write_file("./bench_packed.mry");
+		ht_memory mry_align(system_endian());
+		mry_align.set_tensor_align(4096);
+		write_file(*p_net, mry_align);
+		mry_align.write_file("./bench_aligned.mry");
+		printf("file size packed %zu, aligned %zu\r\n", mry.size(), mry_align.size());
+	}
+	auto p_load = std::make_unique<net_t>();
+	run_bench("ht_memory::read_file + read_file", 20, [&]() {
+		ht_memory mry(system_endian());
+		mry.read_file("./bench_packed.mry");
+		read_file(mry, *p_load);
+	});
+	double d_copy = p_load->forward(mt_input).pval->p[0];
+	run_bench("ht_mapped_memory::map_file + read_file", 20, [&]() {
+		ht_mapped_memory mry(system_endian());
+		mry.set_tensor_align(4096);
+		mry.map_file("./bench_aligned.mry");
+		read_file(mry, *p_load);
+	});
+	printf("forward %lf %lf %lf\r\n", p_net->forward(mt_input).pval->p[0], d_copy, p_load->forward(mt_input).pval->p[0]);
+	remove("./bench_packed.mry");
+	remove("./bench_aligned.mry");
+}
+
+#include "tensor_file.hpp"
+// 张量目录格式：打开时只解析头部和目录，按需读取其中一层，与按位置解析整个文件比较
+void bench_tensor_file()
+{
+	using net_t = bp<double, 1, gd, sigmoid, XavierGaussian, 1568, 784, 392, 10>;
+	using layer_t = bp<double, 1, gd, sigmoid, XavierGaussian, 784, 392>;
+	auto p_net = std::make_unique<net_t>();
+	{
+		ht_memory mry(system_endian());
+		write_file(*p_net, mry);
+		mry.write_file("./bench_packed.mry");
+		ht_memory mry_tf(system_endian());
+		write_tensor_file(*p_net, mry_tf);
+		mry_tf.write_file("./bench_tensor.mry");
+		printf("file size packed %zu, tensor directory %zu\r\n", mry.size(), mry_tf.size());
+	}
+	auto p_load = std::make_unique<net_t>();
+	run_bench("read_file + read_file (whole net)", 20, [&]() {
+		ht_memory mry(system_endian());
+		mry.read_file("./bench_packed.mry");
+		read_file(mry, *p_load);
+	});
+	run_bench("map_file + tensor_file::open", 200, [&]() {
+		ht_mapped_memory mry(system_endian());
+		mry.map_file("./bench_tensor.mry");
+		tensor_file tf;
+		tf.open(mry);
+	});
+	auto p_layer = std::make_unique<layer_t>();
+	int i_ret = 0;
+	run_bench("map_file + open + read layer 1", 200, [&]() {
+		ht_mapped_memory mry(system_endian());
+		mry.map_file("./bench_tensor.mry");
+		tensor_file tf;
+		tf.open(mry);
+		i_ret |= tf.read_tensors([&](auto&& v) { visit_tensors(*p_layer, "", v, 1); });
+	});
+	run_bench("map_file + open + read layer 1 (no crc)", 200, [&]() {
+		ht_mapped_memory mry(system_endian());
+		mry.map_file("./bench_tensor.mry");
+		tensor_file tf;
+		tf.open(mry);
+		i_ret |= tf.read_tensors([&](auto&& v) { visit_tensors(*p_layer, "", v, 1); }, false);
+	});
+	run_bench("ht_memory + open + read whole net", 20, [&]() {
+		ht_memory mry(system_endian());
+		mry.read_file("./bench_tensor.mry");
+		tensor_file tf;
+		tf.open(mry);
+		i_ret |= tf.read("", *p_load);
+	});
+	printf("read %s, layer 1 weight %s\r\n", i_ret == TF_OK ? "ok" : "FAILED",
+		memcmp(p_layer->mt_weight.pval->p, p_net->net_next.mt_weight.pval->p, sizeof(double) * 784 * 392) == 0 ? "same" : "DIFFERENT");
+	remove("./bench_packed.mry");
+	remove("./bench_tensor.mry");
+}
+
+// 张量目录格式：正常写入的文件能打开并读回；目录项的数据偏移超出文件长度时open返回TF_BAD_FORMAT
+void test_tensor_file()
+{
+	using net_t = bp<double, 1, gd, sigmoid, XavierGaussian, 4, 3>;
+	net_t net, net_load;
+	ht_memory mry(system_endian());
+	write_tensor_file(net, mry);
+	tensor_file tf;
+	int i_ret = tf.open(mry);
+	if (i_ret == TF_OK)
+		i_ret = tf.read("", net_load);
+	printf("open and read: %s\r\n", i_ret == TF_OK && memcmp(net.mt_weight.pval->p, net_load.mt_weight.pval->p, sizeof(double) * 3 * 4) == 0 ? "ok" : "FAILED");
+
+	/* 把第一项的偏移改到文件末尾之后，重算目录的CRC32C，只让偏移检查来拦截 */
+	ht_memory mry_bad(mry);
+	unsigned char* p = mry_bad.buf();
+	unsigned long long ull_dir_size = 0, ull_len = 0;
+	memcpy(&ull_dir_size, p + 24, 8);
+	memcpy(&ull_len, p + 40, 8);
+	unsigned char* p_entry = p + TENSOR_FILE_HEADER_SIZE;
+	uint16_t u_name_len = 0;
+	memcpy(&u_name_len, p_entry, 2);
+	const unsigned long long ull_offset = (ull_len / TENSOR_FILE_ALIGN + 2) * TENSOR_FILE_ALIGN;
+	memcpy(p_entry + 2 + u_name_len + 2 + 4 * p_entry[2 + u_name_len + 1], &ull_offset, 8);
+	const uint32_t u_dir_crc = simd_crc32c(p_entry, ull_dir_size);
+	memcpy(p + 20, &u_dir_crc, 4);
+	printf("offset past the end: %s\r\n", tf.open(mry_bad) == TF_BAD_FORMAT ? "rejected" : "ACCEPTED");
+}
+
+// 同一拓扑分别用编译期形状的bp和运行时形状的dbp，比较前向/反向的耗时
+void bench_dmat()
+{
+    using net_t = bp<double, 1, gd, sigmoid, XavierGaussian, 784, 392, 10>;
+    auto p_net = std::make_unique<net_t>();
+    dbp<double, gd, sigmoid, XavierGaussian> dnet({ 784, 392, 10 });
+    mat<784, 1, double> mt_input(.5);
+    mat<10, 1, double> mt_expected(0.);
+    mt_expected.get(3, 0) = 1.;
+    dmat<double> dmt_input(mt_input), dmt_expected(mt_expected);
+    run_bench("bp<784,392,10> forward", 2000, [&]() { p_net->forward(mt_input); });
+    run_bench("dbp{784,392,10} forward", 2000, [&]() { dnet.forward(dmt_input); });
+    run_bench("bp<784,392,10> forward/backward", 500, [&]() {
+        auto mt_out = p_net->forward(mt_input);
+        p_net->backward(mt_out - mt_expected);
+    });
+    run_bench("dbp{784,392,10} forward/backward", 500, [&]() {
+        auto mt_out = dnet.forward(dmt_input);
+        dnet.backward(mt_out - dmt_expected);
+    });
+}
+
+// proxy_dbn_t反向传播时每个头取ret的第i列：col(i)复制成mat与col_view(i)直接使用视图的对比
+void bench_view()
+{
+    mat<200, 8, double> mt_ret(.5);
+    mat<200, 1, double> mt_grad(.25), mt_out;
+    bp<double, 1, gd, softmax, XavierGaussian, 200, 200> net;
+    run_bench("mat<200,1> copy of col(i) * grad", 200000, [&]() {
+        mat<200, 1, double> mt_col = mt_ret.col(3);
+        mt_out = mt_col * mt_grad;
+    });
+    run_bench("col_view(i) * grad", 200000, [&]() { mt_out = mt_ret.col_view(3) * mt_grad; });
+    run_bench("bp<200,200>.backward(col(i))", 2000, [&]() { net.backward(mt_ret.col(3)); });
+    run_bench("bp<200,200>.backward(col_view(i))", 2000, [&]() { net.backward(mt_ret.col_view(3)); });
+}
+
+void bench_expr()
+{
+    using mat_t = mat<784, 392, double>;
+    mat_t mt_w(.5), mt_g(.01), mt_v(.2);
+    nadam<mat_t> updater;
+    run_bench("nadam update 784*392", 200, [&]() {
+        mt_w = updater.update(mt_w, mt_g);
+    });
+    run_bench("w - lr * g / (sqrtl(v) + eps) 784*392", 200, [&]() {
+        mt_w = mt_w - .001 * mt_g / (sqrtl(mt_v) + 1e-8);
+    });
+    run_bench("a * b + c 784*392", 200, [&]() {
+        mt_w = mt_g * mt_v + mt_w;
+    });
+}
+
+// 原地更新与返回新矩阵的对比，主要看每次的堆分配次数
+void bench_inplace()
+{
+    using mat_t = mat<784, 392, double>;
+    mat_t mt_w(.5), mt_g(.01);
+    nadam<mat_t> updater;
+    run_bench("w = nadam.update(w, g) 784*392", 200, [&]() {
+        mt_w = updater.update(mt_w, mt_g);
+    });
+    run_bench("nadam.step(w, g) 784*392", 200, [&]() {
+        updater.step(mt_w, mt_g);
+    });
+    run_bench("w.axpy(-lr, g) 784*392", 200, [&]() {
+        mt_w.axpy(-.001, mt_g);
+    });
+    mat<392, 784, double> mt_a(.01);
+    mat<392, 1, double> mt_x(.5), mt_b(.1);
+    mat<784, 1, double> mt_in(.5);
+    run_bench("mat y = a.dot(x) + b 392*784", 2000, [&]() {
+        mat<392, 1, double> mt_y = mt_a.dot(mt_in) + mt_b;
+        mt_x = mt_y;
+    });
+    using net_t = bp<double, 1, nadam, sigmoid, XavierGaussian, 784, 392, 10>;
+    auto p_net = std::make_unique<net_t>();
+    mat<10, 1, double> mt_expected(0.);
+    mt_expected.get(3, 0) = 1.;
+    run_bench("bp<784,392,10> forward/backward", 500, [&]() {
+        auto mt_out = p_net->forward(mt_in);
+        p_net->backward(mt_out - mt_expected);
+    });
+    dbp<double, nadam, sigmoid, XavierGaussian> dnet({ 784, 392, 10 });
+    dmat<double> dmt_input(mt_in), dmt_expected(mt_expected);
+    run_bench("dbp{784,392,10} forward/backward", 500, [&]() {
+        auto mt_out = dnet.forward(dmt_input);
+        dnet.backward(mt_out - dmt_expected);
+    });
+}
+
+// softmax：原来的max、exp、sum、除法逐步计算与融合内核的对比，64*64相当于mha_t中data_num为64的注意力分数矩阵
+template<int row_num, int col_num>
+void bench_softmax_shape(const int& i_loop)
+{
+    char sz_name[64];
+    mat<row_num, col_num, double> mt_in, mt_out;
+    for (int i = 0; i < row_num * col_num; ++i)
+        mt_in.pval->p[i] = (i % 17) * .25 - 2.;
+    snprintf(sz_name, sizeof(sz_name), "step by step %d*%d", row_num, col_num);
+    run_bench(sz_name, i_loop, [&]() {
+        double d_max = mt_in.max();
+        mat<row_num, col_num, double> mt_exp = exp(mt_in - d_max);
+        double d_sum = mt_exp.sum();
+        mt_out = mt_exp / d_sum;
+    });
+    softmax<mat<row_num, col_num, double> > sm;
+    snprintf(sz_name, sizeof(sz_name), "softmax %d*%d", row_num, col_num);
+    run_bench(sz_name, i_loop, [&]() { sm.forward(mt_in); });
+    col_softmax<mat<row_num, col_num, double> > sm_col;
+    snprintf(sz_name, sizeof(sz_name), "col_softmax %d*%d", row_num, col_num);
+    run_bench(sz_name, i_loop, [&]() { sm_col.forward(mt_in); });
+    row_softmax<mat<row_num, col_num, double> > sm_row;
+    snprintf(sz_name, sizeof(sz_name), "row_softmax %d*%d", row_num, col_num);
+    run_bench(sz_name, i_loop, [&]() { sm_row.forward(mt_in); });
+}
+
+void bench_softmax()
+{
+    bench_softmax_shape<10, 1>(200000);
+    bench_softmax_shape<10, 64>(20000);
+    bench_softmax_shape<64, 64>(20000);
+    bench_softmax_shape<256, 256>(500);
+}
+
+// 28*28的输入上单通道卷积(inner_conv/pad_conv)，以及多通道多批次时直接卷积与im2col+gemm的对比
+template<int tpl_size>
+void bench_conv_shape(const int& i_loop)
+{
+    char sz_name[64];
+    mat<28, 28, double> mt_in;
+    mat<tpl_size, tpl_size, double> mt_tpl;
+    for (int i = 0; i < 28 * 28; ++i)
+        mt_in.pval->p[i] = (i % 17) * .25 - 2.;
+    for (int i = 0; i < tpl_size * tpl_size; ++i)
+        mt_tpl.pval->p[i] = (i % 5) * .1 - .2;
+    double d_sum = 0.;
+    snprintf(sz_name, sizeof(sz_name), "inner_conv 28*28 tpl %d*%d", tpl_size, tpl_size);
+    run_bench(sz_name, i_loop, [&]() { d_sum += inner_conv<1, 1>(mt_in, mt_tpl).sum(); });
+    snprintf(sz_name, sizeof(sz_name), "pad_conv<2,2> 28*28 tpl %d*%d", tpl_size, tpl_size);
+    run_bench(sz_name, i_loop, [&]() { d_sum += pad_conv<2, 2>(mt_in, mt_tpl).sum(); });
+    if (d_sum == 1.)
+        printf("%lf\n", d_sum);
+}
+
+template<typename val_t>
+void bench_conv_channels(const int& i_batch, const int& in_c, const int& out_c, const int& i_loop)
+{
+    char sz_name[64];
+    conv_shape s{ in_c, 28, 28, out_c, 5, 5, 1, 1, 2, 2, 2, 2 };
+    const int i_in_size = 28 * 28, i_k_size = 25, i_out_size = s.out_h() * s.out_w();
+    std::vector<val_t> vec_in(i_batch * in_c * i_in_size), vec_k(out_c * in_c * i_k_size), vec_out(i_batch * out_c * i_out_size);
+    for (size_t i = 0; i < vec_in.size(); ++i)
+        vec_in[i] = val_t((i % 17) * .25 - 2.);
+    for (size_t i = 0; i < vec_k.size(); ++i)
+        vec_k[i] = val_t((i % 5) * .1 - .2);
+    auto plane_in = [&](const int& n, const int& ic) { return vec_in.data() + (n * in_c + ic) * i_in_size; };
+    auto plane_k = [&](const int& oc, const int& ic) { return vec_k.data() + (oc * in_c + ic) * i_k_size; };
+    auto plane_out = [&](const int& n, const int& oc) { return vec_out.data() + (n * out_c + oc) * i_out_size; };
+    snprintf(sz_name, sizeof(sz_name), "direct %d*(%d->%d) 5*5", i_batch, in_c, out_c);
+    run_bench(sz_name, i_loop, [&]() { conv2d_direct<val_t>(s, i_batch, plane_in, plane_k, plane_out); });
+    snprintf(sz_name, sizeof(sz_name), "im2col %d*(%d->%d) 5*5", i_batch, in_c, out_c);
+    run_bench(sz_name, i_loop, [&]() { conv2d_im2col<val_t>(s, i_batch, plane_in, plane_k, plane_out); });
+}
+
+void bench_conv()
+{
+    bench_conv_shape<3>(20000);
+    bench_conv_shape<5>(20000);
+    bench_conv_channels<double>(1, 1, 1, 20000);
+    bench_conv_channels<double>(1, 1, 6, 5000);
+    bench_conv_channels<double>(8, 6, 16, 50);
+    bench_conv_channels<float>(8, 6, 16, 50);
+}
+
+// 拼接与拆分：特征向量拼成一列(stretch_one_col/concat_col)，以及join_col/join_row/split_one_mat
+void bench_concat()
+{
+    mat<14, 1, double> mt_rsi;
+    mat<26, 3, double> mt_macd;
+    mat<9, 3, double> mt_kdj;
+    mat<64, 64, double> mt_a, mt_b;
+    for (int i = 0; i < 14; ++i)
+        mt_rsi.pval->p[i] = i * .1;
+    for (int i = 0; i < 78; ++i)
+        mt_macd.pval->p[i] = i * .2 - 3.;
+    for (int i = 0; i < 27; ++i)
+        mt_kdj.pval->p[i] = i * .3 - 1.;
+    for (int i = 0; i < 64 * 64; ++i)
+    {
+        mt_a.pval->p[i] = i % 7;
+        mt_b.pval->p[i] = i % 5;
+    }
+    mat<32, 119, double> mt_w(.01);
+    double d_sum = 0.;
+    run_bench("stretch_one_col 14+78+27", 1000000, [&]() { d_sum += stretch_one_col(mt_rsi, mt_macd, mt_kdj).pval->p[0]; });
+    run_bench("split_one_mat 14+78+27", 1000000, [&]() {
+        auto mt_col = stretch_one_col(mt_rsi, mt_macd, mt_kdj);
+        split_one_mat(mt_col, mt_rsi, mt_macd, mt_kdj);
+    });
+    run_bench("W.dot(stretch_one_col)", 200000, [&]() { d_sum += mt_w.dot(stretch_one_col(mt_rsi, mt_macd, mt_kdj)).pval->p[0]; });
+    run_bench("concat_col.left_dot(W)", 200000, [&]() { d_sum += concat_col(mt_rsi, mt_macd, mt_kdj).left_dot(mt_w).pval->p[0]; });
+    run_bench("join_col 64*64 x2", 100000, [&]() { d_sum += join_col(mt_a, mt_b).pval->p[0]; });
+    run_bench("join_row 64*64 x2", 100000, [&]() { d_sum += join_row(mt_a, mt_b).pval->p[0]; });
+    if (d_sum == 1.)
+        printf("%lf\n", d_sum);
+}
+
+// 数据集归一化：原来的两遍扫描(每个样本产生若干临时矩阵并返回副本)、一遍统计后返回副本、原地归一化
+void bench_normalize()
+{
+    using mat_t = mat<784, 1, double>;
+    std::vector<mat_t> vec_data(2000);
+    for (size_t i = 0; i < vec_data.size(); ++i)
+        for (int j = 0; j < 784; ++j)
+            vec_data[i].pval->p[j] = ((i * 7 + j) % 23) * .5 - 3.;
+    run_bench("two pass copy 2000*784", 5, [&]() {
+        mat_t mt_mean, mt_div;
+        std::vector<mat_t> vec_ret;
+        for (size_t i = 0; i < vec_data.size(); ++i)
+            mt_mean = mt_mean + vec_data[i] / static_cast<double>(vec_data.size());
+        for (size_t i = 0; i < vec_data.size(); ++i)
+        {
+            auto delta = vec_data[i] - mt_mean;
+            mt_div = mt_div + delta * delta / static_cast<double>(vec_data.size());
+        }
+        mat_t mt_s = sqrtl(mt_div);
+        for (size_t i = 0; i < vec_data.size(); ++i)
+            vec_ret.push_back((vec_data[i] - mt_mean) / mt_s);
+    });
+    run_bench("cal_feature_stat 2000*784", 5, [&]() { cal_feature_stat(vec_data); });
+    run_bench("normalize copy 2000*784", 5, [&]() {
+        mat_t mt_mean, mt_div;
+        normalize(vec_data, mt_mean, mt_div);
+    });
+    run_bench("normalize_in_place 2000*784", 5, [&]() {
+        mat_t mt_mean, mt_div;
+        normalize_in_place(vec_data, mt_mean, mt_div);
+    });
+}
+
+// DBN中一层RBM的权值是in_num*out_num，分别测试前向(W.t().dot(v))、反向(W.dot(h))、权值梯度(v.dot(h.t()))以及批量前向
+template<int in_num, int out_num, int batch_size, typename val_t = double>
+void bench_gemm_shape(const int& i_loop)
+{
+    mat<in_num, out_num, val_t> W(.01);
+    mat<in_num, 1, val_t> v(.5);
+    mat<out_num, 1, val_t> h(.5);
+    mat<in_num, batch_size, val_t> V(.5);
+    char sz_name[64];
+    auto report = [](const double& ns, const double& flop) { printf("%40s %12.2lf GFLOP/s\r\n", "", flop / ns); };
+    sprintf(sz_name, "W.t().dot(v) %d*%d", in_num, out_num);
+    report(run_bench(sz_name, i_loop, [&]() { h = W.t().dot(v); }), 2. * in_num * out_num);
+    sprintf(sz_name, "W.dot(h) %d*%d", in_num, out_num);
+    report(run_bench(sz_name, i_loop, [&]() { v = W.dot(h); }), 2. * in_num * out_num);
+    sprintf(sz_name, "v.dot(h.t()) %d*%d", in_num, out_num);
+    report(run_bench(sz_name, i_loop, [&]() { W = v.dot(h.t()); }), 2. * in_num * out_num);
+    sprintf(sz_name, "W.t().dot(V) %d*%d batch %d", in_num, out_num, batch_size);
+    report(run_bench(sz_name, i_loop / batch_size + 1, [&]() { auto H = W.t().dot(V); }), 2. * in_num * out_num * batch_size);
+}
+
+void bench_gemm()
+{
+    bench_gemm_shape<784, 392, 64>(2000);
+    bench_gemm_shape<392, 196, 64>(8000);
+    bench_gemm_shape<196, 98, 64>(20000);
+    bench_gemm_shape<98, 49, 64>(50000);
+    printf("== float\r\n");
+    bench_gemm_shape<784, 392, 64, float>(2000);
+    bench_gemm_shape<392, 196, 64, float>(8000);
+}
+
+// test_dbn各层的形状在1到硬件线程数之间按倍数增加线程，观察乘法的加速比
+void bench_gemm_threads()
+{
+    const int i_max = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    for (int i_thread = 1; ; i_thread = std::min(i_thread * 2, i_max))
+    {
+        gemm_thread_pool::get().set_thread_num(i_thread);
+        printf("== %d thread(s)\r\n", i_thread);
+        bench_gemm_shape<784, 392, 64>(2000);
+        bench_gemm_shape<392, 196, 64>(8000);
+        bench_gemm_shape<196, 98, 64>(20000);
+        if (i_thread == i_max)
+            break;
+    }
+    gemm_thread_pool::get().set_thread_num(MAT_GEMM_THREADS);
+}
+
+// 依次限制到标量、SSE2、AVX2、AVX-512，比较逐元素运算和归约的耗时
+template<typename val_t>
+void bench_simd_type(const char* sz_type)
+{
+    using mat_t = mat<784, 392, val_t>;
+    mat_t mt_a(.5), mt_b(.25), mt_c;
+    softmax<mat<784, 1, val_t> > sm;
+    mat<784, 1, val_t> mt_v(.1);
+    const char* sz_level[] = { "scalar", "sse2", "avx2", "avx512" };
+    for (int i_level = SIMD_SCALAR; i_level <= SIMD_AVX512; ++i_level)
+    {
+        if (simd_kernels<val_t>::get().use_level(i_level) != i_level)
+            continue;
+        printf("== %s %s\r\n", sz_type, sz_level[i_level]);
+        run_bench("a + b 784*392", 200, [&]() { mt_c = mt_a + mt_b; });
+        run_bench("a * 2 + b 784*392", 200, [&]() { mt_c = mt_a * val_t(2.) + mt_b; });
+        run_bench("exp(a) 784*392", 200, [&]() { mt_c = exp(mt_a); });
+        run_bench("sqrtl(a) 784*392", 200, [&]() { mt_c = sqrtl(mt_a); });
+        run_bench("abs(a - b) 784*392", 200, [&]() { mt_c = abs(mt_a - mt_b); });
+        run_bench("sum 784*392", 200, [&]() { mt_a.get(0, 0) = mt_a.sum() * val_t(1e-20); });
+        run_bench("max 784*392", 200, [&]() { mt_a.get(0, 0) = mt_a.max() * val_t(1e-20); });
+        run_bench("argmax 784*392", 200, [&]() { int r = 0, c = 0; mt_a.get(0, 0) = mt_a.argmax(r, c) * val_t(1e-20); });
+        run_bench("softmax 784*1", 20000, [&]() { mt_v = sm.forward(mt_v); });
+    }
+    simd_kernels<val_t>::get().use_level(SIMD_AVX512);
+}
+
+// float一个寄存器装下两倍的元素，同样的运算与double对比
+void bench_simd()
+{
+    bench_simd_type<double>("double");
+    bench_simd_type<float>("float");
+}
+
+// 行列式、求逆、解方程和ln|det|，N <= 8时同时测原来的逆序数法det(更大的N无法在可接受的时间内完成)
+template<int N>
+void bench_linalg_shape(const int& i_loop)
+{
+    std::mt19937 gen(N);
+    std::uniform_real_distribution<double> dist(-1., 1.);
+    mat<N, N, double> mt_a, mt_inv;
+    mat<N, 1, double> mt_b(1.), mt_x;
+    for (int i = 0; i < N; ++i)
+    {
+        for (int j = 0; j < N; ++j)
+        {
+            mt_a.get(i, j) = dist(gen) + (i == j ? N : 0);      // 对角占优，同时也是正定的
+        }
+    }
+    mat<N, N, double> mt_spd = (mt_a + mt_a.t()) * .5;
+    double d_ret = 0.;
+    char sz_name[64];
+    if constexpr (N <= 8)
+    {
+        sprintf(sz_name, "det_permutation %d*%d", N, N);
+        run_bench(sz_name, i_loop / (N * N) + 1, [&]() { d_ret += det_permutation(mt_a); });
+    }
+    sprintf(sz_name, "det %d*%d", N, N);
+    run_bench(sz_name, i_loop, [&]() { d_ret += det(mt_a); });
+    sprintf(sz_name, "log_det (cholesky) %d*%d", N, N);
+    run_bench(sz_name, i_loop, [&]() { d_ret += log_det(mt_spd); });
+    sprintf(sz_name, "inverse %d*%d", N, N);
+    run_bench(sz_name, i_loop, [&]() { mt_inv = inverse(mt_a); });
+    sprintf(sz_name, "solve %d*%d", N, N);
+    run_bench(sz_name, i_loop, [&]() { mt_x = solve(mt_a, mt_b); });
+    d_ret += mt_inv.sum() + mt_x.sum();
+    if (d_ret == 1.)
+        printf("%lf\n", d_ret);
+}
+
+void bench_linalg()
+{
+    bench_linalg_shape<2>(200000);
+    bench_linalg_shape<4>(100000);
+    bench_linalg_shape<8>(20000);
+    bench_linalg_shape<16>(5000);
+    bench_linalg_shape<32>(1000);
+}
+
 #include "restricked_boltzman_machine.hpp"
 
 void test_rbm()
@@ -91,6 +683,38 @@ void test_rbm()
     }
 }
 
+// elem_map逐元素计算(sigmoid、ReLu、bi)，784*1是MNIST的一张图，392*392以前的递归展开编译不完
+template<int row_num, int col_num>
+void bench_elem_map_shape(const int& i_loop)
+{
+    char sz_name[64];
+    using mat_t = mat<row_num, col_num, double>;
+    mat_t mt_in;
+    for (int i = 0; i < row_num * col_num; ++i)
+        mt_in.pval->p[i] = (i % 17) * .25 - 2.;
+    double d_sum = 0.;
+    sigmoid<mat_t> sg;
+    ReLu<mat_t> rl;
+    snprintf(sz_name, sizeof(sz_name), "sigmoid forward %d*%d", row_num, col_num);
+    run_bench(sz_name, i_loop, [&]() { d_sum += sg.forward(mt_in).pval->p[0]; });
+    snprintf(sz_name, sizeof(sz_name), "ReLu forward %d*%d", row_num, col_num);
+    run_bench(sz_name, i_loop, [&]() { d_sum += rl.forward(mt_in).pval->p[0]; });
+    snprintf(sz_name, sizeof(sz_name), "ReLu backward %d*%d", row_num, col_num);
+    run_bench(sz_name, i_loop, [&]() { d_sum += rl.backward().pval->p[0]; });
+    snprintf(sz_name, sizeof(sz_name), "bi %d*%d", row_num, col_num);
+    run_bench(sz_name, i_loop, [&]() { d_sum += bi(mt_in).pval->p[0]; });
+    if (d_sum == 1.)
+        printf("%lf\n", d_sum);
+}
+
+void bench_elem_map()
+{
+    bench_elem_map_shape<4, 4>(1000000);
+    bench_elem_map_shape<784, 1>(20000);
+    bench_elem_map_shape<100, 100>(2000);
+    bench_elem_map_shape<392, 392>(100);
+}
+
 #include <random>
 #include "gmm_t.hpp"
 
@@ -256,6 +880,115 @@ void assign_mat(mat<28, 28, double>& mt, const unsigned char* sz)
 	}
 }
 
+// MNIST图片的处理路径：字节填入mat、归一化、展开成一列，以及在缓存内的逐元素运算和归约，每次处理64张
+void bench_mnist_path()
+{
+    unsigned char sz_image_buf[28 * 28];
+    for (int i = 0; i < 28 * 28; ++i)
+    {
+        sz_image_buf[i] = static_cast<unsigned char>(i * 7);
+    }
+    std::vector<train_data> vec_data(64);
+    std::vector<mat<28 * 28, 1, double> > vec_col(64);
+    mat<28, 28, double> mt_b(.5), mt_c(.25);
+    int i_misaligned = 0;
+    for (auto& td : vec_data)
+    {
+        i_misaligned += (reinterpret_cast<size_t>(td.mt_image.pval->p) % 64) != 0;
+    }
+    printf("images not on a 64 byte boundary: %d/64\r\n", i_misaligned);
+    run_bench("assign_mat + /256 + one_col (*64)", 5000, [&]() {
+        for (int i = 0; i < 64; ++i)
+        {
+            assign_mat(vec_data[i].mt_image, sz_image_buf);
+            vec_data[i].mt_image = vec_data[i].mt_image / 256.;
+            vec_col[i] = vec_data[i].mt_image.one_col();
+        }
+    });
+    run_bench("a * b + c 28*28 (*64)", 5000, [&]() {
+        for (auto& td : vec_data)
+            td.mt_image = td.mt_image * mt_b + mt_c;
+    });
+    run_bench("sum + max 28*28 (*64)", 5000, [&]() {
+        for (auto& td : vec_data)
+            td.mt_image.get(0, 0) = (td.mt_image.sum() + td.mt_image.max()) * 1e-20;
+    });
+}
+
+#include "idx_reader.hpp"
+// 一个epoch的MNIST数据：整个文件读进ht_memory再逐张assign_mat + /256，与idx_batch_reader流式读取成64张一组的batch
+void bench_idx()
+{
+	const int i_image_num = 60000;
+	{
+		std::ofstream ofs_image("./bench_images.idx3-ubyte", std::ofstream::binary);
+		std::ofstream ofs_label("./bench_labels.idx1-ubyte", std::ofstream::binary);
+		auto write_be = [](std::ofstream& ofs, const uint32_t& u) {
+			const char sz[4] = { char(u >> 24), char(u >> 16), char(u >> 8), char(u) };
+			ofs.write(sz, 4);
+		};
+		write_be(ofs_image, 0x00000803); write_be(ofs_image, i_image_num); write_be(ofs_image, 28); write_be(ofs_image, 28);
+		write_be(ofs_label, 0x00000801); write_be(ofs_label, i_image_num);
+		std::vector<char> vec_image(28 * 28);
+		for (int i = 0; i < i_image_num; ++i)
+		{
+			for (int j = 0; j < 28 * 28; ++j)
+				vec_image[j] = char((i * 31 + j * 7) & 0xff);
+			ofs_image.write(vec_image.data(), vec_image.size());
+			ofs_label.put(char(i % 10));
+		}
+	}
+	double d_sum_load = 0., d_sum_stream = 0.;
+	run_bench("read_file + assign_mat + /256", 3, [&]() {
+		unsigned char sz_image_buf[28 * 28];
+		std::vector<train_data> vec_train_data;
+		ht_memory mry_train_images(ht_memory::big_endian);
+		mry_train_images.read_file("./bench_images.idx3-ubyte");
+		int32_t i_magic_num = 0, i_num = 0, i_row_num = 0, i_col_num = 0;
+		mry_train_images >> i_magic_num >> i_num >> i_row_num >> i_col_num;
+		ht_memory mry_train_labels(ht_memory::big_endian);
+		mry_train_labels.read_file("./bench_labels.idx1-ubyte");
+		mry_train_labels >> i_magic_num >> i_num;
+		for (int i = 0; i < i_num; ++i)
+		{
+			train_data td;
+			unsigned char uc_label = 0;
+			mry_train_images.read((char*)sz_image_buf, sizeof(sz_image_buf));
+			assign_mat(td.mt_image, sz_image_buf);
+			td.mt_image = td.mt_image / 256.;
+			mry_train_labels >> uc_label;
+			td.i_num = uc_label;
+			td.mt_label.get((int)uc_label, 0) = 1;
+			vec_train_data.push_back(td);
+		}
+		d_sum_load = 0.;
+		for (auto& td : vec_train_data)
+			d_sum_load += td.mt_image.sum() + td.i_num;
+	});
+	printf("%40s resident %.1lf MB\r\n", "", (i_image_num * (28 * 28 + 1.) + i_image_num * sizeof(train_data)
+		+ i_image_num * (28 * 28 + 10) * sizeof(double)) / (1024. * 1024.));
+	idx_batch_reader<28 * 28, 10, 64, double> reader;
+	if (reader.open("./bench_images.idx3-ubyte", "./bench_labels.idx1-ubyte") != 0)
+	{
+		printf("open idx failed\r\n");
+		return;
+	}
+	run_bench("idx_batch_reader<784,10,64> epoch", 3, [&]() {
+		d_sum_stream = 0.;
+		for (auto& batch : reader)
+		{
+			d_sum_stream += batch.mt_image.sum();
+			for (int i = 0; i < batch.i_count; ++i)
+				d_sum_stream += batch.sz_label[i];
+		}
+	});
+	printf("%40s resident %.1lf MB (raw buffers %zu bytes)\r\n", "", (reader.buffer_bytes()
+		+ 2. * sizeof(double) * (28 * 28 + 10) * 64) / (1024. * 1024.), reader.buffer_bytes());
+	printf("%40s checksum %s\r\n", "", std::abs(d_sum_load - d_sum_stream) < 1e-6 * d_sum_load ? "same" : "DIFFERENT");
+	remove("./bench_images.idx3-ubyte");
+	remove("./bench_labels.idx1-ubyte");
+}
+
 template<int ipre>
 using bp_type = bp<double, 1, nadam, ReLu, HeGaussian, ipre, 20, 10>;
 
@@ -361,8 +1094,115 @@ void test_dbn()
 	}
 }
 
+// test_dbn同样的网络结构，元素类型分别取double和float，比较pretrain和finetune的耗时(输入是合成的图片，不需要MNIST文件)
+template<typename val_t>
+struct dbn_bench_pred
+{
+	template<int ipre>
+	using bp_t = bp<val_t, 1, nadam, ReLu, HeGaussian, ipre, 20, 10>;
+	template<int ipre>
+	using softmax_t = bp<val_t, 1, nadam, softmax, HeGaussian, bp_t<ipre>::ret_type::r, 10>;
+	template<int ipre>
+	using type = join_net<bp_t<ipre>, softmax_t>;
+};
+
+template<typename val_t>
+void bench_dbn_type(const char* sz_type)
+{
+	using dbn_type = dbn_t<dbn_bench_pred<val_t>::template type, val_t, 28 * 28, 28 * 14, 14 * 14, 14 * 7, 7 * 7>;
+	using mat_type = mat<28 * 28, 1, val_t>;
+	using ret_type = typename dbn_type::ret_type;
+	auto p_dbn = std::make_unique<dbn_type>();
+	std::vector<mat_type> vec_input(50);
+	std::vector<ret_type> vec_expect(50);
+	for (int i = 0; i < 50; ++i)
+	{
+		for (int j = 0; j < 28 * 28; ++j)
+		{
+			vec_input[i].get(j, 0) = static_cast<val_t>(((i * 31 + j * 7) % 256) / 256.);
+		}
+		vec_expect[i].get(i % 10, 0) = 1;
+	}
+	char sz_name[64];
+	sprintf(sz_name, "%s pretrain 50 images * 2 epochs", sz_type);
+	run_bench(sz_name, 3, [&]() { p_dbn->pretrain(vec_input, 2, false); });
+	sprintf(sz_name, "%s finetune 50 images * 20 epochs", sz_type);
+	run_bench(sz_name, 3, [&]() {
+		p_dbn->pretrain(vec_input, 0, false);
+		p_dbn->finetune(vec_expect, 20);
+	});
+}
+
+void bench_dbn_float()
+{
+	bench_dbn_type<double>("double");
+	bench_dbn_type<float>("float");
+}
+
+// mat_m的空闲链表：堆上矩阵反复创建释放，以及DBN预训练，打印命中/未命中次数；默认直接make_shared，-DMAT_POOL=1编译可得到使用空闲链表的结果
+void bench_pool()
+{
+	printf("MAT_POOL=%d\r\n", MAT_POOL);
+	auto report = []() {
+		mat_pool::stat_t st = mat_pool::stat();
+		printf("    pool hit %zu, miss %zu, retained %zu bytes\r\n", st.u_hit, st.u_miss, st.u_bytes_retained);
+	};
+	mat<392, 784, double> W(.01);
+	double d_sum = 0.;
+	run_bench("mat<392,784> tmp = W * 2", 2000, [&]() {
+		mat<392, 784, double> mt_tmp = W * 2.;
+		d_sum += mt_tmp.pval->p[0];
+	});
+	mat<64, 32, double> Q(.1), K(.2);
+	run_bench("mat<32,32> = Q.t().dot(K) temporaries", 100000, [&]() {
+		mat<32, 32, double> mt_score = Q.t().dot(K);
+		d_sum += mt_score.pval->p[0];
+	});
+	report();
+	bench_dbn_type<double>("double");
+	report();
+	if (d_sum == 1.)
+		printf("%lf\n", d_sum);
+}
+
 #include "mha_t.hpp"
 
+// bp反向传播(mt_in.t()、mt_weight.t().dot)与注意力分数Q.t().dot(K)，转置在类型中确定前后对比
+void bench_transpose()
+{
+    using net_t = bp<double, 1, gd, sigmoid, XavierGaussian, 784, 392>;
+    auto p_net = std::make_unique<net_t>();
+    mat<784, 1, double> mt_input(.5);
+    mat<392, 1, double> mt_delta(.01);
+    p_net->forward(mt_input);
+    run_bench("bp<784,392> backward", 500, [&]() { p_net->backward(mt_delta); });
+    using small_net_t = bp<double, 8, gd, sigmoid, XavierGaussian, 64, 64>;
+    small_net_t small_net;
+    mat<64, 8, double> mt_small_input(.5), mt_small_delta(.01);
+    small_net.forward(mt_small_input);
+    run_bench("bp<64,64> batch 8 backward", 20000, [&]() { small_net.backward(mt_small_delta); });
+    mat<64, 32, double> Q(.1), K(.2);
+    mat<32, 32, double> mt_score;
+    run_bench("Q.t().dot(K) 64*32", 20000, [&]() { mt_score = Q.t().dot(K); });
+    mha::header_gen<64, 32, double> header;
+    mat<64, 32, double> mt_x(.3), mt_dx(.01);
+    run_bench("header_gen<64,32> forward", 2000, [&]() { header.forward(mt_x); });
+    run_bench("header_gen<64,32> forward/backward", 1000, [&]() {
+        header.forward(mt_x);
+        header.backward(mt_dx);
+    });
+    mat<784, 392, double> W(.01);
+    double d_sum = 0.;
+    run_bench("W.t().get(i, j) 392*784", 200, [&]() {
+        auto Wt = W.t();
+        for (int i = 0; i < 392; ++i)
+            for (int j = 0; j < 784; ++j)
+                d_sum += Wt.get(i, j);
+    });
+    if (d_sum == 1.)
+        printf("%lf\n", d_sum);
+}
+
 void test_mha()
 {
 	using namespace mha;
@@ -389,6 +1229,84 @@ void test_mha()
 	std::cout << "MHA test completed with read_file." << std::endl;
 }
 
+// 多头注意力的前向/反向，头部输出作为嵌套mat的元素连续存放，WReLu的乘法是一次batched GEMM
+void bench_mha()
+{
+	using namespace mha;
+	using net_type = mha_t<16, 16, 8, double>;
+	net_type mha_net;
+	net_type::input_type mt_input(.5);
+	net_type::input_type mt_expect(.1);
+	run_bench("mha_t<16,16,8> forward", 2000, [&]() {
+		mha_net.forward(mt_input);
+	});
+	run_bench("mha_t<16,16,8> forward/backward", 2000, [&]() {
+		auto mt_out = mha_net.forward(mt_input);
+		mha_net.backward(mt_out - mt_expect);
+	});
+}
+
+// 每个训练步的堆分配次数：同一个step分别直接执行和放在mat_arena_scope里执行
+template<typename step_t>
+void bench_arena_step(const char* name, const int& i_loop, step_t&& step)
+{
+	char sz_name[64];
+	snprintf(sz_name, sizeof(sz_name), "%s", name);
+	run_bench(sz_name, i_loop, step);
+	mat_arena::stat_t st = mat_arena::local().stat();
+	snprintf(sz_name, sizeof(sz_name), "%s arena", name);
+	run_bench(sz_name, i_loop, [&]() {
+		mat_arena_scope scope;
+		step();
+	});
+	const mat_arena::stat_t& st_end = mat_arena::local().stat();
+	printf("    arena blocks/step %.2lf, chunks %zu, escaped %zu\r\n", double(st_end.u_alloc_num - st.u_alloc_num) / (i_loop + 1)
+		, st_end.u_chunk_num - st.u_chunk_num, st_end.u_escaped - st.u_escaped);
+}
+
+void bench_arena()
+{
+	using namespace mha;
+	/* test_bp与test_mha的训练步 */
+	using bp_t = bp<double, 1, nadam, softmax, HeMean, 3, 10>;
+	bp_t bp_net;
+	typename bp_t::input_type mt_bp_input = { .1, .2, .3 };
+	typename bp_t::ret_type mt_bp_expected = { 0, 1., 0, 0, 0, 0, 0, 0, 0, 0 };
+	bench_arena_step("test_bp step", 100000, [&]() {
+		auto mt_out = bp_net.forward(mt_bp_input);
+		bp_net.backward(mt_out - mt_bp_expected);
+		bp_net.update_inert();
+	});
+	using mha_small_t = mha_t<3, 2, 4, double>;
+	mha_small_t mha_small;
+	mha_small_t::input_type mt_small_input = { 1, 2, 3, 4, 5, 6 };
+	mha_small_t::input_type mt_small_expect = { .6, .5, .4, .3, .2, .1 };
+	bench_arena_step("test_mha step", 100000, [&]() {
+		auto mt_out = mha_small.forward(mt_small_input);
+		mha_small.backward(mt_out - mt_small_expect);
+		mha_small.update_inert();
+	});
+	/* 矩阵超过MAT_INLINE_MAX_BYTES、放在堆上的规模 */
+	using big_bp_t = bp<double, 1, gd, sigmoid, XavierGaussian, 784, 392, 10>;
+	auto p_big_bp = std::make_unique<big_bp_t>();
+	mat<784, 1, double> mt_input(.5);
+	mat<10, 1, double> mt_expected(0.);
+	bench_arena_step("bp<784,392,10> step", 500, [&]() {
+		auto mt_out = p_big_bp->forward(mt_input);
+		p_big_bp->backward(mt_out - mt_expected);
+		p_big_bp->update_inert();
+	});
+	using mha_big_t = mha_t<16, 16, 8, double>;
+	mha_big_t mha_big;
+	mha_big_t::input_type mt_big_input(.5);
+	mha_big_t::input_type mt_big_expect(.1);
+	bench_arena_step("mha_t<16,16,8> step", 2000, [&]() {
+		auto mt_out = mha_big.forward(mt_big_input);
+		mha_big.backward(mt_out - mt_big_expect);
+		mha_big.update_inert();
+	});
+}
+
 int main(int argc, char** argv)
 {
     //test_base_ops();
@@ -397,5 +1315,31 @@ int main(int argc, char** argv)
     //test_decision_tree();
 	test_dbn();
 	//test_mha();
+    //bench_mat_storage();
+    //bench_expr();
+    //bench_inplace();
+    //bench_softmax();
+    //bench_conv();
+    //bench_normalize();
+    //bench_concat();
+    //bench_elem_map();
+    //bench_gemm();
+    //bench_gemm_threads();
+    //bench_simd();
+    //bench_mnist_path();
+    //bench_linalg();
+    //bench_dmat();
+    //bench_view();
+    //bench_transpose();
+    //bench_dbn_float();
+    //bench_mha();
+    //bench_arena();
+    //bench_pool();
+    //bench_mmap();
+    //bench_serialize();
+    //bench_ht_memory_growth();
+    //bench_idx();
+    //bench_tensor_file();
+    //test_tensor_file();
     return 0;
 }
\ No newline at end of file
@@ -1,7 +1,9 @@
 #ifndef _MAT_HPP_
 #define _MAT_HPP_
 #include <memory>
+#include <type_traits>
 #include <climits>
+#include <cmath>
 #include <float.h>
 
 
@@ -13,6 +15,9 @@
 #include <algorithm>
 
 #include "ht_memory.h"
+#include "mat_alloc.hpp"
+#include "gemm.hpp"
+#include "simd_kernel.hpp"
 
 
 template<typename val_t>
@@ -21,6 +26,16 @@ val_t max_and_swap(const val_t& v1, const val_t& v2)
 	return v1 < v2 ? v2 : v1;
 }
 
+/* 求最大值时的初值：算术类型取该类型的最小值(-DBL_MAX转成float会溢出)，嵌套的mat仍用-DBL_MAX填满 */
+template<typename val_t>
+val_t lowest_val()
+{
+	if constexpr (std::is_arithmetic<val_t>::value)
+		return std::numeric_limits<val_t>::lowest();
+	else
+		return val_t(-1 * DBL_MAX);
+}
+
 template<typename type>
 struct destoryer 
 {
@@ -30,19 +45,41 @@ struct destoryer
 	}
 };
 
+/*
+ * 数据不小于一个缓存行的mat_m按MAT_ALIGN(默认64字节)对齐，inline_storage放在对象内部、heap_storage通过make_mat_m
+ * 分配时都按这个对齐，SIMD内核按向量宽度步进时不会跨缓存行；更小的矩阵保持自然对齐，避免大量小矩阵浪费内存
+ */
+#ifndef MAT_ALIGN
+#define MAT_ALIGN 64
+#endif
+
+template<int i_size, typename val_t>
+struct mat_m_align
+{
+	static constexpr size_t value = (sizeof(val_t) * i_size >= MAT_ALIGN && alignof(val_t) <= MAT_ALIGN) ? MAT_ALIGN : alignof(val_t);
+};
+
+/*
+ * mat_m只有指向元素的p以及对元素的运算，元素所在的内存由mat_m_buf提供(inline_storage放在对象内部，heap_storage在堆上)，
+ * 也可以在别处(mat_m_ref，例如映射的模型文件)；mat_m之间赋值复制元素，不能拷贝构造
+ */
 template<int i_size, typename val_t>
 struct mat_m
 {
-	val_t sz_ele[i_size];
+	static constexpr size_t alignment = mat_m_align<i_size, val_t>::value;
 	val_t* p;
 
-	mat_m() :p(nullptr)
+	explicit mat_m(val_t* p_ele) :p(p_ele)
+	{
+	}
+	mat_m(const mat_m& other) = delete;
+	mat_m& operator=(const mat_m& other)
 	{
-		p = sz_ele;
 		for (int i = 0; i < i_size; ++i)
 		{
-			new(p + i) val_t(0);
+			p[i] = other.p[i];
 		}
+		return *this;
 	}
 	~mat_m()
 	{
@@ -56,10 +93,17 @@ struct mat_m
 		val_t& ret = p[i_2d_idx + len_1d * i_1d_idx];
 		return ret;
 	}
+	const val_t& get(const int& len_1d, const int& i_1d_idx, const int& i_2d_idx) const
+	{
+		return p[i_2d_idx + len_1d * i_1d_idx];
+	}
 
 	val_t max_abs() const
 	{
-		double d = -1*DBL_MAX;
+		if constexpr (std::is_floating_point<val_t>::value && i_size >= MAT_SIMD_MIN_SIZE)
+			return simd_kernels<val_t>::get().max_abs(p, i_size);
+		using std::abs;
+		val_t d = lowest_val<val_t>();
 		for (int i = 0; i < i_size; ++i) 
 		{
 			d = d < abs(p[i]) ? abs(p[i]) : d;
@@ -69,7 +113,9 @@ struct mat_m
 
 	val_t max() const
 	{
-		val_t d = -1 * DBL_MAX;
+		if constexpr (std::is_floating_point<val_t>::value && i_size >= MAT_SIMD_MIN_SIZE)
+			return simd_kernels<val_t>::get().max(p, i_size);
+		val_t d = lowest_val<val_t>();
 		for (int i = 0; i < i_size; ++i)
 		{
 			//d = d < (p[i]) ? (p[i]) : d;
@@ -80,6 +126,8 @@ struct mat_m
 
 	val_t sum() const 
 	{
+		if constexpr (std::is_floating_point<val_t>::value && i_size >= MAT_SIMD_MIN_SIZE)
+			return simd_kernels<val_t>::get().sum(p, i_size);
 		val_t d_sum = 0.;
 		for (int i = 0; i < i_size; ++i)
 		{
@@ -88,6 +136,20 @@ struct mat_m
 		return d_sum;
 	}
 
+	/* 第一个最大值在内存中的下标 */
+	int argmax() const
+	{
+		if constexpr (std::is_floating_point<val_t>::value && i_size >= MAT_SIMD_MIN_SIZE)
+			return simd_kernels<val_t>::get().argmax(p, i_size);
+		int i_idx = 0;
+		for (int i = 1; i < i_size; ++i)
+		{
+			if (p[i_idx] < p[i])
+				i_idx = i;
+		}
+		return i_idx;
+	}
+
 	template<int len_1d, int i_1d_idx, int i_2d_idx>
 	inline val_t& get_val()
 	{
@@ -102,58 +164,442 @@ struct mat_m
 	}
 };
 
+/* 带元素的mat_m：元素在前、mat_m在后，heap_storage分配的正是这个对象，对外只交出其中的mat_m */
+template<int i_size, typename val_t>
+struct mat_m_buf
+{
+	using mat_m_t = mat_m<i_size, val_t>;
+	alignas(mat_m_t::alignment) val_t sz_ele[i_size];
+	mat_m_t m;
+
+	mat_m_buf() :m(&sz_ele[0])
+	{
+		for (int i = 0; i < i_size; ++i)
+		{
+			sz_ele[i] = val_t(0);
+		}
+	}
+	explicit mat_m_buf(const mat_m_t& other) :m(&sz_ele[0])
+	{
+		for (int i = 0; i < i_size; ++i)
+		{
+			sz_ele[i] = other.p[i];
+		}
+	}
+	mat_m_buf(const mat_m_buf& other) :mat_m_buf(other.m)
+	{
+	}
+	mat_m_buf& operator=(const mat_m_buf& other)
+	{
+		m = other.m;
+		return *this;
+	}
+
+	/* 分配一块mat_m_buf(走make_mat_m的arena/空闲链表)，返回的指针与它共用引用计数 */
+	template<typename... args_t>
+	static std::shared_ptr<mat_m_t> make(args_t&&... args)
+	{
+		std::shared_ptr<mat_m_buf> sp = make_mat_m<mat_m_buf>(std::forward<args_t>(args)...);
+		return std::shared_ptr<mat_m_t>(sp, &sp->m);
+	}
+};
+
+/* 元素在别处的mat_m，例如映射的模型文件：只保存指针，sp_owner保证那段内存在mat_m析构前有效 */
+template<int i_size, typename val_t>
+struct mat_m_ref
+{
+	using mat_m_t = mat_m<i_size, val_t>;
+	std::shared_ptr<void> sp_owner;
+	mat_m_t m;
+
+	mat_m_ref(val_t* p_ele, std::shared_ptr<void> sp) :sp_owner(std::move(sp)), m(p_ele)
+	{
+	}
+
+	static std::shared_ptr<mat_m_t> make(val_t* p_ele, std::shared_ptr<void> sp_owner)
+	{
+		mat_count_alloc();
+		std::shared_ptr<mat_m_ref> sp = std::make_shared<mat_m_ref>(p_ele, std::move(sp_owner));
+		return std::shared_ptr<mat_m_t>(sp, &sp->m);
+	}
+};
+
+/*
+ * mat的存储策略，所有策略都通过operator->暴露mat_m，因此mat内部以及外部的pval->p写法保持不变
+ * inline_storage: 数据直接放在mat对象内部，构造、拷贝都不经过堆分配，适合3*1、10*1这类小矩阵
+ * heap_storage:   堆内存，拷贝、赋值都是深拷贝，移动只转移指针
+ * cow_storage:    共享的堆内存，拷贝只增加引用计数，通过非const接口访问时若仍被共享则复制一份(写时复制)
+ *                 每次非const访问都要检查引用计数，因此只在需要大量廉价拷贝的场合显式使用
+ * view()返回与自身共享内存的存储(inline_storage无法共享，只能复制)，只供t()、one_col()这类视图接口使用
+ * can_share为true的策略通过owner()交出底层的mat_m，dmat以此与mat共享内存
+ */
+#ifndef MAT_INLINE_MAX_BYTES
+#define MAT_INLINE_MAX_BYTES 1024
+#endif
+
+template<int i_size, typename val_t>
+struct inline_storage
+{
+	using mat_m_t = mat_m<i_size, val_t>;
+	mat_m_buf<i_size, val_t> buf;
+
+	static constexpr bool can_share = false;
+
+	inline_storage view() const { return *this; }
+	bool unique() const { return true; }
+
+	mat_m_t* operator->() { return &buf.m; }
+	const mat_m_t* operator->() const { return &buf.m; }
+	mat_m_t& operator*() { return buf.m; }
+	const mat_m_t& operator*() const { return buf.m; }
+};
+
+template<int i_size, typename val_t>
+struct heap_storage
+{
+	using mat_m_t = mat_m<i_size, val_t>;
+	std::shared_ptr<mat_m_t> pm;
+
+	heap_storage() :pm(mat_m_buf<i_size, val_t>::make())
+	{
+	}
+	heap_storage(const heap_storage& other) :pm(mat_m_buf<i_size, val_t>::make(*other.pm))
+	{
+	}
+	heap_storage(heap_storage&& other) = default;
+	/* 接管已有的mat_m，dmat借此把自己的内存交还给mat而不复制 */
+	explicit heap_storage(std::shared_ptr<mat_m_t> p) :pm(std::move(p))
+	{
+	}
+	heap_storage& operator=(const heap_storage& other)
+	{
+		if (pm == other.pm) return *this;
+		if (!pm || pm.use_count() > 1)
+			pm = mat_m_buf<i_size, val_t>::make(*other.pm);
+		else
+			*pm = *other.pm;
+		return *this;
+	}
+	/* arena生效时，已有独占内存的矩阵(通常是网络的成员)接收右值时复制数据，不接管arena上的内存 */
+	heap_storage& operator=(heap_storage&& other)
+	{
+		if (mat_arena::current() && pm && other.pm && pm.use_count() == 1)
+			*pm = *other.pm;
+		else
+			pm = std::move(other.pm);
+		return *this;
+	}
+
+	static constexpr bool can_share = true;
+	bool unique() const { return pm.use_count() == 1; }
+	std::shared_ptr<mat_m_t> owner() const { return pm; }
+
+	heap_storage view() const 
+	{
+		heap_storage ret(share_tag{});
+		ret.pm = pm;
+		return ret;
+	}
+
+	mat_m_t* operator->() { return pm.get(); }
+	const mat_m_t* operator->() const { return pm.get(); }
+	mat_m_t& operator*() { return *pm; }
+	const mat_m_t& operator*() const { return *pm; }
+private:
+	struct share_tag {};
+	explicit heap_storage(share_tag)
+	{
+	}
+};
+
+template<int i_size, typename val_t>
+struct cow_storage
+{
+	using mat_m_t = mat_m<i_size, val_t>;
+	std::shared_ptr<mat_m_t> pm;
+
+	cow_storage() :pm(mat_m_buf<i_size, val_t>::make())
+	{
+	}
+	explicit cow_storage(std::shared_ptr<mat_m_t> p) :pm(std::move(p))
+	{
+	}
+
+	static constexpr bool can_share = true;
+	cow_storage view() const { return *this; }
+	bool unique() const { return pm.use_count() == 1; }
+	std::shared_ptr<mat_m_t> owner() const { return pm; }
+
+	mat_m_t* operator->() { detach(); return pm.get(); }
+	const mat_m_t* operator->() const { return pm.get(); }
+	mat_m_t& operator*() { detach(); return *pm; }
+	const mat_m_t& operator*() const { return *pm; }
+
+	bool shared() const 
+	{
+		return pm.use_count() > 1;
+	}
+
+	void detach()
+	{
+		if (pm.use_count() > 1)
+		{
+			pm = mat_m_buf<i_size, val_t>::make(*pm);
+		}
+	}
+};
+
+/* 默认策略：小矩阵放在对象内部，大矩阵使用独占的堆内存 */
+template<int i_size, typename val_t>
+struct auto_storage : public std::conditional_t<(sizeof(val_t) * i_size <= MAT_INLINE_MAX_BYTES), inline_storage<i_size, val_t>, heap_storage<i_size, val_t> >
+{
+	using base_t = std::conditional_t<(sizeof(val_t) * i_size <= MAT_INLINE_MAX_BYTES), inline_storage<i_size, val_t>, heap_storage<i_size, val_t> >;
+	static constexpr bool is_inline = (sizeof(val_t) * i_size <= MAT_INLINE_MAX_BYTES);
+
+	auto_storage() = default;
+	auto_storage(base_t&& other) :base_t(std::move(other))
+	{
+	}
+	explicit auto_storage(std::shared_ptr<typename base_t::mat_m_t> p) :base_t(std::move(p))
+	{
+	}
+
+	auto_storage view() const { return auto_storage(base_t::view()); }
+};
+
+#ifndef MAT_DEFAULT_STORAGE
+#define MAT_DEFAULT_STORAGE auto_storage
+#endif
+
+/* 表达式模板的标记，base_function.hpp中的表达式节点都继承它 */
+struct mat_expr_tag
+{
+	/* 表达式中能被求值结果直接接管内存的右值矩阵，没有时返回nullptr，见mat(expr_t&&) */
+	template<typename target_t>
+	target_t* reuse_target()
+	{
+		return nullptr;
+	}
+};
+
+template<typename type>
+struct is_mat_expr
+{
+	static constexpr bool value = std::is_base_of<mat_expr_tag, std::decay_t<type> >::value;
+};
+
+template<int row_num, int col_num, typename val_t>
+struct mat_view;
+
+template<typename type>
+struct is_mat_view
+{
+	static constexpr bool value = false;
+};
+
+template<int row_num, int col_num, typename val_t>
+struct is_mat_view<mat_view<row_num, col_num, val_t> >
+{
+	static constexpr bool value = true;
+};
+
+template<int row_num, int col_num, typename val_t, template<int, typename> class storage_tpl>
+struct transposed_mat;
+
+template<typename type>
+struct is_transposed_mat
+{
+	static constexpr bool value = false;
+};
+
+template<int row_num, int col_num, typename val_t, template<int, typename> class storage_tpl>
+struct is_transposed_mat<transposed_mat<row_num, col_num, val_t, storage_tpl> >
+{
+	static constexpr bool value = true;
+};
+
+template<int row_num, int col_num, typename val_t, template<int, typename> class storage_tpl>
+struct mat;
+
+/* mat本身(不含transposed_mat、mat_view和表达式)，数据总是按行主序连续存放，可以整块复制 */
+template<typename type>
+struct is_mat
+{
+	static constexpr bool value = false;
+};
+
+template<int row_num, int col_num, typename val_t, template<int, typename> class storage_tpl>
+struct is_mat<mat<row_num, col_num, val_t, storage_tpl> >
+{
+	static constexpr bool value = true;
+};
+
+/* 元素是算术类型矩阵的mat元素(例如mha_t中mat<header_num, 1, mat<token_len, data_num>>的元素)，mat_dot对它按batched GEMM计算 */
+template<typename type>
+struct is_arith_mat
+{
+	static constexpr bool value = false;
+};
+
+template<int row_num, int col_num, typename val_t, template<int, typename> class storage_tpl>
+struct is_arith_mat<mat<row_num, col_num, val_t, storage_tpl> >
+{
+	static constexpr bool value = std::is_arithmetic<val_t>::value;
+};
 
+/*
+ * 用作嵌套mat元素的矩阵：数据总在元素对象内部，外层mat的存储就是一整块[行][列][元素]连续排列的张量，
+ * 元素再大也不会各自分配堆内存，各元素的数据按sizeof(元素)等距排列
+ */
 template<int row_num, int col_num, typename val_t = double>
+using tensor_elem_t = mat<row_num, col_num, val_t, inline_storage>;
+
+template<bool a_t, bool b_t, int M, int N, int K, typename val_t, typename lhs_t, typename rhs_t>
+mat<M, N, val_t, MAT_DEFAULT_STORAGE> mat_dot(const lhs_t& lhs, const rhs_t& rhs);
+
+template<int row_num, int col_num, typename val_t = double, template<int, typename> class storage_tpl = MAT_DEFAULT_STORAGE>
 struct mat
 {
-	using t_type = mat<col_num, row_num, val_t>;
+	using t_type = transposed_mat<col_num, row_num, val_t, storage_tpl>;
 	using type = val_t;
 	typedef val_t vt;
 	static constexpr int r = row_num;
 	static constexpr int c = col_num;
 	using mat_m_t = mat_m<row_num * col_num, val_t>;
-	std::shared_ptr<mat_m_t> pval;
-	bool b_t;
+	using storage_t = storage_tpl<row_num * col_num, val_t>;
+	storage_t pval;
 
-	mat():b_t(false)
+	mat()
 	{
-		pval = std::make_shared<mat_m_t>();
 	}
-	mat(const mat<row_num, col_num, val_t>& other) :pval(other.pval), b_t(other.b_t)
+	mat(const mat& other) :pval(other.pval)
 	{
 	}
-	~mat() 
+	mat(mat&& other) = default;
+	mat& operator=(const mat& other) = default;
+	mat& operator=(mat&& other) = default;
+
+	/* 直接接管已有的存储，one_col()、transposed_mat::t()借此与原矩阵共享内存 */
+	explicit mat(storage_t&& s) :pval(std::move(s))
 	{
-		pval.reset();
 	}
 
-	mat(const val_t&& v):b_t(false)
+	/* 不同存储策略之间的转换，总是复制数据 */
+	template<template<int, typename> class other_storage_tpl>
+	explicit mat(const mat<row_num, col_num, val_t, other_storage_tpl>& other)
 	{
-		pval = std::make_shared<mat_m_t>();
 		for (int i = 0; i < row_num; ++i)
 		{
 			for (int j = 0; j < col_num; ++j)
 			{
-				pval->get(col_num, i, j) = v;
+				get(i, j) = other.get(i, j);
 			}
 		}
 	}
-	mat(const val_t& v) :b_t(false)
+
+	/* 由表达式构造，整个表达式在一个循环里算完 */
+	template<typename expr_t, typename = std::enable_if_t<is_mat_expr<expr_t>::value && expr_t::r == row_num && expr_t::c == col_num> >
+	mat(const expr_t& e)
+	{
+		eval_from(e);
+	}
+
+	/*
+	 * 由右值表达式构造：表达式按值保存了独占堆内存的同类型右值矩阵(例如a.dot(b) + c中dot的结果)时，
+	 * 结果直接写回这块内存再接管过来，不再分配新内存；逐元素写回的是同一个下标，不会覆盖还没读到的值
+	 */
+	template<typename expr_t, typename = std::enable_if_t<is_mat_expr<expr_t>::value && !std::is_lvalue_reference<expr_t>::value
+		&& std::decay_t<expr_t>::r == row_num && std::decay_t<expr_t>::c == col_num> >
+	mat(expr_t&& e) :mat(e.template reuse_target<mat>(), e)
+	{
+	}
+
+	/*
+	 * 赋值时直接写入自身的内存，以下情况先算到新矩阵里再换过来：
+	 * 内存与t()、one_col()得到的矩阵共享；表达式以转置或视图的方式读取了自身(逐元素写入会覆盖还没读到的值)
+	 */
+	template<typename expr_t, typename = std::enable_if_t<is_mat_expr<expr_t>::value && expr_t::r == row_num && expr_t::c == col_num> >
+	mat& operator=(const expr_t& e)
+	{
+		if (!pval.unique() || e.conflict(pval->p))
+		{
+			*this = mat(e);
+			return *this;
+		}
+		eval_from(e);
+		return *this;
+	}
+
+	template<typename expr_t>
+	mat(mat* p_reuse, const expr_t& e) :pval(p_reuse ? reuse_storage(p_reuse, e) : storage_t())
+	{
+		if (!p_reuse)
+			eval_from(e);
+	}
+
+	template<typename expr_t>
+	static storage_t reuse_storage(mat* p_reuse, const expr_t& e)
+	{
+		p_reuse->eval_from(e);
+		return std::move(p_reuse->pval);
+	}
+
+	template<typename expr_t>
+	void eval_from(const expr_t& e)
 	{
-		pval = std::make_shared<mat_m_t>();
+		val_t* p = pval->p;
+		if constexpr (std::is_floating_point<val_t>::value && row_num * col_num >= MAT_SIMD_MIN_SIZE)
+		{
+			/* 分块求值，每个节点对一块数据调用一次SIMD内核，块内的中间结果放在栈上 */
+			if (e.linear())
+			{
+				for (int i0 = 0; i0 < row_num * col_num; i0 += MAT_EXPR_BLOCK)
+				{
+					const int n = std::min(MAT_EXPR_BLOCK, row_num * col_num - i0);
+					const val_t* p_ret = e.block(i0, n, p + i0);
+					if (p_ret != p + i0)
+						std::copy(p_ret, p_ret + n, p + i0);
+				}
+				return;
+			}
+		}
+		if (e.linear())
+		{
+			for (int i = 0; i < row_num * col_num; ++i)
+			{
+				p[i] = e.at(i);
+			}
+			return;
+		}
 		for (int i = 0; i < row_num; ++i)
 		{
 			for (int j = 0; j < col_num; ++j)
 			{
-				pval->get(col_num, i, j) = v;
+				p[i * col_num + j] = e.get(i, j);
 			}
 		}
 	}
+
+	mat(const val_t&& v)
+	{
+		val_t* p = pval->p;
+		for (int i = 0; i < row_num * col_num; ++i)
+		{
+			p[i] = v;
+		}
+	}
+	mat(const val_t& v)
+	{
+		val_t* p = pval->p;
+		for (int i = 0; i < row_num * col_num; ++i)
+		{
+			p[i] = v;
+		}
+	}
 #if 0
 	template<typename val_other_t>
-	mat(const val_other_t& v) :b_t(false)
+	mat(const val_other_t& v)
 	{
-		pval = std::make_shared<mat_m_t>();
 		for (int i = 0; i < row_num; ++i)
 		{
 			for (int j = 0; j < col_num; ++j)
@@ -163,9 +609,8 @@ struct mat
 		}
 	}
 #endif
-	mat(const std::initializer_list<val_t>& lst):b_t(false)
+	mat(const std::initializer_list<val_t>& lst)
 	{
-		pval = std::make_shared<mat_m_t>();
 		auto itr = lst.begin();
 		for (int i = 0; i < row_num; ++i)
 		{
@@ -178,47 +623,34 @@ struct mat
 		}
 	}
 
+	/* mat总是行主序，转置由transposed_mat在类型上体现，访问元素不需要判断 */
 	val_t& get(const int& i_row, const int& i_col)
 	{
-		if (!b_t)
-			return pval->get(col_num, i_row, i_col);
-		else
-			return pval->get(row_num, i_col, i_row);
+		return pval->get(col_num, i_row, i_col);
 	}
 
 	val_t get(const int& i_row, const int& i_col) const
 	{
-		if (!b_t)
-			return pval->get(col_num, i_row, i_col);
-		else
-			return pval->get(row_num, i_col, i_row);
+		return pval->get(col_num, i_row, i_col);
 	}
 
 	template<int i_1d_idx, int i_2d_idx>
 	inline val_t& get_val()
 	{
-		if (!b_t)
-			return pval->template get_val<col_num, i_1d_idx, i_2d_idx>();
-		else
-			return pval->template get_val<row_num, i_2d_idx, i_1d_idx>();
+		return pval->template get_val<col_num, i_1d_idx, i_2d_idx>();
 	}
 
 	template<int i_1d_idx, int i_2d_idx>
 	inline val_t get_val() const
 	{
 		static_assert(i_1d_idx < row_num && i_2d_idx < col_num, "ERROR: mat::get_val overflow!!!!!");
-		if (!b_t)
-			return pval->template get_val<col_num, i_1d_idx, i_2d_idx>();
-		else
-			return pval->template get_val<row_num, i_2d_idx, i_1d_idx>();
+		return pval->template get_val<col_num, i_1d_idx, i_2d_idx>();
 	}
 
-	mat<col_num, row_num, val_t> t() const
+	/* 转置不复制数据，返回与自身共享存储的transposed_mat */
+	t_type t() const
 	{
-		mat<col_num, row_num, val_t> ret;
-		ret.pval = pval;
-		ret.b_t = !b_t;
-		return ret;
+		return t_type(pval.view());
 	}
 
 	val_t max_abs() const
@@ -236,6 +668,15 @@ struct mat
 		return pval->sum();
 	}
 
+	/* 最大值所在的行列，返回最大值 */
+	val_t argmax(int& i_row, int& i_col) const
+	{
+		const int i_idx = pval->argmax();
+		i_row = i_idx / col_num;
+		i_col = i_idx % col_num;
+		return pval->p[i_idx];
+	}
+
 	void print() const
 	{
 		std::cout << "[" << std::endl;
@@ -251,19 +692,36 @@ struct mat
 		std::cout << "]" << std::endl;
 	}
 
-	template<int other_col_num>
-	mat<row_num, other_col_num, val_t> dot(const mat<col_num, other_col_num, val_t>& mt) const
+	template<int other_col_num, template<int, typename> class other_storage_tpl>
+	mat<row_num, other_col_num, val_t> dot(const mat<col_num, other_col_num, val_t, other_storage_tpl>& mt) const
+	{
+		return mat_dot<false, false, row_num, other_col_num, col_num, val_t>(*this, mt);
+	}
+
+	/* 例如mt_desig.dot(mt_in.t())，在编译期选择NT版本的gemm */
+	template<int other_col_num, template<int, typename> class other_storage_tpl>
+	mat<row_num, other_col_num, val_t> dot(const transposed_mat<col_num, other_col_num, val_t, other_storage_tpl>& mt) const
+	{
+		return mat_dot<false, true, row_num, other_col_num, col_num, val_t>(*this, mt);
+	}
+
+	/* 以(首地址, 行步长, 列步长)的形式交给步长在运行时给出的gemm，供mat_view和dmat使用 */
+	gemm_operand<val_t> gemm_arg() const
+	{
+		return gemm_operand<val_t>{ pval->p, col_num, 1 };
+	}
+
+	template<typename expr_t, typename = std::enable_if_t<is_mat_expr<expr_t>::value && !is_transposed_mat<expr_t>::value && expr_t::r == col_num> >
+	mat<row_num, expr_t::c, val_t> dot(const expr_t& e) const
 	{
-		using omatt = mat<row_num, other_col_num, val_t>;
-		omatt mt_ret;
-		for (int r = 0; r < omatt::r; ++r)
+		/* 视图本身就是(首地址, 行步长, 列步长)，直接交给gemm，不先复制成mat */
+		if constexpr (is_mat_view<expr_t>::value && std::is_arithmetic<val_t>::value)
 		{
-			for (int c = 0; c < omatt::c; ++c)
-			{
-				mt_ret.get(r, c) = do_dot(r, c, *this, mt);
-			}
+			mat<row_num, expr_t::c, val_t> mt_ret;
+			gemm(row_num, expr_t::c, col_num, gemm_arg(), e.gemm_arg(), mt_ret.pval->p);
+			return mt_ret;
 		}
-		return mt_ret;
+		return dot(mat<col_num, expr_t::c, val_t>(e));
 	}
 
 	mat<row_num, col_num, val_t> rot180() const
@@ -311,10 +769,10 @@ struct mat
 	}
 
 	template<int row_span, int col_span>
-	mat<row_num + row_span*(row_num - 1), col_num + col_span*(col_num-1)>
+	mat<row_num + row_span*(row_num - 1), col_num + col_span*(col_num-1), val_t>
 		span() const
 	{
-		using mat_ret_t = mat<row_num + row_span * (row_num - 1), col_num + col_span * (col_num - 1)>;
+		using mat_ret_t = mat<row_num + row_span * (row_num - 1), col_num + col_span * (col_num - 1), val_t>;
 		mat_ret_t mt_ret;
 		for (int r = 0; r < row_num; ++r) 
 		{
@@ -330,7 +788,7 @@ struct mat
 	val_t region_max(int& i_row, int& i_col) const 
 	{
 		static_assert(row_base < row_num && col_base < col_num, "region_max overflow!!!");
-		val_t d_max = -1. * DBL_MAX;
+		val_t d_max = lowest_val<val_t>();
 		for (int r = row_base; r < row_base + row_len && r < row_num; ++r) 
 		{
 			for (int c = col_base; c < col_base + col_len && c < col_num; ++c) 
@@ -345,11 +803,9 @@ struct mat
 		return d_max;
 	}
 
-	mat<row_num*col_num, 1, val_t> one_col() const 
+	mat<row_num*col_num, 1, val_t, storage_tpl> one_col() const 
 	{
-		mat<row_num*col_num, 1, val_t> ret;
-		ret.pval = pval;
-		return ret;
+		return mat<row_num*col_num, 1, val_t, storage_tpl>(pval.view());
 	}
 
 	template<typename t>
@@ -358,10 +814,10 @@ struct mat
 		std::cout << typeid(t).name();
 	}
 
-	template<int r, int c, typename t>
-	static void print_sub_type(mat<r, c, t>)
+	template<int r, int c, typename t, template<int, typename> class s>
+	static void print_sub_type(mat<r, c, t, s>)
 	{
-		mat<r, c, t>::print_type();
+		mat<r, c, t, s>::print_type();
 	}
 
 	static void print_type() 
@@ -381,19 +837,55 @@ struct mat
 		return pval->p[idx];
 	}
 
-	mat<row_num, col_num, val_t>& operator+=(const mat<row_num, col_num, val_t>& other)
+	/*
+	 * 复合赋值直接写回自身的内存(与operator=相同，只有内存被共享时才换一块新内存)，
+	 * other可以是矩阵、表达式或视图，a += b * c这样的式子也只遍历一次内存
+	 */
+	template<typename other_t>
+	mat& operator+=(const other_t& other)
 	{
-		for (int i = 0; i < row_num; ++i)
-		{
-			for (int j = 0; j < col_num; ++j)
-			{
-				get(i, j) += other.get(i, j);
-			}
-		}
+		*this = *this + other;
+		return *this;
+	}
+
+	template<typename other_t>
+	mat& operator-=(const other_t& other)
+	{
+		*this = *this - other;
+		return *this;
+	}
+
+	template<typename other_t>
+	mat& operator*=(const other_t& other)
+	{
+		*this = *this * other;
+		return *this;
+	}
+
+	template<typename other_t>
+	mat& operator/=(const other_t& other)
+	{
+		*this = *this / other;
+		return *this;
+	}
+
+	/* this = a * x + this */
+	template<typename x_t>
+	mat& axpy(const val_t& a, const x_t& x)
+	{
+		*this = a * x + *this;
+		return *this;
+	}
+
+	/* this = a * x + b * this */
+	template<typename x_t>
+	mat& axpby(const val_t& a, const x_t& x, const val_t& b)
+	{
+		*this = a * x + b * *this;
 		return *this;
 	}
 
-	friend std::ostream& operator<<(std::ostream& ofs, const mat<row_num, col_num, val_t>& mt)
+	friend std::ostream& operator<<(std::ostream& ofs, const mat& mt)
 	{
 		std::cout << "[" ;
 		for (int i = 0; i < row_num; ++i)
@@ -432,16 +924,463 @@ struct mat
 		return mt_ret;
 	}
 
+	/* 复制出第i_col列，返回的矩阵独立持有内存；只需读取时用col_view() */
 	mat<row_num, 1, val_t> col(const int& i_col) const
 	{
-		mat<row_num, 1, val_t> ret;
-		for (int i = 0; i < row_num; ++i)
-		{
-			ret.get(i, 0) = get(i, i_col);
-		}
-		return ret;
+		return mat<row_num, 1, val_t>(col_view(i_col));
 	}
-};
+
+	/*
+	 * 以下接口返回不复制数据的mat_view，视图不持有内存，不能比原矩阵活得更久
+	 * 需要独立副本时赋值给mat，例如mat<row_num, 1> mt_c = mt.col_view(0)
+	 */
+	mat_view<row_num, col_num, val_t> view() const
+	{
+		const gemm_operand<val_t> arg = gemm_arg();
+		return mat_view<row_num, col_num, val_t>(const_cast<val_t*>(arg.p), arg.rs, arg.cs);
+	}
+
+	mat_view<row_num, 1, val_t> col_view(const int& i_col) const
+	{
+		const gemm_operand<val_t> arg = gemm_arg();
+		return mat_view<row_num, 1, val_t>(const_cast<val_t*>(arg.p) + i_col * arg.cs, arg.rs, arg.cs, arg.p);
+	}
+
+	mat_view<1, col_num, val_t> row(const int& i_row) const
+	{
+		const gemm_operand<val_t> arg = gemm_arg();
+		return mat_view<1, col_num, val_t>(const_cast<val_t*>(arg.p) + i_row * arg.rs, arg.rs, arg.cs, arg.p);
+	}
+
+	/* 从(row_base, col_base)开始的row_len*col_len子块 */
+	template<int row_base, int col_base, int row_len, int col_len>
+	mat_view<row_len, col_len, val_t> sub_mat() const
+	{
+		static_assert(row_base >= 0 && col_base >= 0 && row_base + row_len <= row_num && col_base + col_len <= col_num, "mat::sub_mat overflow!!!");
+		const gemm_operand<val_t> arg = gemm_arg();
+		return mat_view<row_len, col_len, val_t>(const_cast<val_t*>(arg.p) + row_base * arg.rs + col_base * arg.cs, arg.rs, arg.cs, arg.p);
+	}
+
+	template<int row_base, int row_len>
+	mat_view<row_len, col_num, val_t> rows() const
+	{
+		return sub_mat<row_base, 0, row_len, col_num>();
+	}
+
+	template<int col_base, int col_len>
+	mat_view<row_num, col_len, val_t> cols() const
+	{
+		return sub_mat<0, col_base, row_num, col_len>();
+	}
+};
+
+/* 把mat_arena_scope内得到的矩阵复制到普通的堆上，返回值可以带出scope */
+template<int row_num, int col_num, typename val_t, template<int, typename> class storage_tpl>
+mat<row_num, col_num, val_t, storage_tpl> mat_arena_escape(const mat<row_num, col_num, val_t, storage_tpl>& mt)
+{
+	mat_arena_pause pause;
+	mat<row_num, col_num, val_t, storage_tpl> ret;
+	std::copy(mt.pval->p, mt.pval->p + row_num * col_num, ret.pval->p);
+	return ret;
+}
+
+/*
+ * 不持有内存的矩阵视图：元素(i, j)位于p[i*rs + j*cs]
+ * 由mat::view/col/row/sub_mat/rows/cols得到，t()只交换步长，都不复制数据
+ * 视图是表达式模板的叶子节点，base_function.hpp中的逐元素运算、exp/sqrtl/abs都可以直接使用，dot直接交给gemm
+ * 与指针一样，const视图不限制写入元素；对视图赋值会写入原矩阵
+ * p_base记录原矩阵的首地址，赋值时用来判断源和目标是否是同一块内存
+ */
+template<int row_num, int col_num, typename val_t>
+struct mat_view :public mat_expr_tag
+{
+	using type = val_t;
+	using t_type = mat_view<col_num, row_num, val_t>;
+	static constexpr int r = row_num;
+	static constexpr int c = col_num;
+	val_t* p;
+	int rs;
+	int cs;
+	const void* p_base;
+
+	mat_view(val_t* p_i, const int& rs_i, const int& cs_i, const void* p_base_i = nullptr)
+		:p(p_i), rs(rs_i), cs(cs_i), p_base(p_base_i ? p_base_i : p_i)
+	{
+	}
+	mat_view(const mat_view& other) = default;
+
+	/* 对视图赋值会写入原矩阵，源与目标共享内存时先算到临时矩阵里 */
+	const mat_view& operator=(const mat_view& other) const
+	{
+		return assign_from(other);
+	}
+
+	template<typename expr_t, typename = std::enable_if_t<is_mat_expr<expr_t>::value && expr_t::r == row_num && expr_t::c == col_num> >
+	const mat_view& operator=(const expr_t& e) const
+	{
+		return assign_from(e);
+	}
+
+	template<template<int, typename> class storage_tpl>
+	const mat_view& operator=(const mat<row_num, col_num, val_t, storage_tpl>& mt) const
+	{
+		return assign_from(mt.view());
+	}
+
+	const mat_view& operator=(const val_t& v) const
+	{
+		for (int i = 0; i < row_num; ++i)
+		{
+			for (int j = 0; j < col_num; ++j)
+			{
+				get(i, j) = v;
+			}
+		}
+		return *this;
+	}
+
+	val_t& get(const int& i_row, const int& i_col) const
+	{
+		return p[i_row * rs + i_col * cs];
+	}
+
+	/* 按行主序的下标访问 */
+	const val_t& at(const int& idx) const
+	{
+		return p[(idx / col_num) * rs + (idx % col_num) * cs];
+	}
+
+	/* 按行主序连续存放 */
+	bool contiguous() const
+	{
+		return (col_num == 1 || cs == 1) && (row_num == 1 || rs == col_num * cs);
+	}
+
+	/* 连续时直接返回自身的内存，否则把这一段按行主序收集到p_buf */
+	const val_t* block(const int& i0, const int& n, val_t* p_buf) const
+	{
+		if (contiguous())
+			return p + i0;
+		int i_row = i0 / col_num, i_col = i0 % col_num;
+		for (int k = 0; k < n; ++k)
+		{
+			p_buf[k] = p[i_row * rs + i_col * cs];
+			if (++i_col == col_num)
+			{
+				i_col = 0;
+				++i_row;
+			}
+		}
+		return p_buf;
+	}
+
+	/* at和block都已按步长换算，视图总能按行主序下标访问 */
+	bool linear() const
+	{
+		return true;
+	}
+
+	bool conflict(const void* p_dst) const
+	{
+		return p_base == p_dst;
+	}
+
+	gemm_operand<val_t> gemm_arg() const
+	{
+		return gemm_operand<val_t>{ p, rs, cs };
+	}
+
+	t_type t() const
+	{
+		return t_type(p, cs, rs, p_base);
+	}
+
+	mat<row_num, 1, val_t> col(const int& i_col) const
+	{
+		return mat<row_num, 1, val_t>(col_view(i_col));
+	}
+
+	mat_view<row_num, 1, val_t> col_view(const int& i_col) const
+	{
+		return mat_view<row_num, 1, val_t>(p + i_col * cs, rs, cs, p_base);
+	}
+
+	mat_view<1, col_num, val_t> row(const int& i_row) const
+	{
+		return mat_view<1, col_num, val_t>(p + i_row * rs, rs, cs, p_base);
+	}
+
+	template<int row_base, int col_base, int row_len, int col_len>
+	mat_view<row_len, col_len, val_t> sub_mat() const
+	{
+		static_assert(row_base >= 0 && col_base >= 0 && row_base + row_len <= row_num && col_base + col_len <= col_num, "mat_view::sub_mat overflow!!!");
+		return mat_view<row_len, col_len, val_t>(p + row_base * rs + col_base * cs, rs, cs, p_base);
+	}
+
+	mat<row_num, col_num, val_t> eval() const
+	{
+		return mat<row_num, col_num, val_t>(*this);
+	}
+
+	template<typename other_t>
+	mat<row_num, other_t::c, val_t> dot(const other_t& other) const
+	{
+		static_assert(other_t::r == col_num, "mat_view::dot shape mismatch");
+		if constexpr (std::is_arithmetic<val_t>::value && (is_mat_view<other_t>::value || is_transposed_mat<other_t>::value || !is_mat_expr<other_t>::value))
+		{
+			mat<row_num, other_t::c, val_t> mt_ret;
+			gemm(row_num, other_t::c, col_num, gemm_arg(), other.gemm_arg(), mt_ret.pval->p);
+			return mt_ret;
+		}
+		else
+		{
+			return eval().dot(other);
+		}
+	}
+
+	val_t sum() const
+	{
+		if (contiguous())
+			return simd_kernels<val_t>::get().sum(p, row_num * col_num);
+		return eval().sum();
+	}
+
+	val_t max() const
+	{
+		if (contiguous())
+			return simd_kernels<val_t>::get().max(p, row_num * col_num);
+		return eval().max();
+	}
+
+	val_t max_abs() const
+	{
+		if (contiguous())
+			return simd_kernels<val_t>::get().max_abs(p, row_num * col_num);
+		return eval().max_abs();
+	}
+
+	val_t argmax(int& i_row, int& i_col) const
+	{
+		i_row = i_col = 0;
+		for (int i = 0; i < row_num; ++i)
+		{
+			for (int j = 0; j < col_num; ++j)
+			{
+				if (get(i_row, i_col) < get(i, j))
+				{
+					i_row = i;
+					i_col = j;
+				}
+			}
+		}
+		return get(i_row, i_col);
+	}
+
+	void print() const
+	{
+		eval().print();
+	}
+
+	const val_t& operator[](const int& idx) const
+	{
+		return at(idx);
+	}
+
+private:
+	template<typename src_t>
+	const mat_view& assign_from(const src_t& e) const
+	{
+		if (e.conflict(p_base))
+		{
+			mat<row_num, col_num, val_t> mt_tmp(e);
+			return assign_from(mt_tmp.view());
+		}
+		for (int i = 0; i < row_num; ++i)
+		{
+			for (int j = 0; j < col_num; ++j)
+			{
+				get(i, j) = e.get(i, j);
+			}
+		}
+		return *this;
+	}
+};
+
+/*
+ * mat::t()的结果：与原矩阵共享存储(inline_storage只能复制)，元素(i, j)位于p[j*row_num + i]
+ * 转置体现在类型上，get不需要判断；dot按NN/NT/TN/TT在编译期选择gemm的版本
+ * 是表达式模板的叶子节点，赋值给mat时按转置复制出一份行主序的矩阵，t()再转回与原矩阵共享存储的mat
+ */
+template<int row_num, int col_num, typename val_t, template<int, typename> class storage_tpl>
+struct transposed_mat :public mat_expr_tag
+{
+	using type = val_t;
+	using t_type = mat<col_num, row_num, val_t, storage_tpl>;
+	static constexpr int r = row_num;
+	static constexpr int c = col_num;
+	using storage_t = storage_tpl<row_num * col_num, val_t>;
+	storage_t pval;
+
+	explicit transposed_mat(storage_t&& s) :pval(std::move(s))
+	{
+	}
+	/* 在表达式中按值保存，复制时与原矩阵共享存储而不是深拷贝 */
+	transposed_mat(const transposed_mat& other) :pval(other.pval.view())
+	{
+	}
+	transposed_mat(transposed_mat&& other) = default;
+	transposed_mat& operator=(const transposed_mat& other) = delete;
+
+	val_t get(const int& i_row, const int& i_col) const
+	{
+		return pval->p[i_col * row_num + i_row];
+	}
+
+	/* 只有行向量、列向量的转置能按内存顺序线性访问，at和block只在linear()时使用 */
+	const val_t& at(const int& idx) const
+	{
+		return pval->p[idx];
+	}
+
+	const val_t* block(const int& i0, const int& /* n */, val_t* /* p_buf */) const
+	{
+		return pval->p + i0;
+	}
+
+	bool linear() const
+	{
+		return row_num == 1 || col_num == 1;
+	}
+
+	bool conflict(const void* p_dst) const
+	{
+		return pval->p == p_dst;
+	}
+
+	gemm_operand<val_t> gemm_arg() const
+	{
+		return gemm_operand<val_t>{ pval->p, 1, row_num };
+	}
+
+	t_type t() const
+	{
+		return t_type(pval.view());
+	}
+
+	mat<row_num, col_num, val_t> eval() const
+	{
+		return mat<row_num, col_num, val_t>(*this);
+	}
+
+	mat_view<row_num, col_num, val_t> view() const
+	{
+		return mat_view<row_num, col_num, val_t>(const_cast<val_t*>(pval->p), 1, row_num);
+	}
+
+	/* 例如mt_weight.t().dot(mt_desig)，在编译期选择TN版本的gemm */
+	template<int other_col_num, template<int, typename> class other_storage_tpl>
+	mat<row_num, other_col_num, val_t> dot(const mat<col_num, other_col_num, val_t, other_storage_tpl>& mt) const
+	{
+		return mat_dot<true, false, row_num, other_col_num, col_num, val_t>(*this, mt);
+	}
+
+	template<int other_col_num, template<int, typename> class other_storage_tpl>
+	mat<row_num, other_col_num, val_t> dot(const transposed_mat<col_num, other_col_num, val_t, other_storage_tpl>& mt) const
+	{
+		return mat_dot<true, true, row_num, other_col_num, col_num, val_t>(*this, mt);
+	}
+
+	template<typename expr_t, typename = std::enable_if_t<is_mat_expr<expr_t>::value && !is_transposed_mat<expr_t>::value && expr_t::r == col_num> >
+	mat<row_num, expr_t::c, val_t> dot(const expr_t& e) const
+	{
+		if constexpr (is_mat_view<expr_t>::value && std::is_arithmetic<val_t>::value)
+		{
+			mat<row_num, expr_t::c, val_t> mt_ret;
+			gemm(row_num, expr_t::c, col_num, gemm_arg(), e.gemm_arg(), mt_ret.pval->p);
+			return mt_ret;
+		}
+		else
+		{
+			return dot(mat<col_num, expr_t::c, val_t>(e));
+		}
+	}
+
+	/* 归约与元素的排列顺序无关，直接作用在共享的存储上 */
+	val_t sum() const
+	{
+		return pval->sum();
+	}
+
+	val_t max() const
+	{
+		return pval->max();
+	}
+
+	val_t max_abs() const
+	{
+		return pval->max_abs();
+	}
+
+	val_t argmax(int& i_row, int& i_col) const
+	{
+		const int i_idx = pval->argmax();
+		i_row = i_idx % row_num;
+		i_col = i_idx / row_num;
+		return pval->p[i_idx];
+	}
+
+	void print() const
+	{
+		eval().print();
+	}
+
+	/* 按转置后的行主序下标访问 */
+	val_t operator[](const int& idx) const
+	{
+		return get(idx / col_num, idx % col_num);
+	}
+
+	int size() const
+	{
+		return row_num * col_num;
+	}
+};
+
+/*
+ * 转置方式在编译期确定的矩阵乘法
+ * 元素本身是算术类型的矩阵(例如mha_t)时，对元素数据做一次batched Hadamard GEMM，不产生临时矩阵；更深的嵌套逐元素do_dot
+ */
+template<bool a_t, bool b_t, int M, int N, int K, typename val_t, typename lhs_t, typename rhs_t>
+mat<M, N, val_t, MAT_DEFAULT_STORAGE> mat_dot(const lhs_t& lhs, const rhs_t& rhs)
+{
+	mat<M, N, val_t> mt_ret;
+	if constexpr (std::is_arithmetic<val_t>::value)
+	{
+		gemm<a_t, b_t>(M, N, K, lhs.pval->p, rhs.pval->p, mt_ret.pval->p);
+	}
+	else if constexpr (is_arith_mat<val_t>::value)
+	{
+		using elem_vt = typename val_t::type;
+		const val_t* pa = lhs.pval->p;
+		const val_t* pb = rhs.pval->p;
+		val_t* pc = mt_ret.pval->p;
+		gemm_batched_hadamard<elem_vt>(M, N, K, val_t::r * val_t::c,
+			[pa](const int& i, const int& k) -> const elem_vt* { return pa[a_t ? k * M + i : i * K + k].pval->p; },
+			[pb](const int& k, const int& j) -> const elem_vt* { return pb[b_t ? j * K + k : k * N + j].pval->p; },
+			[pc](const int& i, const int& j) -> elem_vt* { return pc[i * N + j].pval->p; });
+	}
+	else
+	{
+		for (int i = 0; i < M; ++i)
+		{
+			for (int j = 0; j < N; ++j)
+			{
+				mt_ret.get(i, j) = do_dot(i, j, lhs, rhs);
+			}
+		}
+	}
+	return mt_ret;
+}
 
 template<typename type>
 struct mat_size
@@ -449,8 +1388,8 @@ struct mat_size
 	static constexpr int num = 1;
 };
 
-template<int target_col, int target_row, typename target_val_t>
-struct mat_size<mat<target_col, target_row, target_val_t> >
+template<int target_col, int target_row, typename target_val_t, template<int, typename> class target_storage_tpl>
+struct mat_size<mat<target_col, target_row, target_val_t, target_storage_tpl> >
 {
 	static constexpr int num = target_col * target_row * mat_size<target_val_t>::num;
 };
@@ -461,8 +1400,8 @@ struct mat_unite_type
 	using type = unite_type;
 };
 
-template<int row_num, int col_num, typename val_t>
-struct mat_unite_type<mat<row_num, col_num, val_t> >
+template<int row_num, int col_num, typename val_t, template<int, typename> class storage_tpl>
+struct mat_unite_type<mat<row_num, col_num, val_t, storage_tpl> >
 {
 	using type = typename mat_unite_type<val_t>::type;
 };
@@ -492,10 +1431,10 @@ struct stretch_to_unite
 	}
 };
 
-template<int i1, int i2, typename val_t>
-mat<i1, i2, val_t> max_and_swap(const mat<i1, i2, val_t>& mt_max, const mat<i1, i2, val_t>& mt_optional)
+template<int i1, int i2, typename val_t, template<int, typename> class storage_tpl>
+mat<i1, i2, val_t, storage_tpl> max_and_swap(const mat<i1, i2, val_t, storage_tpl>& mt_max, const mat<i1, i2, val_t, storage_tpl>& mt_optional)
 {
-	using ret_type = mat<i1, i2, val_t>;
+	using ret_type = mat<i1, i2, val_t, storage_tpl>;
 	ret_type ret;
 	for (int i = 0; i < i1; ++i) 
 	{
@@ -513,10 +1452,10 @@ val_t max_and_choose(const val_t& v1, const val_t& v2, const val_t& v3, const va
 	return v1 < v2 ? v3 : v4;
 }
 
-template<int i1, int i2, typename val_t>
-mat<i1, i2, val_t> max_and_choose(const mat<i1, i2, val_t>& mt_judge1, const mat<i1, i2, val_t>& mt_judge2, const mat<i1, i2, val_t>& mt_optional1, const mat<i1, i2, val_t>& mt_optional2)
+template<int i1, int i2, typename val_t, template<int, typename> class storage_tpl>
+mat<i1, i2, val_t, storage_tpl> max_and_choose(const mat<i1, i2, val_t, storage_tpl>& mt_judge1, const mat<i1, i2, val_t, storage_tpl>& mt_judge2, const mat<i1, i2, val_t, storage_tpl>& mt_optional1, const mat<i1, i2, val_t, storage_tpl>& mt_optional2)
 {
-	using ret_type = mat<i1, i2, val_t>;
+	using ret_type = mat<i1, i2, val_t, storage_tpl>;
 	ret_type ret;
 	for (int i = 0; i < i1; ++i)
 	{
@@ -528,10 +1467,10 @@ mat<i1, i2, val_t> max_and_choose(const mat<i1, i2, val_t>& mt_judge1, const mat
 	return ret;
 }
 
-template<int row_num, int col_num, typename val_t>
-struct destoryer<mat<row_num, col_num, val_t> >
+template<int row_num, int col_num, typename val_t, template<int, typename> class storage_tpl>
+struct destoryer<mat<row_num, col_num, val_t, storage_tpl> >
 {
-	using type = mat<row_num, col_num, val_t>;
+	using type = mat<row_num, col_num, val_t, storage_tpl>;
 	static void do_destory(type& v)
 	{
 		v.~type();
@@ -555,7 +1494,7 @@ double sub_mul_cal(const mat<N, N, double>& mt, const std::vector<int>& vec_cur)
 }
 
 
-// 使用逆序数法求行列式
+// 使用逆序数法求行列式，复杂度O(N!)，只保留用来校验和对比det
 template<int N>
 void det_cal(double& dret, const mat<N, N, double>& mt, const std::vector<int>& vec_idx, const size_t& siz_cur, const double& dflag = 1.)
 {
@@ -575,9 +1514,8 @@ void det_cal(double& dret, const mat<N, N, double>& mt, const std::vector<int>&
 	}
 }
 
-// 求行列式的值
 template<int N>
-double det(const mat<N, N, double>& mt)
+double det_permutation(const mat<N, N, double>& mt)
 {
 	std::vector<int> vec(N, 0);
 	int idx = 0;
@@ -590,14 +1528,312 @@ double det(const mat<N, N, double>& mt)
 	return dret;
 }
 
+/*
+ * 部分主元LU分解：P*A = L*U
+ * L的对角线恒为1不保存，L的其余部分和U共用mt_lu；sz_piv[i]记录第i行来自原矩阵的哪一行
+ * 主元为0时标记为奇异，det返回0，solve和inverse与原来的伴随矩阵法一样得到inf/nan
+ */
+template<int N, typename val_t = double>
+struct lu_t
+{
+	mat<N, N, val_t> mt_lu;
+	int sz_piv[N];
+	val_t sign;
+	bool singular;
+
+	lu_t(const mat<N, N, val_t>& mt)
+	{
+		decompose(mt);
+	}
+
+	void decompose(const mat<N, N, val_t>& mt)
+	{
+		for (int i = 0; i < N; ++i)
+		{
+			sz_piv[i] = i;
+			for (int j = 0; j < N; ++j)
+			{
+				mt_lu.get(i, j) = mt.get(i, j);
+			}
+		}
+		sign = 1;
+		singular = false;
+		// mt_lu是新建的行主序矩阵，消元直接在连续内存上进行，避免逐元素get的转置判断
+		val_t* a = &mt_lu.get(0, 0);
+		for (int k = 0; k < N; ++k)
+		{
+			int i_max = k;
+			for (int i = k + 1; i < N; ++i)
+			{
+				if (std::abs(a[i * N + k]) > std::abs(a[i_max * N + k]))
+					i_max = i;
+			}
+			if (i_max != k)
+			{
+				std::swap_ranges(a + k * N, a + k * N + N, a + i_max * N);
+				std::swap(sz_piv[k], sz_piv[i_max]);
+				sign = -sign;
+			}
+			const val_t pivot = a[k * N + k];
+			if (pivot == val_t(0))
+			{
+				singular = true;
+				continue;
+			}
+			const val_t* a_k = a + k * N;
+			for (int i = k + 1; i < N; ++i)
+			{
+				val_t* a_i = a + i * N;
+				const val_t l = a_i[k] / pivot;
+				a_i[k] = l;
+				for (int j = k + 1; j < N; ++j)
+				{
+					a_i[j] -= l * a_k[j];
+				}
+			}
+		}
+	}
+
+	val_t det() const
+	{
+		if (singular)
+			return val_t(0);
+		val_t ret = sign;
+		for (int i = 0; i < N; ++i)
+		{
+			ret *= mt_lu.get(i, i);
+		}
+		return ret;
+	}
+
+	// ln|det|，高维矩阵的行列式容易上溢或下溢时使用
+	val_t log_det() const
+	{
+		val_t ret = 0;
+		for (int i = 0; i < N; ++i)
+		{
+			ret += std::log(std::abs(mt_lu.get(i, i)));
+		}
+		return ret;
+	}
+
+	// 求解A*X = B，B的每一列是一个右端项
+	template<int M>
+	mat<N, M, val_t> solve(const mat<N, M, val_t>& mt_b) const
+	{
+		mat<N, M, val_t> mt_x;
+		for (int i = 0; i < N; ++i)
+		{
+			for (int j = 0; j < M; ++j)
+			{
+				mt_x.get(i, j) = mt_b.get(sz_piv[i], j);
+			}
+		}
+		// 前代和回代都按行进行，最内层沿X的一行连续
+		const val_t* a = mt_lu.gemm_arg().p;
+		val_t* x = &mt_x.get(0, 0);
+		for (int i = 1; i < N; ++i)
+		{
+			for (int k = 0; k < i; ++k)
+			{
+				const val_t l = a[i * N + k];
+				for (int j = 0; j < M; ++j)
+				{
+					x[i * M + j] -= l * x[k * M + j];
+				}
+			}
+		}
+		for (int i = N - 1; i >= 0; --i)
+		{
+			for (int k = i + 1; k < N; ++k)
+			{
+				const val_t u = a[i * N + k];
+				for (int j = 0; j < M; ++j)
+				{
+					x[i * M + j] -= u * x[k * M + j];
+				}
+			}
+			const val_t u_ii = a[i * N + i];
+			for (int j = 0; j < M; ++j)
+			{
+				x[i * M + j] /= u_ii;
+			}
+		}
+		return mt_x;
+	}
+
+	mat<N, N, val_t> inverse() const
+	{
+		mat<N, N, val_t> mt_e(val_t(0));
+		for (int i = 0; i < N; ++i)
+		{
+			mt_e.get(i, i) = 1;
+		}
+		return solve(mt_e);
+	}
+};
+
+/*
+ * Cholesky分解：A = L*L^T，只适用于对称正定矩阵(例如协方差矩阵)，计算量约为LU的一半
+ * 只读取A的下三角；遇到非正的对角元时positive为false，此时应改用lu_t
+ */
+template<int N, typename val_t = double>
+struct cholesky_t
+{
+	mat<N, N, val_t> mt_l;
+	bool positive;
+
+	cholesky_t(const mat<N, N, val_t>& mt)
+	{
+		decompose(mt);
+	}
+
+	bool decompose(const mat<N, N, val_t>& mt)
+	{
+		positive = true;
+		val_t* l = &mt_l.get(0, 0);
+		for (int j = 0; j < N; ++j)
+		{
+			const val_t* l_j = l + j * N;
+			val_t d = mt.get(j, j);
+			for (int k = 0; k < j; ++k)
+			{
+				d -= l_j[k] * l_j[k];
+			}
+			if (!(d > val_t(0)))
+			{
+				positive = false;
+				return false;
+			}
+			const val_t l_jj = std::sqrt(d);
+			l[j * N + j] = l_jj;
+			for (int i = j + 1; i < N; ++i)
+			{
+				const val_t* l_i = l + i * N;
+				val_t v = mt.get(i, j);
+				for (int k = 0; k < j; ++k)
+				{
+					v -= l_i[k] * l_j[k];
+				}
+				l[i * N + j] = v / l_jj;
+				l[j * N + i] = 0;
+			}
+		}
+		return true;
+	}
+
+	val_t det() const
+	{
+		val_t ret = 1;
+		for (int i = 0; i < N; ++i)
+		{
+			ret *= mt_l.get(i, i);
+		}
+		return ret * ret;
+	}
+
+	val_t log_det() const
+	{
+		val_t ret = 0;
+		for (int i = 0; i < N; ++i)
+		{
+			ret += std::log(mt_l.get(i, i));
+		}
+		return 2 * ret;
+	}
+
+	// 先解L*Y = B，再解L^T*X = Y
+	template<int M>
+	mat<N, M, val_t> solve(const mat<N, M, val_t>& mt_b) const
+	{
+		mat<N, M, val_t> mt_x;
+		for (int i = 0; i < N; ++i)
+		{
+			for (int j = 0; j < M; ++j)
+			{
+				mt_x.get(i, j) = mt_b.get(i, j);
+			}
+		}
+		const val_t* l = mt_l.gemm_arg().p;
+		val_t* x = &mt_x.get(0, 0);
+		for (int i = 0; i < N; ++i)
+		{
+			for (int k = 0; k < i; ++k)
+			{
+				const val_t l_ik = l[i * N + k];
+				for (int j = 0; j < M; ++j)
+				{
+					x[i * M + j] -= l_ik * x[k * M + j];
+				}
+			}
+			const val_t l_ii = l[i * N + i];
+			for (int j = 0; j < M; ++j)
+			{
+				x[i * M + j] /= l_ii;
+			}
+		}
+		for (int i = N - 1; i >= 0; --i)
+		{
+			for (int k = i + 1; k < N; ++k)
+			{
+				const val_t l_ki = l[k * N + i];
+				for (int j = 0; j < M; ++j)
+				{
+					x[i * M + j] -= l_ki * x[k * M + j];
+				}
+			}
+			const val_t l_ii = l[i * N + i];
+			for (int j = 0; j < M; ++j)
+			{
+				x[i * M + j] /= l_ii;
+			}
+		}
+		return mt_x;
+	}
+
+	mat<N, N, val_t> inverse() const
+	{
+		mat<N, N, val_t> mt_e(val_t(0));
+		for (int i = 0; i < N; ++i)
+		{
+			mt_e.get(i, i) = 1;
+		}
+		return solve(mt_e);
+	}
+};
+
+// 求行列式的值
+template<int N, typename val_t>
+val_t det(const mat<N, N, val_t>& mt)
+{
+	return lu_t<N, val_t>(mt).det();
+}
+
+// 求ln|det|，对称正定矩阵走Cholesky，否则走LU
+template<int N, typename val_t>
+val_t log_det(const mat<N, N, val_t>& mt)
+{
+	cholesky_t<N, val_t> chol(mt);
+	if (chol.positive)
+		return chol.log_det();
+	return lu_t<N, val_t>(mt).log_det();
+}
+
+// 求解mt_a * X = mt_b
+template<int N, int M, typename val_t>
+mat<N, M, val_t> solve(const mat<N, N, val_t>& mt_a, const mat<N, M, val_t>& mt_b)
+{
+	return lu_t<N, val_t>(mt_a).solve(mt_b);
+}
+
 template<int N, typename val_t>
 mat<N, N, val_t> algebraic_complement(const mat<N, N, val_t>& mt)
 {
 	mat<N, N, val_t> mtret;
-	double drflag = 1.;
+	val_t drflag = 1.;
 	for (int i = 0; i < N; ++i)
 	{
-		double dcflag = 1.;
+		val_t dcflag = 1.;
 		for (int j = 0; j < N; ++j)
 		{
 			mtret.get(i, j) = (drflag * dcflag * det(mt.algebraic_complement_val(i, j)));
@@ -611,7 +1847,7 @@ mat<N, N, val_t> algebraic_complement(const mat<N, N, val_t>& mt)
 template<int N, typename val_t>
 mat<N, N, val_t> inverse(const mat<N, N, val_t>& mt)
 {
-	return algebraic_complement(mt)/det(mt);
+	return lu_t<N, val_t>(mt).inverse();
 }
 
 template<typename cur_mt_t, typename ...other_mt_t>
@@ -630,11 +1866,19 @@ constexpr int row_sum()
 template<int begin_row, typename ret_mt_t, typename cur_mt_t, typename ...other_mt_t>
 void __join_col(ret_mt_t& mt_ret, const cur_mt_t& mt_cur, const other_mt_t& ...mt_other)
 {
-	for (int i = 0; i < cur_mt_t::r; ++i)
+	if constexpr (is_mat<cur_mt_t>::value && cur_mt_t::c == ret_mt_t::c)
 	{
-		for (int j = 0; j < cur_mt_t::c; ++j)
+		/* 列数相同时，mat在结果中占连续的一整块 */
+		std::copy(mt_cur.pval->p, mt_cur.pval->p + cur_mt_t::r * cur_mt_t::c, mt_ret.pval->p + begin_row * ret_mt_t::c);
+	}
+	else
+	{
+		for (int i = 0; i < cur_mt_t::r; ++i)
 		{
-			mt_ret.get(i + begin_row, j) = mt_cur.get(i, j);
+			for (int j = 0; j < cur_mt_t::c; ++j)
+			{
+				mt_ret.get(i + begin_row, j) = mt_cur.get(i, j);
+			}
 		}
 	}
 	if constexpr (sizeof...(other_mt_t) > 0)
@@ -645,9 +1889,9 @@ void __join_col(ret_mt_t& mt_ret, const cur_mt_t& mt_cur, const other_mt_t& ...m
 
 
 template<typename cur_mt_t, typename ...mat_ts>
-mat<row_sum<cur_mt_t,mat_ts...>(), cur_mt_t::c> join_col(const cur_mt_t& mt, const mat_ts& ...mts)
+mat<row_sum<cur_mt_t,mat_ts...>(), cur_mt_t::c, typename cur_mt_t::type> join_col(const cur_mt_t& mt, const mat_ts& ...mts)
 {
-	using ret_type = mat<row_sum<cur_mt_t,mat_ts...>(), cur_mt_t::c>;
+	using ret_type = mat<row_sum<cur_mt_t,mat_ts...>(), cur_mt_t::c, typename cur_mt_t::type>;
 	ret_type mt_ret;
 	__join_col<0, ret_type, cur_mt_t, mat_ts...>(mt_ret, mt, mts...);
 	return mt_ret;
@@ -669,11 +1913,24 @@ constexpr int col_num()
 template<int begin_col, typename ret_mt_t, typename cur_mt_t, typename ...mat_ts>
 void __join_row(ret_mt_t& mt_ret, const cur_mt_t& mt_cur, const mat_ts& ...mts)
 {
-	for (int i = 0; i < cur_mt_t::r; ++i)
+	if constexpr (is_mat<cur_mt_t>::value)
 	{
-		for (int j = 0; j < cur_mt_t::c; ++j)
+		/* 每一行整段复制到结果对应行的第begin_col列开始处 */
+		const auto* p_src = mt_cur.pval->p;
+		auto* p_dst = mt_ret.pval->p + begin_col;
+		for (int i = 0; i < cur_mt_t::r; ++i)
 		{
-			mt_ret.get(i, j + begin_col) = mt_cur.get(i, j);
+			std::copy(p_src + i * cur_mt_t::c, p_src + (i + 1) * cur_mt_t::c, p_dst + i * ret_mt_t::c);
+		}
+	}
+	else
+	{
+		for (int i = 0; i < cur_mt_t::r; ++i)
+		{
+			for (int j = 0; j < cur_mt_t::c; ++j)
+			{
+				mt_ret.get(i, j + begin_col) = mt_cur.get(i, j);
+			}
 		}
 	}
 	if constexpr (sizeof...(mts) > 0)
@@ -683,40 +1940,157 @@ void __join_row(ret_mt_t& mt_ret, const cur_mt_t& mt_cur, const mat_ts& ...mts)
 }
 
 template<typename cur_mt_t, typename ...mat_ts>
-mat<cur_mt_t::r, col_num<cur_mt_t, mat_ts...>()> join_row(const cur_mt_t& mt, const mat_ts& ...mts)
+mat<cur_mt_t::r, col_num<cur_mt_t, mat_ts...>(), typename cur_mt_t::type> join_row(const cur_mt_t& mt, const mat_ts& ...mts)
 {
-	using ret_type = mat<cur_mt_t::r, col_num<cur_mt_t, mat_ts...>()>;
+	using ret_type = mat<cur_mt_t::r, col_num<cur_mt_t, mat_ts...>(), typename cur_mt_t::type>;
 	ret_type mt_ret;
 	__join_row<0, ret_type, cur_mt_t, mat_ts...>(mt_ret, mt, mts...);
 	return mt_ret;
 }
 
 #include <vector>
-/* 输出改成0均值1均方差的 */
+/*
+ * 按特征(矩阵的每个元素)统计样本的均值与方差，一遍扫描，不产生临时矩阵
+ * push按Welford递推：n += 1, delta = x - mean, mean += delta / n, m2 += delta * (x - mean)
+ * merge按Chan的公式合并两段数据的统计量，数据可以分段(分线程)统计后再合并
+ * variance是总体方差m2 / n，与原来normalize输出的mt_div一致
+ */
 template<int row_num, int col_num, typename val_t>
-inline std::vector<mat<row_num, col_num, val_t> > normalize(const std::vector<mat<row_num, col_num, val_t> >& vec_input, mat<row_num, col_num, val_t>& mt_mean, mat<row_num, col_num, val_t>& mt_div)
+struct feature_stat_t
 {
-	if (1 == vec_input.size())return vec_input;
-	using type = mat<row_num, col_num, val_t>;
-	std::vector<type> vec_ret;
-	//type mt_mean, mt_div;
-	for (int i = 0; i < vec_input.size(); ++i)
+	static_assert(std::is_arithmetic<val_t>::value, "feature_stat_t: val_t must be arithmetic");
+	using mat_t = mat<row_num, col_num, val_t>;
+	static constexpr int i_size = row_num * col_num;
+
+	long long n = 0;
+	mat_t mt_mean;
+	mat_t mt_m2;
+
+	void push(const mat_t& mt)
 	{
-		mt_mean = mt_mean + vec_input[i] / static_cast<val_t>(vec_input.size());
+		++n;
+		const val_t v_inv = val_t(1) / static_cast<val_t>(n);
+		const val_t* p = mt.pval->p;
+		val_t* p_mean = mt_mean.pval->p;
+		val_t* p_m2 = mt_m2.pval->p;
+		for (int i = 0; i < i_size; ++i)
+		{
+			const val_t delta = p[i] - p_mean[i];
+			p_mean[i] = p_mean[i] + delta * v_inv;
+			p_m2[i] = p_m2[i] + delta * (p[i] - p_mean[i]);
+		}
 	}
 
-	for (int i = 0; i < vec_input.size(); ++i)
+	void merge(const feature_stat_t& other)
 	{
-		auto delta = vec_input[i] - mt_mean;
-		mt_div = mt_div + delta * delta / static_cast<val_t>(vec_input.size());
+		if (other.n == 0)
+			return;
+		if (n == 0)
+		{
+			*this = other;
+			return;
+		}
+		const long long n_all = n + other.n;
+		const val_t v_ratio = static_cast<val_t>(static_cast<double>(other.n) / n_all);
+		const val_t v_cross = static_cast<val_t>(static_cast<double>(n) * other.n / n_all);
+		const val_t* p_other_mean = other.mt_mean.pval->p;
+		const val_t* p_other_m2 = other.mt_m2.pval->p;
+		val_t* p_mean = mt_mean.pval->p;
+		val_t* p_m2 = mt_m2.pval->p;
+		for (int i = 0; i < i_size; ++i)
+		{
+			const val_t delta = p_other_mean[i] - p_mean[i];
+			p_mean[i] = p_mean[i] + delta * v_ratio;
+			p_m2[i] = p_m2[i] + p_other_m2[i] + delta * delta * v_cross;
+		}
+		n = n_all;
 	}
 
-	auto mt_s = sqrtl(mt_div);
+	mat_t variance() const
+	{
+		mat_t mt_ret;
+		if (n == 0)
+			return mt_ret;
+		const val_t v_n = static_cast<val_t>(n);
+		const val_t* p_m2 = mt_m2.pval->p;
+		val_t* p_ret = mt_ret.pval->p;
+		for (int i = 0; i < i_size; ++i)
+			p_ret[i] = p_m2[i] / v_n;
+		return mt_ret;
+	}
+};
 
-	for (int i = 0; i < vec_input.size(); ++i)
+/* 
+ * 样本数*特征数达到MAT_GEMM_PARALLEL_MIN时，把样本分成与线程数相同的段交给gemm的线程池，
+ * 各段分别统计后按顺序合并，因此线程数不变时结果是确定的
+ * 线程数只读一次，分段前先在调用线程上调用f_begin(段数)，f的第一个参数小于这个段数
+ */
+template<typename begin_func_t, typename func_t>
+inline void dataset_for_each_part(const size_t& sz_num, const int& i_feature_num, begin_func_t&& f_begin, func_t&& f)
+{
+	gemm_thread_pool& pool = gemm_thread_pool::get();
+	const int i_thread_num = pool.thread_num();
+	const int i_part = (i_thread_num > 1 && static_cast<double>(sz_num) * i_feature_num >= MAT_GEMM_PARALLEL_MIN) ? i_thread_num : 1;
+	f_begin(i_part);
+	if (i_part == 1)
 	{
-		vec_ret.push_back((vec_input[i] - mt_mean) / mt_s);
+		f(0, size_t(0), sz_num);
+		return;
 	}
+	pool.run(i_part, [&](const int& i_task) {
+		f(i_task, sz_num * i_task / i_part, sz_num * (i_task + 1) / i_part);
+	});
+}
+
+template<typename func_t>
+inline void dataset_for_each_part(const size_t& sz_num, const int& i_feature_num, func_t&& f)
+{
+	dataset_for_each_part(sz_num, i_feature_num, [](const int&) {}, std::forward<func_t>(f));
+}
+
+template<int row_num, int col_num, typename val_t>
+inline feature_stat_t<row_num, col_num, val_t> cal_feature_stat(const std::vector<mat<row_num, col_num, val_t> >& vec_input)
+{
+	using stat_t = feature_stat_t<row_num, col_num, val_t>;
+	std::vector<stat_t> vec_part;
+	dataset_for_each_part(vec_input.size(), row_num * col_num, [&](const int& i_part_num) {
+		vec_part.resize(i_part_num);
+	}, [&](const int& i_part, const size_t& sz_begin, const size_t& sz_end) {
+		for (size_t i = sz_begin; i < sz_end; ++i)
+			vec_part[i_part].push(vec_input[i]);
+	});
+	for (size_t i = 1; i < vec_part.size(); ++i)
+		vec_part[0].merge(vec_part[i]);
+	return vec_part[0];
+}
+
+/* 原地改成0均值1均方差的，不再复制整个数据集；mt_mean、mt_div输出均值和方差 */
+template<int row_num, int col_num, typename val_t>
+inline void normalize_in_place(std::vector<mat<row_num, col_num, val_t> >& vec_input, mat<row_num, col_num, val_t>& mt_mean, mat<row_num, col_num, val_t>& mt_div)
+{
+	if (vec_input.size() <= 1)return;
+	auto stat = cal_feature_stat(vec_input);
+	mt_mean = stat.mt_mean;
+	mt_div = stat.variance();
+	mat<row_num, col_num, val_t> mt_s = sqrtl(mt_div);
+	const val_t* p_mean = mt_mean.pval->p;
+	const val_t* p_s = mt_s.pval->p;
+	dataset_for_each_part(vec_input.size(), row_num * col_num, [&](const int&, const size_t& sz_begin, const size_t& sz_end) {
+		for (size_t i = sz_begin; i < sz_end; ++i)
+		{
+			val_t* p = vec_input[i].pval->p;
+			for (int j = 0; j < row_num * col_num; ++j)
+				p[j] = (p[j] - p_mean[j]) / p_s[j];
+		}
+	});
+}
+
+/* 输出改成0均值1均方差的 */
+template<int row_num, int col_num, typename val_t>
+inline std::vector<mat<row_num, col_num, val_t> > normalize(const std::vector<mat<row_num, col_num, val_t> >& vec_input, mat<row_num, col_num, val_t>& mt_mean, mat<row_num, col_num, val_t>& mt_div)
+{
+	std::vector<mat<row_num, col_num, val_t> > vec_ret(vec_input);
+	normalize_in_place(vec_ret, mt_mean, mt_div);
 	return vec_ret;
 }
 
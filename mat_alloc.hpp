@@ -0,0 +1,545 @@
+#ifndef _MAT_ALLOC_HPP_
+#define _MAT_ALLOC_HPP_
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+
+/*
+ * mat_m的分配入口：heap_storage/cow_storage都通过make_mat_m申请内存
+ * 当前线程有生效的mat_arena_scope时从arena顺序分配，否则直接make_shared
+ * 编译时定义MAT_POOL=1后改为从mat_pool按大小复用：释放的块不还给系统，每个线程和全局链表各自最多保留MAT_POOL_MAX_BYTES字节，
+ * 训练结束或内存紧张时调用mat_pool::trim()把当前线程和全局链表上的空闲块归还系统
+ */
+#ifndef MAT_POOL
+#define MAT_POOL 0
+#endif
+#ifndef MAT_POOL_CLASS_NUM
+#define MAT_POOL_CLASS_NUM 64
+#endif
+#ifndef MAT_POOL_LIST_MAX
+#define MAT_POOL_LIST_MAX 32
+#endif
+#ifndef MAT_POOL_MAX_BYTES
+#define MAT_POOL_MAX_BYTES (8 * 1024 * 1024)
+#endif
+#ifndef MAT_ARENA_CHUNK
+#define MAT_ARENA_CHUNK (256 * 1024)
+#endif
+
+/*
+ * 库内向系统申请内存的次数：mat_m、mat_m_ref、arena的大块、空闲链表未命中、dmat和gemm的缓冲区，
+ * bench_xxx用它统计每次操作的分配次数，不替换全局的operator new
+ */
+inline std::atomic<long long> g_mat_alloc_count{ 0 };
+
+inline void mat_count_alloc(const long long& n = 1)
+{
+	g_mat_alloc_count.fetch_add(n, std::memory_order_relaxed);
+}
+
+/*
+ * 按步分配的arena：一次训练步里产生的临时mat_m都从大块内存上顺序切出来，释放时只减引用计数，
+ * scope结束时如果没有块存活，把游标拨回第一个大块即可(O(1))，大块留给下一步复用，稳定后每步不再调用malloc
+ * 仍有块存活(逃逸)时这一批大块整体交给存活的块，最后一个块释放时归还系统，arena换一批新的大块，逃逸的块数记在stat里
+ */
+class mat_arena
+{
+public:
+	struct stat_t
+	{
+		size_t u_alloc_num = 0;					// 从arena分配的块数
+		size_t u_chunk_num = 0;					// 向系统申请大块的次数
+		size_t u_escaped = 0;					// scope结束时仍然存活的块数
+	};
+
+	/* 一批大块，引用计数为arena自身(1)加上存活的块数，可能在其它线程上减到0 */
+	class region
+	{
+		struct chunk
+		{
+			chunk* p_next;
+			size_t u_size;
+			size_t u_used;
+			unsigned char* data() { return reinterpret_cast<unsigned char*>(this + 1); }
+		};
+		chunk* m_p_head = nullptr;
+		chunk* m_p_cur = nullptr;
+		std::atomic<size_t> m_u_ref{ 1 };
+
+		chunk* new_chunk(const size_t& u_size)
+		{
+			mat_count_alloc();
+			chunk* p = static_cast<chunk*>(::operator new(sizeof(chunk) + u_size));
+			p->u_size = u_size;
+			p->u_used = 0;
+			return p;
+		}
+		~region()
+		{
+			for (chunk* p = m_p_head; p;)
+			{
+				chunk* p_next = p->p_next;
+				::operator delete(p);
+				p = p_next;
+			}
+		}
+	public:
+		/* 只在拥有者线程、scope生效时调用 */
+		void* allocate(const size_t& u_size, const size_t& u_align, stat_t& st)
+		{
+			for (;;)
+			{
+				if (m_p_cur)
+				{
+					uintptr_t u_base = reinterpret_cast<uintptr_t>(m_p_cur->data());
+					uintptr_t u_p = (u_base + m_p_cur->u_used + u_align - 1) & ~(uintptr_t(u_align) - 1);
+					if (u_p + u_size <= u_base + m_p_cur->u_size)
+					{
+						m_p_cur->u_used = u_p + u_size - u_base;
+						m_u_ref.fetch_add(1, std::memory_order_relaxed);
+						++st.u_alloc_num;
+						return reinterpret_cast<void*>(u_p);
+					}
+					chunk* p_next = m_p_cur->p_next;
+					if (p_next && p_next->u_size >= u_size + u_align)
+					{
+						m_p_cur = p_next;
+						m_p_cur->u_used = 0;
+						continue;
+					}
+				}
+				size_t u_chunk = u_size + u_align > MAT_ARENA_CHUNK ? u_size + u_align : MAT_ARENA_CHUNK;
+				chunk* p = new_chunk(u_chunk);
+				++st.u_chunk_num;
+				if (m_p_cur)
+				{
+					p->p_next = m_p_cur->p_next;
+					m_p_cur->p_next = p;
+				}
+				else
+				{
+					p->p_next = m_p_head;
+					m_p_head = p;
+				}
+				m_p_cur = p;
+			}
+		}
+		void release()
+		{
+			if (m_u_ref.fetch_sub(1, std::memory_order_acq_rel) == 1)
+				delete this;
+		}
+		size_t live() const { return m_u_ref.load(std::memory_order_acquire) - 1; }
+		/* 没有存活的块时把游标拨回第一个大块 */
+		void rewind()
+		{
+			m_p_cur = m_p_head;
+			if (m_p_cur)
+				m_p_cur->u_used = 0;
+		}
+	};
+
+	mat_arena() = default;
+	mat_arena(const mat_arena&) = delete;
+	mat_arena& operator=(const mat_arena&) = delete;
+	~mat_arena()
+	{
+		if (m_p_region)
+			m_p_region->release();
+	}
+
+	region* get_region()
+	{
+		if (!m_p_region)
+			m_p_region = new region;
+		return m_p_region;
+	}
+	stat_t& stat() { return m_stat; }
+	const stat_t& stat() const { return m_stat; }
+
+	/* scope结束：返回逃逸的块数 */
+	size_t reset()
+	{
+		if (!m_p_region)
+			return 0;
+		size_t u_live = m_p_region->live();
+		if (u_live == 0)
+		{
+			m_p_region->rewind();
+			return 0;
+		}
+		m_stat.u_escaped += u_live;
+		m_p_region->release();
+		m_p_region = nullptr;
+		return u_live;
+	}
+
+	/* 每个线程默认使用的arena */
+	static mat_arena& local()
+	{
+		thread_local mat_arena arena;
+		return arena;
+	}
+	/* 当前线程生效的arena，没有时为nullptr */
+	static mat_arena*& current()
+	{
+		thread_local mat_arena* p_arena = nullptr;
+		return p_arena;
+	}
+private:
+	region* m_p_region = nullptr;
+	stat_t m_stat;
+};
+
+/* 供allocate_shared使用，控制块和mat_m一起从arena分配，释放时只归还引用 */
+template<typename T>
+struct mat_arena_allocator
+{
+	using value_type = T;
+	mat_arena* p_arena;
+	mat_arena::region* p_region;
+
+	explicit mat_arena_allocator(mat_arena* p) :p_arena(p), p_region(p->get_region())
+	{
+	}
+	template<typename U>
+	mat_arena_allocator(const mat_arena_allocator<U>& other) : p_arena(other.p_arena), p_region(other.p_region)
+	{
+	}
+	T* allocate(const size_t& n)
+	{
+		return static_cast<T*>(p_region->allocate(n * sizeof(T), alignof(T), p_arena->stat()));
+	}
+	void deallocate(T*, const size_t&)
+	{
+		p_region->release();
+	}
+	template<typename U>
+	bool operator==(const mat_arena_allocator<U>& other) const { return p_region == other.p_region; }
+	template<typename U>
+	bool operator!=(const mat_arena_allocator<U>& other) const { return p_region != other.p_region; }
+};
+
+/*
+ * RAII：构造后当前线程新建的mat(堆存储部分)从arena分配，析构时整体释放
+ * 嵌套同一个arena时只有最外层的scope释放；需要带出scope的矩阵用mat_arena_escape复制一份，
+ * 已有独占内存的矩阵(网络成员等)在scope内被右值赋值时复制数据而不接管arena的内存，见heap_storage::operator=
+ */
+class mat_arena_scope
+{
+	mat_arena& m_arena;
+	mat_arena* m_p_prev;
+public:
+	explicit mat_arena_scope(mat_arena& arena = mat_arena::local()) :m_arena(arena), m_p_prev(mat_arena::current())
+	{
+		mat_arena::current() = &m_arena;
+	}
+	mat_arena_scope(const mat_arena_scope&) = delete;
+	mat_arena_scope& operator=(const mat_arena_scope&) = delete;
+	~mat_arena_scope()
+	{
+		mat_arena::current() = m_p_prev;
+		if (m_p_prev != &m_arena)
+			m_arena.reset();
+	}
+};
+
+/* RAII：暂停当前线程的arena，期间的分配走普通的堆 */
+class mat_arena_pause
+{
+	mat_arena* m_p_prev;
+public:
+	mat_arena_pause() :m_p_prev(mat_arena::current())
+	{
+		mat_arena::current() = nullptr;
+	}
+	mat_arena_pause(const mat_arena_pause&) = delete;
+	mat_arena_pause& operator=(const mat_arena_pause&) = delete;
+	~mat_arena_pause()
+	{
+		mat_arena::current() = m_p_prev;
+	}
+};
+
+/*
+ * 按大小复用的空闲链表：同一形状的mat_m(连同shared_ptr的控制块)大小相同，释放后挂在(字节数, 对齐)对应的链表上，
+ * 下次申请同样大小时直接取出，不再调用malloc；空闲块的前几个字节存放链表指针
+ * 每个线程有自己的链表(不加锁)，一条链表超过MAT_POOL_LIST_MAX块时把一半交给全局链表(加锁)，
+ * 本线程的链表为空时先从全局链表取，因此在别的线程释放的块也能回到申请它的线程；线程退出时空闲块全部交给全局链表
+ * 线程和全局各自最多保留MAT_POOL_MAX_BYTES字节，超出的块以及大小种类超过MAT_POOL_CLASS_NUM时直接归还系统
+ */
+class mat_pool
+{
+public:
+	struct stat_t
+	{
+		size_t u_hit = 0;						// 从空闲链表取到的块数
+		size_t u_miss = 0;						// 调用系统分配的块数
+		size_t u_bytes_retained = 0;			// 空闲链表上保留的字节数
+	};
+private:
+	struct free_block
+	{
+		free_block* p_next;
+	};
+	struct size_class
+	{
+		size_t u_size = 0;						// 0表示空位
+		size_t u_align = 0;
+		free_block* p_head = nullptr;
+		size_t u_count = 0;
+	};
+	/* 按字节数开放寻址的链表表，线程和全局各一份 */
+	struct class_table
+	{
+		size_class sz_class[MAT_POOL_CLASS_NUM];
+		size_t u_bytes = 0;
+
+		size_class* find(const size_t& u_size, const size_t& u_align)
+		{
+			size_t u_idx = (u_size / alignof(std::max_align_t)) % MAT_POOL_CLASS_NUM;
+			for (int i = 0; i < MAT_POOL_CLASS_NUM; ++i)
+			{
+				size_class& sc = sz_class[(u_idx + i) % MAT_POOL_CLASS_NUM];
+				if (sc.u_size == u_size && sc.u_align == u_align)
+					return &sc;
+				if (sc.u_size == 0)
+				{
+					sc.u_size = u_size;
+					sc.u_align = u_align;
+					return &sc;
+				}
+			}
+			return nullptr;
+		}
+		void* pop(size_class& sc)
+		{
+			free_block* p = sc.p_head;
+			sc.p_head = p->p_next;
+			--sc.u_count;
+			u_bytes -= sc.u_size;
+			return p;
+		}
+		void push(size_class& sc, void* p)
+		{
+			free_block* p_block = static_cast<free_block*>(p);
+			p_block->p_next = sc.p_head;
+			sc.p_head = p_block;
+			++sc.u_count;
+			u_bytes += sc.u_size;
+		}
+	};
+	struct global_pool
+	{
+		std::mutex mtx;
+		class_table table;
+		stat_t st;							// 已退出线程的计数
+		std::atomic<size_t> u_bytes_hint{ 0 };	// table.u_bytes的副本，全局链表为空时不加锁
+	};
+	struct local_cache
+	{
+		class_table table;
+		stat_t st;
+
+		local_cache()
+		{
+			global();						// 保证全局链表比线程的缓存后析构
+		}
+		~local_cache()
+		{
+			local_exited() = true;
+			global_pool& g = global();
+			std::lock_guard<std::mutex> lock(g.mtx);
+			g.st.u_hit += st.u_hit;
+			g.st.u_miss += st.u_miss;
+			for (size_class& sc : table.sz_class)
+			{
+				size_class* p_global = sc.p_head ? g.table.find(sc.u_size, sc.u_align) : nullptr;
+				while (sc.p_head)
+				{
+					void* p = table.pop(sc);
+					if (p_global && g.table.u_bytes + sc.u_size <= MAT_POOL_MAX_BYTES)
+						g.table.push(*p_global, p);
+					else
+						sys_free(p, sc.u_align);
+				}
+			}
+			g.u_bytes_hint.store(g.table.u_bytes, std::memory_order_relaxed);
+		}
+	};
+
+	static global_pool& global()
+	{
+		static global_pool g;
+		return g;
+	}
+	static local_cache& local()
+	{
+		thread_local local_cache cache;
+		return cache;
+	}
+	/* 线程的缓存析构之后(例如静态对象析构时)释放的块直接归还系统 */
+	static bool& local_exited()
+	{
+		thread_local bool b_exited = false;
+		return b_exited;
+	}
+	static void* sys_alloc(const size_t& u_size, const size_t& u_align)
+	{
+		mat_count_alloc();
+		if (u_align > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+			return ::operator new(u_size, std::align_val_t(u_align));
+		return ::operator new(u_size);
+	}
+	static void sys_free(void* p, const size_t& u_align)
+	{
+		if (u_align > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+			::operator delete(p, std::align_val_t(u_align));
+		else
+			::operator delete(p);
+	}
+public:
+	static void* allocate(const size_t& u_size, const size_t& u_align)
+	{
+		if (local_exited())
+			return sys_alloc(u_size, u_align);
+		local_cache& cache = local();
+		size_class* p_sc = cache.table.find(u_size, u_align);
+		if (p_sc)
+		{
+			global_pool& g = global();
+			if (!p_sc->p_head && g.u_bytes_hint.load(std::memory_order_relaxed) != 0)
+			{
+				/* 从全局链表取回最多一半的容量 */
+				std::lock_guard<std::mutex> lock(g.mtx);
+				size_class* p_global = g.table.find(u_size, u_align);
+				for (int i = 0; p_global && p_global->p_head && i < MAT_POOL_LIST_MAX / 2; ++i)
+					cache.table.push(*p_sc, g.table.pop(*p_global));
+				g.u_bytes_hint.store(g.table.u_bytes, std::memory_order_relaxed);
+			}
+			if (p_sc->p_head)
+			{
+				++cache.st.u_hit;
+				return cache.table.pop(*p_sc);
+			}
+		}
+		++cache.st.u_miss;
+		return sys_alloc(u_size, u_align);
+	}
+	static void deallocate(void* p, const size_t& u_size, const size_t& u_align)
+	{
+		if (local_exited())
+		{
+			sys_free(p, u_align);
+			return;
+		}
+		local_cache& cache = local();
+		size_class* p_sc = cache.table.find(u_size, u_align);
+		if (!p_sc || cache.table.u_bytes + u_size > MAT_POOL_MAX_BYTES)
+		{
+			sys_free(p, u_align);
+			return;
+		}
+		cache.table.push(*p_sc, p);
+		if (p_sc->u_count > MAT_POOL_LIST_MAX)
+		{
+			/* 一半交给全局链表，其它线程(或者块的来源线程)可以取走 */
+			global_pool& g = global();
+			std::lock_guard<std::mutex> lock(g.mtx);
+			size_class* p_global = g.table.find(u_size, u_align);
+			while (p_sc->u_count > MAT_POOL_LIST_MAX / 2)
+			{
+				void* p_block = cache.table.pop(*p_sc);
+				if (p_global && g.table.u_bytes + u_size <= MAT_POOL_MAX_BYTES)
+					g.table.push(*p_global, p_block);
+				else
+					sys_free(p_block, u_align);
+			}
+			g.u_bytes_hint.store(g.table.u_bytes, std::memory_order_relaxed);
+		}
+	}
+	/* 当前线程的命中/未命中次数加上已退出线程的计数，保留字节数包括当前线程和全局链表 */
+	static stat_t stat()
+	{
+		stat_t st;
+		if (!local_exited())
+		{
+			local_cache& cache = local();
+			st = cache.st;
+			st.u_bytes_retained = cache.table.u_bytes;
+		}
+		global_pool& g = global();
+		std::lock_guard<std::mutex> lock(g.mtx);
+		st.u_hit += g.st.u_hit;
+		st.u_miss += g.st.u_miss;
+		st.u_bytes_retained += g.table.u_bytes;
+		return st;
+	}
+	/* 把当前线程和全局链表上的空闲块都归还系统 */
+	static void trim()
+	{
+		if (!local_exited())
+		{
+			local_cache& cache = local();
+			for (size_class& sc : cache.table.sz_class)
+				while (sc.p_head)
+					sys_free(cache.table.pop(sc), sc.u_align);
+		}
+		global_pool& g = global();
+		std::lock_guard<std::mutex> lock(g.mtx);
+		for (size_class& sc : g.table.sz_class)
+			while (sc.p_head)
+				sys_free(g.table.pop(sc), sc.u_align);
+		g.u_bytes_hint.store(0, std::memory_order_relaxed);
+	}
+};
+
+/* 无状态的分配器，供allocate_shared使用 */
+template<typename T>
+struct mat_pool_allocator
+{
+	using value_type = T;
+
+	mat_pool_allocator() = default;
+	template<typename U>
+	mat_pool_allocator(const mat_pool_allocator<U>&)
+	{
+	}
+	T* allocate(const size_t& n)
+	{
+		return static_cast<T*>(mat_pool::allocate(n * sizeof(T), block_align()));
+	}
+	void deallocate(T* p, const size_t& n)
+	{
+		mat_pool::deallocate(p, n * sizeof(T), block_align());
+	}
+	template<typename U>
+	bool operator==(const mat_pool_allocator<U>&) const { return true; }
+	template<typename U>
+	bool operator!=(const mat_pool_allocator<U>&) const { return false; }
+private:
+	/* 空闲块要能放下链表指针 */
+	static constexpr size_t block_align()
+	{
+		return alignof(T) > alignof(void*) ? alignof(T) : alignof(void*);
+	}
+};
+
+template<typename mat_m_t, typename... args_t>
+std::shared_ptr<mat_m_t> make_mat_m(args_t&&... args)
+{
+	if (mat_arena* p_arena = mat_arena::current())
+		return std::allocate_shared<mat_m_t>(mat_arena_allocator<mat_m_t>(p_arena), std::forward<args_t>(args)...);
+#if MAT_POOL
+	return std::allocate_shared<mat_m_t>(mat_pool_allocator<mat_m_t>(), std::forward<args_t>(args)...);
+#else
+	mat_count_alloc();
+	return std::make_shared<mat_m_t>(std::forward<args_t>(args)...);
+#endif
+}
+
+#endif
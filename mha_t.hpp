@@ -1,5 +1,6 @@
 #ifndef __MHA_T_HPP__
 #define __MHA_T_HPP__
+#include <string>
 #include <vector>
 
 #include "mat.hpp"
@@ -31,7 +32,7 @@ struct header_gen
         K = Wk.forward(input);         // K类型mat<token_len, data_num, val_t>
         V = Wv.forward(input);         // V类型mat<token_len, data_num, val_t>
 
-        auto sqrt_QtK = Q.t().dot(K) / std::sqrt(static_cast<double>(token_len));  // 计算Q和K的点积，得到注意力分数矩阵
+        mat<data_num, data_num, val_t> sqrt_QtK = Q.t().dot(K) / std::sqrt(static_cast<val_t>(token_len));  // 计算Q和K的点积，得到注意力分数矩阵
         if (domask)
         {
             // 如果需要掩码处理，可以在这里添加掩码逻辑
@@ -52,12 +53,14 @@ struct header_gen
         return V.dot(softmax_output.t());  // 返回经过注意力机制处理后的输出
     }
 
-    mat<token_len, data_num, val_t> backward(const mat<token_len, data_num, val_t>& delta)
+    // delta可以是mat或mat_view(例如mha_t里某个头部的误差)，只被dot读取，不必先复制成mat
+    template<typename delta_t>
+    mat<token_len, data_num, val_t> backward(const delta_t& delta)
     {
         // 求出误差对V的梯度
         auto dV = delta.dot(softmax_output);  // deltaV类型 mat<token_len, data_num, val_t>
-        auto deltaSoftmax = delta.t().dot(V);         // deltaSoftmax类型 mat<token_len, token_len, val_t>
-        auto deltaQK = deltaSoftmax*softmax_func.backward();
+        mat<data_num, data_num, val_t> deltaQK = delta.t().dot(V);         // deltaSoftmax类型 mat<token_len, token_len, val_t>
+        softmax_func.backward(deltaQK);  // 原地乘上softmax的导数
         /**
           对于$$C=A\cdot B$$，误差反向传播对A和B的偏导数为：
           $$\frac{\partial L}{\partial A} = \frac{\partial L}{\partial C} \cdot B^T$$
@@ -67,14 +70,14 @@ struct header_gen
           对K的梯度为：
           $$\frac{\partial L}{\partial K} = (\frac{\partial L}{\partial C})^T \cdot Q$$
          */
-        auto dQ = K.dot(deltaQK.t()) / std::sqrt(static_cast<double>(token_len));  // Q的梯度
-        auto dK = Q.dot(deltaQK) / std::sqrt(static_cast<double>(token_len));  // K的梯度
+        auto dQ = K.dot(deltaQK.t()) / std::sqrt(static_cast<val_t>(token_len));  // Q的梯度
+        auto dK = Q.dot(deltaQK) / std::sqrt(static_cast<val_t>(token_len));  // K的梯度
 
         auto deltaV = Wv.backward(dV);  // 更新V的权重，并反馈V的误差
-        auto deltaQ = Wq.backward(dQ);  // 更新Q的权重，并反馈Q的误差
-        auto deltaK = Wk.backward(dK);  // 更新K的权重，并反馈K的误差
+        deltaV += Wq.backward(dQ);  // 更新Q的权重，并反馈Q的误差
+        deltaV += Wk.backward(dK);  // 更新K的权重，并反馈K的误差
         // 返回误差
-        return deltaV + deltaQ + deltaK;  // 返回误差
+        return deltaV;  // 返回误差
     }
 
     void update_inert()
@@ -90,9 +93,10 @@ struct mha_t
 {
     using input_type = mat<token_len, data_num, val_t>;  // 输入类型
     using ret_type = mat<token_len, data_num, val_t>;  // 返回类型
+    using head_type = tensor_elem_t<token_len, data_num, val_t>;  // 头部输出作为元素的类型，所有头部的输出连续存放
     std::vector<header_gen<token_len, data_num, val_t>> headers;  // 多头注意力机制的多个头部
-    mat<header_num, 1, input_type> header_outputs;  // 每个头部的输出
-    bp<input_type, 1, nadam, ReLu, XavierGaussian, header_num, 1> WReLu;
+    mat<header_num, 1, head_type> header_outputs;  // 每个头部的输出
+    bp<head_type, 1, nadam, ReLu, XavierGaussian, header_num, 1> WReLu;
     bool domask;  // 是否使用掩码
 
     mha_t():domask(false)
@@ -105,21 +109,21 @@ struct mha_t
         // 使用输入对每个多头注意力头进行前向传播
         for (int i = 0; i < header_num; ++i)
         {
-            header_outputs.get(i, 0) = headers[i].forward(input, domask);  // 获取每个头部的输出
+            header_outputs.get(i, 0).view() = headers[i].forward(input, domask);  // 头部的输出直接写入header_outputs的第i格
         }
-        return WReLu.forward(header_outputs)[0];  // 将所有头部的输出通过ReLU和归一化层
+        return ret_type(WReLu.forward(header_outputs)[0]);  // 将所有头部的输出通过ReLU和归一化层
     }
 
     mat<token_len, data_num, val_t> backward(const mat<token_len, data_num, val_t>& delta)
     {
-        mat<1, 1, input_type> delta_out;
-        delta_out.get(0, 0) = delta;  // 将delta转换为适合WReLu的格式
+        mat<1, 1, head_type> delta_out;
+        delta_out.get(0, 0).view() = delta;  // 将delta转换为适合WReLu的格式
         auto delta_WReLu = WReLu.backward(delta_out);  // 反向传播到ReLU层
         // 返回每个头部的输出误差的和
         mat<token_len, data_num, val_t> delta_sum;
         for (int i = 0; i < header_num; ++i)
         {
-            delta_sum = delta_sum + headers[i].backward(delta_WReLu.get(i, 0));  // 累加每个头部的输出误差
+            delta_sum += headers[i].backward(delta_WReLu.get(i, 0).view());  // 累加每个头部的输出误差，头部误差以视图传入，不复制
         }
         return delta_sum;  // 返回总的误差
     }
@@ -156,17 +160,19 @@ struct cross_header_gen
         Q = Wq.forward(decoder_input);         // Q类型mat<token_len, data_num, val_t>
         K = Wk.forward(encoder_input);         // K类型mat<token_len, data_num, val_t>
         V = Wv.forward(encoder_input);         // V类型mat<token_len, data_num, val_t>
-        auto sqrt_QtK = Q.t().dot(K) / std::sqrt(static_cast<double>(token_len));  // 计算Q和K的点积，得到注意力分数矩阵
+        mat<encoder_data_num, decoder_data_num, val_t> sqrt_QtK = Q.t().dot(K) / std::sqrt(static_cast<val_t>(token_len));  // 计算Q和K的点积，得到注意力分数矩阵
         softmax_output = softmax_func.forward(sqrt_QtK);  // 缩放
         return V.dot(softmax_output.t());  // 返回经过注意力机制处理后的输出
     }
 
-    void backward(const ret_type& delta, encoder_input_type& encoder_delta, decoder_input_type& decoder_delta)
+    // delta可以是mat或mat_view，与header_gen::backward相同
+    template<typename delta_t>
+    void backward(const delta_t& delta, encoder_input_type& encoder_delta, decoder_input_type& decoder_delta)
     {
         // 求出误差对V的梯度
         auto dV = delta.dot(softmax_output);  // deltaV类型 mat<token_len, data_num, val_t>
-        auto deltaSoftmax = delta.t().dot(V);         // deltaSoftmax类型 mat<token_len, token_len, val_t>
-        auto deltaQK = deltaSoftmax*softmax_func.backward();
+        mat<encoder_data_num, decoder_data_num, val_t> deltaQK = delta.t().dot(V);         // deltaSoftmax类型 mat<token_len, token_len, val_t>
+        softmax_func.backward(deltaQK);  // 原地乘上softmax的导数
         /**
           对于$$C=A\cdot B$$，误差反向传播对A和B的偏导数为：
           $$\frac{\partial L}{\partial A} = \frac{\partial L}{\partial C} \cdot B^T$$
@@ -176,8 +182,8 @@ struct cross_header_gen
           对K的梯度为：
           $$\frac{\partial L}{\partial K} = (\frac{\partial L}{\partial C})^T \cdot Q$$
          */
-        auto dQ = K.dot(deltaQK.t()) / std::sqrt(static_cast<double>(token_len));  // Q的梯度
-        auto dK = Q.dot(deltaQK) / std::sqrt(static_cast<double>(token_len));  // K的梯度
+        auto dQ = K.dot(deltaQK.t()) / std::sqrt(static_cast<val_t>(token_len));  // Q的梯度
+        auto dK = Q.dot(deltaQK) / std::sqrt(static_cast<val_t>(token_len));  // K的梯度
 
         auto deltaV = Wv.backward(dV);  // 更新V的权重，并反馈V的误差
         decoder_delta = Wq.backward(dQ);  // 更新Q的权重，并反馈Q的误差
@@ -200,9 +206,10 @@ struct cross_mha_t
     using decoder_input_type = mat<token_len, decoder_data_num, val_t>;  // 输入类型
     using ret_type = mat<token_len, decoder_data_num, val_t>;  // 返回类型
     using head_gen_t = cross_header_gen<token_len, encoder_data_num, decoder_data_num, val_t>;
+    using head_type = tensor_elem_t<token_len, decoder_data_num, val_t>;  // 头部输出作为元素的类型，所有头部的输出连续存放
     std::vector<head_gen_t> headers;  // 多头注意力机制的多个头部
-    mat<header_num, 1, decoder_input_type> header_outputs;  // 每个头部的输出，会被串成一列送入BP
-    bp<decoder_input_type, 1, nadam, ReLu, XavierGaussian, header_num, 1> WReLu;
+    mat<header_num, 1, head_type> header_outputs;  // 每个头部的输出，会被串成一列送入BP
+    bp<head_type, 1, nadam, ReLu, XavierGaussian, header_num, 1> WReLu;
 
     cross_mha_t()
     {
@@ -214,15 +221,15 @@ struct cross_mha_t
         // 使用输入对每个多头注意力头进行前向传播
         for (int i = 0; i < header_num; ++i)
         {
-            header_outputs.get(i, 0) = headers[i].forward(encoder_input, decoder_input);  // 获取每个头部的输出
+            header_outputs.get(i, 0).view() = headers[i].forward(encoder_input, decoder_input);  // 头部的输出直接写入header_outputs的第i格
         }
-        return WReLu.forward(header_outputs)[0];  // 将所有头部的输出通过ReLU和归一化层
+        return ret_type(WReLu.forward(header_outputs)[0]);  // 将所有头部的输出通过ReLU和归一化层
     }
 
     void backward(const ret_type& delta, encoder_input_type& encoder_delta, decoder_input_type& decoder_delta)
     {
-        mat<1, 1, ret_type> delta_out;
-        delta_out.get(0, 0) = delta;  // 将delta转换为适合WReLu的格式
+        mat<1, 1, head_type> delta_out;
+        delta_out.get(0, 0).view() = delta;  // 将delta转换为适合WReLu的格式
         auto delta_WReLu = WReLu.backward(delta_out);  // 反向传播到ReLU层
         // 返回每个头部的输出误差的和
         encoder_input_type encoder_delta_cur;
@@ -231,7 +238,7 @@ struct cross_mha_t
         decoder_delta = 0.;
         for (int i = 0; i < header_num; ++i)
         {
-            headers[i].backward(delta_WReLu.get(i, 0), encoder_delta_cur, decoder_delta_cur);  // 累加每个头部的输出误差
+            headers[i].backward(delta_WReLu.get(i, 0).view(), encoder_delta_cur, decoder_delta_cur);  // 累加每个头部的输出误差，头部误差以视图传入，不复制
             encoder_delta += encoder_delta_cur;
             decoder_delta += decoder_delta_cur;
         }
@@ -285,4 +292,24 @@ void read_file(ht_memory& mry, mha::mha_t<token_len, data_num, header_num, val_t
     read_file(mry, mha.WReLu);  // 从文件中读取ReLU层
 }
 
+// Q、K、V三个权重网络的矩阵名以prefix + "Wq."、"Wk."、"Wv."开头(见tensor_file.hpp)
+template<int token_len, int data_num, typename val_t, typename visitor_t>
+void visit_tensors(mha::header_gen<token_len, data_num, val_t>& header, const std::string& prefix, visitor_t&& v)
+{
+    visit_tensors(header.Wq, prefix + "Wq.", v);
+    visit_tensors(header.Wk, prefix + "Wk.", v);
+    visit_tensors(header.Wv, prefix + "Wv.", v);
+}
+
+// 第i个头以prefix + "head{i}."开头，输出层以prefix + "WReLu."开头，WReLu的元素是矩阵，展开成四维张量
+template<int token_len, int data_num, int header_num, typename val_t, typename visitor_t>
+void visit_tensors(mha::mha_t<token_len, data_num, header_num, val_t>& mha, const std::string& prefix, visitor_t&& v)
+{
+    for (int i = 0; i < header_num; ++i)
+    {
+        visit_tensors(mha.headers[i], prefix + "head" + std::to_string(i) + ".", v);
+    }
+    visit_tensors(mha.WReLu, prefix + "WReLu.", v);
+}
+
 #endif
@@ -1,11 +1,13 @@
 #ifndef __PROXY_DBN_T_HPP__
 #define __PROXY_DBN_T_HPP__
 
+#include <string>
 #include <thread>
 #include <vector>
 
 #include "bp.hpp"
 #include "dbn_t.hpp"
+#include "tensor_file.hpp"
 
 // DBN中的RBM进行学习，然后通过多个bp神经网络进行微调
 template<int predict_num, typename val_t, int first_input_row, int...args>
@@ -61,7 +63,7 @@ struct predict_net_t
         input_type input;
         for (int i = 0; i < predict_num; ++i)
         {
-            auto&& bp_out = m_bps[i].backward(m_softmax[i].backward(ret.col(i)));    // 反向传播
+            auto&& bp_out = m_bps[i].backward(m_softmax[i].backward(ret.col_view(i)));    // 反向传播
             for (int j = 0; j < bp_type::input_type::r; ++j)
             {
                 input.get(j, 0) += bp_out.get(j, 0);    // 将每个BP的输入结果累加到input
@@ -75,7 +77,7 @@ struct predict_net_t
         for (int i = 0; i < predict_num; ++i)
         {
             threads.emplace_back([&, i]() {
-                deltas[i] = m_bps[i].backward(m_softmax[i].backward(ret.col(i)));    // 反向传播
+                deltas[i] = m_bps[i].backward(m_softmax[i].backward(ret.col_view(i)));    // 反向传播
             });
         }
         // 等待所有线程完成
@@ -119,6 +121,24 @@ void read_file(predict_net_t<predict_num, val_t, args...>& net, ht_memory& mry)
     }
 }
 
+// 第i个预测头的BP网络和Softmax层，矩阵名以prefix + "bp."、"softmax."开头
+template<int predict_num, typename val_t, int...args, typename visitor_t>
+void visit_head(predict_net_t<predict_num, val_t, args...>& net, const int& i, const std::string& prefix, visitor_t&& v)
+{
+    visit_tensors(net.m_bps[i], prefix + "bp.", v);
+    visit_tensors(net.m_softmax[i], prefix + "softmax.", v);
+}
+
+// 第i个预测头以prefix + "head{i}."开头(见tensor_file.hpp)
+template<int predict_num, typename val_t, int...args, typename visitor_t>
+void visit_tensors(predict_net_t<predict_num, val_t, args...>& net, const std::string& prefix, visitor_t&& v)
+{
+    for (int i = 0; i < predict_num; ++i)
+    {
+        visit_head(net, i, prefix + "head" + std::to_string(i) + ".", v);
+    }
+}
+
 struct predict_result
 {
     int idx;            // 预测结果的索引
@@ -166,7 +186,8 @@ public:
     }
 
     // 获取最大值的索引
-    static int get_max_index(const mat<200, 1, double>& mt_out, double& d_poss)
+    template<typename col_t>
+    static int get_max_index(const col_t& mt_out, double& d_poss)
     {
         int idx = 0;
         d_poss = mt_out.get(0, 0);
@@ -188,11 +209,37 @@ public:
         for (int c = 0; c < output_num; ++c)
         {
             predict_result result;
-            result.idx = get_max_index(mt_out.col(c), result.d_poss);    // 获取最大值的索引和概率
+            result.idx = get_max_index(mt_out.col_view(c), result.d_poss);    // 获取最大值的索引和概率
             vec_result.push_back(result);    // 将结果添加到结果向量中
         }
     }
+
+    // 模型的所有矩阵(见tensor_file.hpp)，write_tensor_file(proxy, mry)写出整个模型，tf.read("", proxy)读取整个模型
+    template<typename visitor_t>
+    void visit_tensors(const std::string& prefix, visitor_t&& v)
+    {
+        ::visit_tensors(m_dbn, prefix, v);
+    }
+
+    // 只读取第i个预测头，文件中的RBM和其它预测头不解析、不访问
+    int load_head(const tensor_file& tf, const int& i, const std::string& prefix = "")
+    {
+        if (i < 0 || i >= output_num)
+        {
+            return TF_NOT_FOUND;
+        }
+        auto& net = m_dbn.predict();
+        return tf.read_tensors([&](auto&& v) {
+            visit_head(net, i, prefix + "predict.head" + std::to_string(i) + ".", v);
+        });
+    }
 };
 
+template<typename trans_name, typename raw_data_type, int output_num, typename visitor_t>
+void visit_tensors(proxy_dbn_t<trans_name, raw_data_type, output_num>& proxy, const std::string& prefix, visitor_t&& v)
+{
+    proxy.visit_tensors(prefix, v);
+}
+
 
 #endif
@@ -1,5 +1,6 @@
 #ifndef _RESTRICKED_BOLTZMAN_MACHINE_HPP_
 #define _RESTRICKED_BOLTZMAN_MACHINE_HPP_
+#include <string>
 #include "mat.hpp"
 #include "base_logic.hpp"
 #include "activate_function.hpp"
@@ -9,10 +10,18 @@
 static std::default_random_engine e;
 static std::uniform_real_distribution<double> ud(0., 1.);
 
+/* [0, 1)的均匀随机数，按元素类型生成，float不再先生成double再比较 */
+template<typename vt>
+inline vt rand_unit()
+{
+	static std::uniform_real_distribution<vt> ud_vt(vt(0.), vt(1.));
+	return ud_vt(e);
+}
+
 template<int r, int c>
 struct bi_mat_accumulate
 {
-	template<typename imatt, typename vt = double>
+	template<typename imatt, typename vt = typename imatt::type>
 	static vt cal(const imatt& mt, const vt& v_threshold, int* const p_accu_num_out)
 	{
 		vt v_ret;
@@ -33,7 +42,7 @@ struct bi_mat_accumulate
 template<int r, int c>
 struct bi_mat
 {
-	template<typename imatt, typename vt = double>
+	template<typename imatt, typename vt = typename imatt::type>
 	static vt cal(const imatt& mt, const vt& v_threshold)
 	{
 		vt v_ret;
@@ -53,31 +62,31 @@ template<typename target_t>
 target_t bi(const target_t& mt_input) 
 {
 	target_t mt_output;
-	col_loop<target_t::c - 1, bi_mat>(mt_output, mt_input, .5);
+	elem_map<bi_mat>(mt_output, mt_input, .5);
 	return mt_output;
 }
 
 template<int r, int c>
 struct n_choice
 {
-	template<typename imatt, typename vt = double>
+	template<typename imatt, typename vt = typename imatt::type>
 	static vt cal(const imatt& mt_ratio)
 	{
 		auto d_ratio = mt_ratio.get(r,c);
-		double d_rand = ud(e);
+		vt d_rand = rand_unit<vt>();
 		//printf("input:%lf, rand:%lf\r\n", d_ratio, d_rand);
-		return d_ratio < d_rand ? 0. : 1.;
+		return d_ratio < d_rand ? vt(0.) : vt(1.);
 	}
 };
 
 // 从输入矩阵mt_ratio中获取第r行第c列的值，
 // 与随机数比较，返回0或1
-template<typename imatt, typename vt = double>
+template<typename imatt, typename vt = typename imatt::type>
 vt f_choice(const imatt& mt_ratio, const int r, const int c)
 {
 	auto d_ratio = mt_ratio.get(r,c);
-	double d_rand = ud(e);
-	return d_ratio < d_rand ? 0. : 1.;
+	vt d_rand = rand_unit<vt>();
+	return d_ratio < d_rand ? vt(0.) : vt(1.);
 }
 
 // 对输入矩阵mt_input进行采样，返回一个新的矩阵mt_output
@@ -86,14 +95,7 @@ template<typename target_t>
 target_t choice(const target_t& mt_input) 
 {
 	target_t mt_output;
-	//col_loop<target_t::c - 1, n_choice>(mt_output, mt_input);
-	for (int i = 0; i < mt_input.r; ++i)
-	{
-		for (int j = 0; j < mt_input.c; ++j)
-		{
-			mt_output.get(i, j) = f_choice(mt_input, i, j);
-		}
-	}
+	elem_map<n_choice>(mt_output, mt_input);
 	return mt_output;
 }
 
@@ -110,17 +112,10 @@ struct restricked_boltzman_machine
 
 
 	template<typename T>
-	T prob_func(const T& t_in) 
+	mat<T::r, T::c, typename T::type> prob_func(const T& t_in) 
 	{
-		T t_out;
-		//col_loop<T::c - 1, n_sigmoid>(t_out, t_in);
-		for (int i = 0; i < t_in.r; ++i)
-		{
-			for (int j = 0; j < t_in.c; ++j)
-			{
-				t_out.get(i, j) = f_sigmoid(t_in.get(i, j));
-			}
-		}
+		mat<T::r, T::c, typename T::type> t_out;
+		elem_map<n_sigmoid>(t_out, t_in);
 		return t_out;
 	}
 
@@ -143,9 +138,9 @@ struct restricked_boltzman_machine
 		auto cdw = v2.dot(h2.t()) - v1.dot(h1.t());
 		auto cdv = (v2 - v1);
 		auto cdh = (h2 - h1);
-		W = W_updater.update(W, cdw);
-		a = a_updater.update(a, cdv);
-		b = b_updater.update(b, cdh);
+		W_updater.step(W, cdw);
+		a_updater.step(a, cdv);
+		b_updater.step(b, cdh);
 	}
 
 	// 显层输入，求出隐层输出
@@ -219,4 +214,13 @@ void read_file(ht_memory& mry, restricked_boltzman_machine<v_num, h_num, val_t>&
 	mry.read(rbm.b);
 }
 
+/* 权值和两个偏移分别为prefix + "W"、"a"、"b"(见tensor_file.hpp)，更新器的状态不保存 */
+template<int v_num, int h_num, typename val_t, template<typename> class um_tpl, typename visitor_t>
+void visit_tensors(restricked_boltzman_machine<v_num, h_num, val_t, um_tpl>& rbm, const std::string& prefix, visitor_t&& v)
+{
+	visit_tensors(rbm.W, prefix + "W", v);
+	visit_tensors(rbm.a, prefix + "a", v);
+	visit_tensors(rbm.b, prefix + "b", v);
+}
+
 #endif
@@ -0,0 +1,1016 @@
+#ifndef _SIMD_KERNEL_HPP_
+#define _SIMD_KERNEL_HPP_
+#include <math.h>
+#include <float.h>
+#include <limits>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+/*
+ * 逐元素运算和归约的SIMD内核，作用在mat的连续内存pval->p上
+ * 启动后第一次使用时通过CPUID选择SSE2/AVX2/AVX-512中可用的最高一级，double和float各有一套，其它平台或其它元素类型走标量版本
+ * 各指令集的实现只有基本操作(v_load、v_add……)不同，算法部分由SIMD_KERNEL_ALGORITHMS展开，
+ * 每个指令集的结构体都在对应的target区域内定义，保证内联后的代码用的是该指令集
+ */
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define MAT_SIMD_X86 1
+#define MAT_SIMD_GNUC 1
+#include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define MAT_SIMD_X86 1
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+/* 元素个数达到MAT_SIMD_MIN_SIZE的矩阵才调用内核，表达式按MAT_EXPR_BLOCK个元素一块求值 */
+#ifndef MAT_SIMD_MIN_SIZE
+#define MAT_SIMD_MIN_SIZE 32
+#endif
+
+#ifndef MAT_EXPR_BLOCK
+#define MAT_EXPR_BLOCK 256
+#endif
+
+enum simd_level_t
+{
+	SIMD_SCALAR = 0,
+	SIMD_SSE2 = 1,
+	SIMD_AVX2 = 2,
+	SIMD_AVX512 = 3,
+};
+
+inline int simd_detect_level()
+{
+#if defined(MAT_SIMD_GNUC)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f"))
+		return SIMD_AVX512;
+	if (__builtin_cpu_supports("avx2"))
+		return SIMD_AVX2;
+	if (__builtin_cpu_supports("sse2"))
+		return SIMD_SSE2;
+	return SIMD_SCALAR;
+#elif defined(MAT_SIMD_X86)
+	int sz_info[4] = { 0 };
+	__cpuid(sz_info, 0);
+	const int i_max_leaf = sz_info[0];
+	__cpuid(sz_info, 1);
+	const bool b_sse2 = (sz_info[3] & (1 << 26)) != 0;
+	const bool b_osxsave = (sz_info[2] & (1 << 27)) != 0;
+	const bool b_avx = (sz_info[2] & (1 << 28)) != 0;
+	if (!b_sse2)
+		return SIMD_SCALAR;
+	if (!b_osxsave || !b_avx || i_max_leaf < 7)
+		return SIMD_SSE2;
+	const unsigned long long ull_xcr0 = _xgetbv(0);
+	if ((ull_xcr0 & 0x6) != 0x6)
+		return SIMD_SSE2;
+	__cpuidex(sz_info, 7, 0);
+	if ((sz_info[1] & (1 << 16)) && (ull_xcr0 & 0xe6) == 0xe6)
+		return SIMD_AVX512;
+	if (sz_info[1] & (1 << 5))
+		return SIMD_AVX2;
+	return SIMD_SSE2;
+#else
+	return SIMD_SCALAR;
+#endif
+}
+
+/* 标量版本，也是double、float以外类型使用的版本，语义与原来的逐元素循环一致 */
+template<typename val_t>
+struct simd_scalar
+{
+	static void add(const val_t* a, const val_t* b, val_t* o, int n) { for (int i = 0; i < n; ++i) o[i] = a[i] + b[i]; }
+	static void sub(const val_t* a, const val_t* b, val_t* o, int n) { for (int i = 0; i < n; ++i) o[i] = a[i] - b[i]; }
+	static void mul(const val_t* a, const val_t* b, val_t* o, int n) { for (int i = 0; i < n; ++i) o[i] = a[i] * b[i]; }
+	static void div(const val_t* a, const val_t* b, val_t* o, int n) { for (int i = 0; i < n; ++i) o[i] = a[i] / b[i]; }
+	static void add_s(const val_t* a, val_t v, val_t* o, int n) { for (int i = 0; i < n; ++i) o[i] = a[i] + v; }
+	static void sub_s(const val_t* a, val_t v, val_t* o, int n) { for (int i = 0; i < n; ++i) o[i] = a[i] - v; }
+	static void rsub_s(const val_t* a, val_t v, val_t* o, int n) { for (int i = 0; i < n; ++i) o[i] = v - a[i]; }
+	static void mul_s(const val_t* a, val_t v, val_t* o, int n) { for (int i = 0; i < n; ++i) o[i] = a[i] * v; }
+	static void div_s(const val_t* a, val_t v, val_t* o, int n) { for (int i = 0; i < n; ++i) o[i] = a[i] / v; }
+	static void rdiv_s(const val_t* a, val_t v, val_t* o, int n) { for (int i = 0; i < n; ++i) o[i] = v / a[i]; }
+	/* o += a*v，支持fma的指令集上可能被合成一次fma */
+	static void mul_add_s(const val_t* a, val_t v, val_t* o, int n) { for (int i = 0; i < n; ++i) o[i] = o[i] + a[i] * v; }
+	/* o = a*v，a是uint8(例如IDX文件中的像素) */
+	static void from_u8(const unsigned char* a, val_t v, val_t* o, int n) { for (int i = 0; i < n; ++i) o[i] = static_cast<val_t>(a[i]) * v; }
+	static void exp(const val_t* a, val_t* o, int n) { for (int i = 0; i < n; ++i) o[i] = static_cast<val_t>(std::exp(a[i])); }
+	static void sqrt(const val_t* a, val_t* o, int n)
+	{
+		/* float不经过long double，直接按float开方 */
+		for (int i = 0; i < n; ++i)
+		{
+			if constexpr (std::is_same<val_t, float>::value)
+				o[i] = std::sqrt(a[i]);
+			else
+				o[i] = static_cast<val_t>(sqrtl(a[i]));
+		}
+	}
+	static void abs(const val_t* a, val_t* o, int n) { for (int i = 0; i < n; ++i) o[i] = std::abs(a[i]); }
+
+	static val_t sum(const val_t* a, int n)
+	{
+		val_t d_sum = 0.;
+		for (int i = 0; i < n; ++i)
+			d_sum = d_sum + a[i];
+		return d_sum;
+	}
+
+	static val_t max(const val_t* a, int n)
+	{
+		val_t d = std::numeric_limits<val_t>::lowest();
+		for (int i = 0; i < n; ++i)
+			d = a[i] < d ? d : a[i];
+		return d;
+	}
+
+	static val_t max_abs(const val_t* a, int n)
+	{
+		val_t d = std::numeric_limits<val_t>::lowest();
+		for (int i = 0; i < n; ++i)
+			d = d < std::abs(a[i]) ? std::abs(a[i]) : d;
+		return d;
+	}
+
+	/* 第一个最大值的下标 */
+	static int argmax(const val_t* a, int n)
+	{
+		int i_idx = 0;
+		for (int i = 1; i < n; ++i)
+		{
+			if (a[i_idx] < a[i])
+				i_idx = i;
+		}
+		return i_idx;
+	}
+
+	/* o = exp(a - max(a)) / sum，先求最大值保证数值稳定，最后乘以和的倒数 */
+	static void softmax(const val_t* a, val_t* o, int n)
+	{
+		const val_t d_max = max(a, n);
+		for (int i = 0; i < n; ++i)
+			o[i] = static_cast<val_t>(std::exp(a[i] - d_max));
+		const val_t d_inv = val_t(1) / sum(o, n);
+		for (int i = 0; i < n; ++i)
+			o[i] = o[i] * d_inv;
+	}
+
+	/* 行主序rows*cols的矩阵按列各自做softmax */
+	static void softmax_cols(const val_t* a, val_t* o, int rows, int cols)
+	{
+		for (int j = 0; j < cols; ++j)
+		{
+			val_t d_max = std::numeric_limits<val_t>::lowest();
+			for (int i = 0; i < rows; ++i)
+				d_max = a[i * cols + j] < d_max ? d_max : a[i * cols + j];
+			val_t d_sum = 0.;
+			for (int i = 0; i < rows; ++i)
+			{
+				o[i * cols + j] = static_cast<val_t>(std::exp(a[i * cols + j] - d_max));
+				d_sum = d_sum + o[i * cols + j];
+			}
+			const val_t d_inv = val_t(1) / d_sum;
+			for (int i = 0; i < rows; ++i)
+				o[i * cols + j] = o[i * cols + j] * d_inv;
+		}
+	}
+};
+
+#ifdef MAT_SIMD_X86
+
+/*
+ * 各指令集共用的算法，要求结构体内已经定义elem_t、reg_t、W以及v_xxx基本操作
+ * exp：x = n*ln2 + r，|r| <= ln2/2，e^r的double版本用13阶泰勒展开，float版本用7阶，
+ * 2^n拆成两个2的幂相乘以覆盖次正规数和上溢边界
+ * softmax：求最大值只做比较，exp、写回与求和合在一遍里，最后一遍乘以和的倒数(除法比乘法慢得多)；
+ * softmax_cols一次处理W列，列数不足W时经过栈上的缓冲区
+ */
+#define SIMD_BINARY_KERNEL(name, vop, sop) \
+	static void name(const elem_t* a, const elem_t* b, elem_t* o, int n) \
+	{ \
+		int i = 0; \
+		for (; i + W <= n; i += W) \
+			v_store(o + i, vop(v_load(a + i), v_load(b + i))); \
+		for (; i < n; ++i) \
+			o[i] = a[i] sop b[i]; \
+	}
+
+#define SIMD_SCALAR_KERNEL(name, vop, sop, b_left) \
+	static void name(const elem_t* a, elem_t v, elem_t* o, int n) \
+	{ \
+		const reg_t rv = v_set1(v); \
+		int i = 0; \
+		for (; i + W <= n; i += W) \
+			v_store(o + i, b_left ? vop(rv, v_load(a + i)) : vop(v_load(a + i), rv)); \
+		for (; i < n; ++i) \
+			o[i] = b_left ? (v sop a[i]) : (a[i] sop v); \
+	}
+
+#define SIMD_KERNEL_ALGORITHMS \
+	SIMD_BINARY_KERNEL(add, v_add, +) \
+	SIMD_BINARY_KERNEL(sub, v_sub, -) \
+	SIMD_BINARY_KERNEL(mul, v_mul, *) \
+	SIMD_BINARY_KERNEL(div, v_div, /) \
+	SIMD_SCALAR_KERNEL(add_s, v_add, +, false) \
+	SIMD_SCALAR_KERNEL(sub_s, v_sub, -, false) \
+	SIMD_SCALAR_KERNEL(rsub_s, v_sub, -, true) \
+	SIMD_SCALAR_KERNEL(mul_s, v_mul, *, false) \
+	SIMD_SCALAR_KERNEL(div_s, v_div, /, false) \
+	SIMD_SCALAR_KERNEL(rdiv_s, v_div, /, true) \
+	static void mul_add_s(const elem_t* a, elem_t v, elem_t* o, int n) \
+	{ \
+		const reg_t rv = v_set1(v); \
+		int i = 0; \
+		for (; i + W <= n; i += W) \
+			v_store(o + i, v_add(v_load(o + i), v_mul(v_load(a + i), rv))); \
+		for (; i < n; ++i) \
+			o[i] = o[i] + a[i] * v; \
+	} \
+	static void from_u8(const unsigned char* a, elem_t v, elem_t* o, int n) \
+	{ \
+		const reg_t rv = v_set1(v); \
+		int i = 0; \
+		for (; i + W <= n; i += W) \
+			v_store(o + i, v_mul(v_load_u8(a + i), rv)); \
+		for (; i < n; ++i) \
+			o[i] = static_cast<elem_t>(a[i]) * v; \
+	} \
+	static void exp(const elem_t* a, elem_t* o, int n) \
+	{ \
+		int i = 0; \
+		for (; i + W <= n; i += W) \
+			v_store(o + i, v_exp(v_load(a + i))); \
+		if (i < n) \
+		{ \
+			elem_t sz_buf[W] = { 0 }; \
+			for (int j = i; j < n; ++j) sz_buf[j - i] = a[j]; \
+			v_store(sz_buf, v_exp(v_load(sz_buf))); \
+			for (int j = i; j < n; ++j) o[j] = sz_buf[j - i]; \
+		} \
+	} \
+	static void sqrt(const elem_t* a, elem_t* o, int n) \
+	{ \
+		int i = 0; \
+		for (; i + W <= n; i += W) \
+			v_store(o + i, v_sqrt(v_load(a + i))); \
+		for (; i < n; ++i) \
+			o[i] = std::sqrt(a[i]); \
+	} \
+	static void abs(const elem_t* a, elem_t* o, int n) \
+	{ \
+		int i = 0; \
+		for (; i + W <= n; i += W) \
+			v_store(o + i, v_abs(v_load(a + i))); \
+		for (; i < n; ++i) \
+			o[i] = std::fabs(a[i]); \
+	} \
+	static elem_t sum(const elem_t* a, int n) \
+	{ \
+		reg_t s0 = v_set1(elem_t(0)), s1 = s0, s2 = s0, s3 = s0; \
+		int i = 0; \
+		for (; i + 4 * W <= n; i += 4 * W) \
+		{ \
+			s0 = v_add(s0, v_load(a + i)); \
+			s1 = v_add(s1, v_load(a + i + W)); \
+			s2 = v_add(s2, v_load(a + i + 2 * W)); \
+			s3 = v_add(s3, v_load(a + i + 3 * W)); \
+		} \
+		for (; i + W <= n; i += W) \
+			s0 = v_add(s0, v_load(a + i)); \
+		elem_t d_sum = v_hsum(v_add(v_add(s0, s1), v_add(s2, s3))); \
+		for (; i < n; ++i) \
+			d_sum = d_sum + a[i]; \
+		return d_sum; \
+	} \
+	static elem_t max(const elem_t* a, int n) \
+	{ \
+		reg_t m0 = v_set1(std::numeric_limits<elem_t>::lowest()), m1 = m0; \
+		int i = 0; \
+		for (; i + 2 * W <= n; i += 2 * W) \
+		{ \
+			m0 = v_max(v_load(a + i), m0); \
+			m1 = v_max(v_load(a + i + W), m1); \
+		} \
+		for (; i + W <= n; i += W) \
+			m0 = v_max(v_load(a + i), m0); \
+		elem_t d = v_hmax(v_max(m0, m1)); \
+		for (; i < n; ++i) \
+			d = a[i] < d ? d : a[i]; \
+		return d; \
+	} \
+	static elem_t max_abs(const elem_t* a, int n) \
+	{ \
+		reg_t m0 = v_set1(std::numeric_limits<elem_t>::lowest()), m1 = m0; \
+		int i = 0; \
+		for (; i + 2 * W <= n; i += 2 * W) \
+		{ \
+			m0 = v_max(v_abs(v_load(a + i)), m0); \
+			m1 = v_max(v_abs(v_load(a + i + W)), m1); \
+		} \
+		for (; i + W <= n; i += W) \
+			m0 = v_max(v_abs(v_load(a + i)), m0); \
+		elem_t d = v_hmax(v_max(m0, m1)); \
+		for (; i < n; ++i) \
+			d = d < std::fabs(a[i]) ? std::fabs(a[i]) : d; \
+		return d; \
+	} \
+	static int argmax(const elem_t* a, int n) \
+	{ \
+		if (n <= 0) \
+			return 0; \
+		const elem_t d_max = max(a, n); \
+		for (int i = 0; i < n; ++i) \
+		{ \
+			if (a[i] == d_max) \
+				return i; \
+		} \
+		return simd_scalar<elem_t>::argmax(a, n); \
+	} \
+	static void softmax(const elem_t* a, elem_t* o, int n) \
+	{ \
+		const elem_t d_max = max(a, n); \
+		const reg_t rm = v_set1(d_max); \
+		reg_t s0 = v_set1(elem_t(0)), s1 = s0, s2 = s0, s3 = s0; \
+		int i = 0; \
+		for (; i + 4 * W <= n; i += 4 * W) \
+		{ \
+			const reg_t e0 = v_exp(v_sub(v_load(a + i), rm)); \
+			const reg_t e1 = v_exp(v_sub(v_load(a + i + W), rm)); \
+			const reg_t e2 = v_exp(v_sub(v_load(a + i + 2 * W), rm)); \
+			const reg_t e3 = v_exp(v_sub(v_load(a + i + 3 * W), rm)); \
+			v_store(o + i, e0); \
+			v_store(o + i + W, e1); \
+			v_store(o + i + 2 * W, e2); \
+			v_store(o + i + 3 * W, e3); \
+			s0 = v_add(s0, e0); \
+			s1 = v_add(s1, e1); \
+			s2 = v_add(s2, e2); \
+			s3 = v_add(s3, e3); \
+		} \
+		for (; i + W <= n; i += W) \
+		{ \
+			const reg_t e0 = v_exp(v_sub(v_load(a + i), rm)); \
+			v_store(o + i, e0); \
+			s0 = v_add(s0, e0); \
+		} \
+		elem_t d_sum = v_hsum(v_add(v_add(s0, s1), v_add(s2, s3))); \
+		if (i < n) \
+		{ \
+			elem_t sz_buf[W] = { 0 }; \
+			for (int j = i; j < n; ++j) sz_buf[j - i] = a[j] - d_max; \
+			v_store(sz_buf, v_exp(v_load(sz_buf))); \
+			for (int j = i; j < n; ++j) \
+			{ \
+				o[j] = sz_buf[j - i]; \
+				d_sum = d_sum + o[j]; \
+			} \
+		} \
+		mul_s(o, elem_t(1) / d_sum, o, n); \
+	} \
+	static void softmax_cols(const elem_t* a, elem_t* o, int rows, int cols) \
+	{ \
+		for (int j = 0; j < cols; j += W) \
+		{ \
+			const int w = cols - j < W ? cols - j : W; \
+			elem_t sz_buf[W] = { 0 }; \
+			auto load = [&](const elem_t* p) { if (w == W) return v_load(p); for (int k = 0; k < w; ++k) sz_buf[k] = p[k]; return v_load(sz_buf); }; \
+			auto store = [&](elem_t* p, reg_t v) { if (w == W) { v_store(p, v); return; } v_store(sz_buf, v); for (int k = 0; k < w; ++k) p[k] = sz_buf[k]; }; \
+			reg_t rm = v_set1(std::numeric_limits<elem_t>::lowest()); \
+			for (int i = 0; i < rows; ++i) \
+				rm = v_max(load(a + i * cols + j), rm); \
+			reg_t rs = v_set1(elem_t(0)); \
+			for (int i = 0; i < rows; ++i) \
+			{ \
+				const reg_t e = v_exp(v_sub(load(a + i * cols + j), rm)); \
+				store(o + i * cols + j, e); \
+				rs = v_add(rs, e); \
+			} \
+			rs = v_div(v_set1(elem_t(1)), rs); \
+			for (int i = 0; i < rows; ++i) \
+				store(o + i * cols + j, v_mul(load(o + i * cols + j), rs)); \
+		} \
+	}
+
+#define SIMD_EXP_F64 \
+	static reg_t v_exp(reg_t x) \
+	{ \
+		const reg_t magic = v_set1(6755399441055744.0); \
+		const reg_t xc = v_min(v_max(x, v_set1(-745.2)), v_set1(709.8)); \
+		const reg_t t = v_add(v_mul(xc, v_set1(1.4426950408889634)), magic); \
+		const reg_t rn = v_sub(t, magic); \
+		const reg_t r = v_sub(v_sub(xc, v_mul(rn, v_set1(6.93145751953125e-1))), v_mul(rn, v_set1(1.42860682030941723212e-6))); \
+		reg_t p = v_set1(1. / 6227020800.); \
+		p = v_add(v_mul(p, r), v_set1(1. / 479001600.)); \
+		p = v_add(v_mul(p, r), v_set1(1. / 39916800.)); \
+		p = v_add(v_mul(p, r), v_set1(1. / 3628800.)); \
+		p = v_add(v_mul(p, r), v_set1(1. / 362880.)); \
+		p = v_add(v_mul(p, r), v_set1(1. / 40320.)); \
+		p = v_add(v_mul(p, r), v_set1(1. / 5040.)); \
+		p = v_add(v_mul(p, r), v_set1(1. / 720.)); \
+		p = v_add(v_mul(p, r), v_set1(1. / 120.)); \
+		p = v_add(v_mul(p, r), v_set1(1. / 24.)); \
+		p = v_add(v_mul(p, r), v_set1(1. / 6.)); \
+		p = v_add(v_mul(p, r), v_set1(.5)); \
+		p = v_add(v_mul(p, r), v_set1(1.)); \
+		p = v_add(v_mul(p, r), v_set1(1.)); \
+		const reg_t t1 = v_add(v_sub(v_mul(rn, v_set1(.5)), v_set1(.25)), magic); \
+		const reg_t rn1 = v_sub(t1, magic); \
+		const reg_t t2 = v_add(v_sub(rn, rn1), magic); \
+		reg_t ret = v_mul(v_mul(p, v_pow2n(t1)), v_pow2n(t2)); \
+		ret = v_lt_blend(x, v_set1(-745.13321910194122), v_set1(0.), ret); \
+		ret = v_gt_blend(x, v_set1(709.78271289338397), v_set1(HUGE_VAL), ret); \
+		return v_nan_blend(x, x, ret); \
+	}
+
+#define SIMD_EXP_F32 \
+	static reg_t v_exp(reg_t x) \
+	{ \
+		const reg_t magic = v_set1(12582912.f); \
+		const reg_t xc = v_min(v_max(x, v_set1(-104.f)), v_set1(88.8f)); \
+		const reg_t t = v_add(v_mul(xc, v_set1(1.44269504f)), magic); \
+		const reg_t rn = v_sub(t, magic); \
+		const reg_t r = v_sub(v_sub(xc, v_mul(rn, v_set1(6.93359375e-1f))), v_mul(rn, v_set1(-2.12194440e-4f))); \
+		reg_t p = v_set1(1.f / 5040.f); \
+		p = v_add(v_mul(p, r), v_set1(1.f / 720.f)); \
+		p = v_add(v_mul(p, r), v_set1(1.f / 120.f)); \
+		p = v_add(v_mul(p, r), v_set1(1.f / 24.f)); \
+		p = v_add(v_mul(p, r), v_set1(1.f / 6.f)); \
+		p = v_add(v_mul(p, r), v_set1(.5f)); \
+		p = v_add(v_mul(p, r), v_set1(1.f)); \
+		p = v_add(v_mul(p, r), v_set1(1.f)); \
+		const reg_t t1 = v_add(v_sub(v_mul(rn, v_set1(.5f)), v_set1(.25f)), magic); \
+		const reg_t rn1 = v_sub(t1, magic); \
+		const reg_t t2 = v_add(v_sub(rn, rn1), magic); \
+		reg_t ret = v_mul(v_mul(p, v_pow2n(t1)), v_pow2n(t2)); \
+		ret = v_lt_blend(x, v_set1(-103.972084f), v_set1(0.f), ret); \
+		ret = v_gt_blend(x, v_set1(88.7228394f), v_set1(HUGE_VALF), ret); \
+		return v_nan_blend(x, x, ret); \
+	}
+
+/* 每个指令集对double和float各有一份特化，float一个寄存器装下两倍的元素 */
+template<typename elem_t> struct simd_sse2;
+template<typename elem_t> struct simd_avx2;
+template<typename elem_t> struct simd_avx512;
+
+#ifdef MAT_SIMD_GNUC
+#pragma GCC push_options
+#pragma GCC target("sse2")
+#endif
+template<>
+struct simd_sse2<double>
+{
+	using elem_t = double;
+	using reg_t = __m128d;
+	static constexpr int W = 2;
+	static reg_t v_load(const double* p) { return _mm_loadu_pd(p); }
+	static void v_store(double* p, reg_t v) { _mm_storeu_pd(p, v); }
+	static reg_t v_load_u8(const unsigned char* p)
+	{
+		uint16_t u;
+		memcpy(&u, p, sizeof(u));
+		const __m128i zero = _mm_setzero_si128();
+		return _mm_cvtepi32_pd(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(u), zero), zero));
+	}
+	static reg_t v_set1(double v) { return _mm_set1_pd(v); }
+	static reg_t v_add(reg_t a, reg_t b) { return _mm_add_pd(a, b); }
+	static reg_t v_sub(reg_t a, reg_t b) { return _mm_sub_pd(a, b); }
+	static reg_t v_mul(reg_t a, reg_t b) { return _mm_mul_pd(a, b); }
+	static reg_t v_div(reg_t a, reg_t b) { return _mm_div_pd(a, b); }
+	static reg_t v_sqrt(reg_t a) { return _mm_sqrt_pd(a); }
+	static reg_t v_max(reg_t a, reg_t b) { return _mm_max_pd(a, b); }
+	static reg_t v_min(reg_t a, reg_t b) { return _mm_min_pd(a, b); }
+	static reg_t v_abs(reg_t a) { return _mm_andnot_pd(_mm_set1_pd(-0.), a); }
+	static double v_hsum(reg_t a) { return _mm_cvtsd_f64(_mm_add_sd(a, _mm_unpackhi_pd(a, a))); }
+	static double v_hmax(reg_t a) { return _mm_cvtsd_f64(_mm_max_sd(a, _mm_unpackhi_pd(a, a))); }
+	static reg_t v_select(reg_t mask, reg_t a, reg_t b) { return _mm_or_pd(_mm_and_pd(mask, a), _mm_andnot_pd(mask, b)); }
+	static reg_t v_lt_blend(reg_t x, reg_t lim, reg_t a, reg_t b) { return v_select(_mm_cmplt_pd(x, lim), a, b); }
+	static reg_t v_gt_blend(reg_t x, reg_t lim, reg_t a, reg_t b) { return v_select(_mm_cmpgt_pd(x, lim), a, b); }
+	static reg_t v_nan_blend(reg_t x, reg_t a, reg_t b) { return v_select(_mm_cmpunord_pd(x, x), a, b); }
+	/* t = n + 1.5*2^52，低位就是整数n，构造2^n的位模式 */
+	static reg_t v_pow2n(reg_t t)
+	{
+		return _mm_castsi128_pd(_mm_slli_epi64(_mm_add_epi64(_mm_castpd_si128(t), _mm_set1_epi64x(1023)), 52));
+	}
+	SIMD_EXP_F64
+	SIMD_KERNEL_ALGORITHMS
+};
+template<>
+struct simd_sse2<float>
+{
+	using elem_t = float;
+	using reg_t = __m128;
+	static constexpr int W = 4;
+	static reg_t v_load(const float* p) { return _mm_loadu_ps(p); }
+	static void v_store(float* p, reg_t v) { _mm_storeu_ps(p, v); }
+	static reg_t v_load_u8(const unsigned char* p)
+	{
+		int32_t u;
+		memcpy(&u, p, sizeof(u));
+		const __m128i zero = _mm_setzero_si128();
+		return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(u), zero), zero));
+	}
+	static reg_t v_set1(float v) { return _mm_set1_ps(v); }
+	static reg_t v_add(reg_t a, reg_t b) { return _mm_add_ps(a, b); }
+	static reg_t v_sub(reg_t a, reg_t b) { return _mm_sub_ps(a, b); }
+	static reg_t v_mul(reg_t a, reg_t b) { return _mm_mul_ps(a, b); }
+	static reg_t v_div(reg_t a, reg_t b) { return _mm_div_ps(a, b); }
+	static reg_t v_sqrt(reg_t a) { return _mm_sqrt_ps(a); }
+	static reg_t v_max(reg_t a, reg_t b) { return _mm_max_ps(a, b); }
+	static reg_t v_min(reg_t a, reg_t b) { return _mm_min_ps(a, b); }
+	static reg_t v_abs(reg_t a) { return _mm_andnot_ps(_mm_set1_ps(-0.f), a); }
+	static float v_hsum(reg_t a)
+	{
+		__m128 v = _mm_add_ps(a, _mm_movehl_ps(a, a));
+		return _mm_cvtss_f32(_mm_add_ss(v, _mm_shuffle_ps(v, v, 1)));
+	}
+	static float v_hmax(reg_t a)
+	{
+		__m128 v = _mm_max_ps(a, _mm_movehl_ps(a, a));
+		return _mm_cvtss_f32(_mm_max_ss(v, _mm_shuffle_ps(v, v, 1)));
+	}
+	static reg_t v_select(reg_t mask, reg_t a, reg_t b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+	static reg_t v_lt_blend(reg_t x, reg_t lim, reg_t a, reg_t b) { return v_select(_mm_cmplt_ps(x, lim), a, b); }
+	static reg_t v_gt_blend(reg_t x, reg_t lim, reg_t a, reg_t b) { return v_select(_mm_cmpgt_ps(x, lim), a, b); }
+	static reg_t v_nan_blend(reg_t x, reg_t a, reg_t b) { return v_select(_mm_cmpunord_ps(x, x), a, b); }
+	/* t = n + 1.5*2^23，低位就是整数n，构造2^n的位模式 */
+	static reg_t v_pow2n(reg_t t)
+	{
+		return _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_castps_si128(t), _mm_set1_epi32(127)), 23));
+	}
+	SIMD_EXP_F32
+	SIMD_KERNEL_ALGORITHMS
+};
+#ifdef MAT_SIMD_GNUC
+#pragma GCC pop_options
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+template<>
+struct simd_avx2<double>
+{
+	using elem_t = double;
+	using reg_t = __m256d;
+	static constexpr int W = 4;
+	static reg_t v_load(const double* p) { return _mm256_loadu_pd(p); }
+	static void v_store(double* p, reg_t v) { _mm256_storeu_pd(p, v); }
+	static reg_t v_load_u8(const unsigned char* p)
+	{
+		int32_t u;
+		memcpy(&u, p, sizeof(u));
+		return _mm256_cvtepi32_pd(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(u)));
+	}
+	static reg_t v_set1(double v) { return _mm256_set1_pd(v); }
+	static reg_t v_add(reg_t a, reg_t b) { return _mm256_add_pd(a, b); }
+	static reg_t v_sub(reg_t a, reg_t b) { return _mm256_sub_pd(a, b); }
+	static reg_t v_mul(reg_t a, reg_t b) { return _mm256_mul_pd(a, b); }
+	static reg_t v_div(reg_t a, reg_t b) { return _mm256_div_pd(a, b); }
+	static reg_t v_sqrt(reg_t a) { return _mm256_sqrt_pd(a); }
+	static reg_t v_max(reg_t a, reg_t b) { return _mm256_max_pd(a, b); }
+	static reg_t v_min(reg_t a, reg_t b) { return _mm256_min_pd(a, b); }
+	static reg_t v_abs(reg_t a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.), a); }
+	static double v_hsum(reg_t a)
+	{
+		__m128d v = _mm_add_pd(_mm256_castpd256_pd128(a), _mm256_extractf128_pd(a, 1));
+		return _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v)));
+	}
+	static double v_hmax(reg_t a)
+	{
+		__m128d v = _mm_max_pd(_mm256_castpd256_pd128(a), _mm256_extractf128_pd(a, 1));
+		return _mm_cvtsd_f64(_mm_max_sd(v, _mm_unpackhi_pd(v, v)));
+	}
+	static reg_t v_lt_blend(reg_t x, reg_t lim, reg_t a, reg_t b) { return _mm256_blendv_pd(b, a, _mm256_cmp_pd(x, lim, _CMP_LT_OQ)); }
+	static reg_t v_gt_blend(reg_t x, reg_t lim, reg_t a, reg_t b) { return _mm256_blendv_pd(b, a, _mm256_cmp_pd(x, lim, _CMP_GT_OQ)); }
+	static reg_t v_nan_blend(reg_t x, reg_t a, reg_t b) { return _mm256_blendv_pd(b, a, _mm256_cmp_pd(x, x, _CMP_UNORD_Q)); }
+	static reg_t v_pow2n(reg_t t)
+	{
+		return _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_add_epi64(_mm256_castpd_si256(t), _mm256_set1_epi64x(1023)), 52));
+	}
+	SIMD_EXP_F64
+	SIMD_KERNEL_ALGORITHMS
+};
+template<>
+struct simd_avx2<float>
+{
+	using elem_t = float;
+	using reg_t = __m256;
+	static constexpr int W = 8;
+	static reg_t v_load(const float* p) { return _mm256_loadu_ps(p); }
+	static void v_store(float* p, reg_t v) { _mm256_storeu_ps(p, v); }
+	static reg_t v_load_u8(const unsigned char* p) { return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)))); }
+	static reg_t v_set1(float v) { return _mm256_set1_ps(v); }
+	static reg_t v_add(reg_t a, reg_t b) { return _mm256_add_ps(a, b); }
+	static reg_t v_sub(reg_t a, reg_t b) { return _mm256_sub_ps(a, b); }
+	static reg_t v_mul(reg_t a, reg_t b) { return _mm256_mul_ps(a, b); }
+	static reg_t v_div(reg_t a, reg_t b) { return _mm256_div_ps(a, b); }
+	static reg_t v_sqrt(reg_t a) { return _mm256_sqrt_ps(a); }
+	static reg_t v_max(reg_t a, reg_t b) { return _mm256_max_ps(a, b); }
+	static reg_t v_min(reg_t a, reg_t b) { return _mm256_min_ps(a, b); }
+	static reg_t v_abs(reg_t a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.f), a); }
+	static float v_hsum(reg_t a)
+	{
+		__m128 v = _mm_add_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+		v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+		return _mm_cvtss_f32(_mm_add_ss(v, _mm_shuffle_ps(v, v, 1)));
+	}
+	static float v_hmax(reg_t a)
+	{
+		__m128 v = _mm_max_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+		v = _mm_max_ps(v, _mm_movehl_ps(v, v));
+		return _mm_cvtss_f32(_mm_max_ss(v, _mm_shuffle_ps(v, v, 1)));
+	}
+	static reg_t v_lt_blend(reg_t x, reg_t lim, reg_t a, reg_t b) { return _mm256_blendv_ps(b, a, _mm256_cmp_ps(x, lim, _CMP_LT_OQ)); }
+	static reg_t v_gt_blend(reg_t x, reg_t lim, reg_t a, reg_t b) { return _mm256_blendv_ps(b, a, _mm256_cmp_ps(x, lim, _CMP_GT_OQ)); }
+	static reg_t v_nan_blend(reg_t x, reg_t a, reg_t b) { return _mm256_blendv_ps(b, a, _mm256_cmp_ps(x, x, _CMP_UNORD_Q)); }
+	static reg_t v_pow2n(reg_t t)
+	{
+		return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(_mm256_castps_si256(t), _mm256_set1_epi32(127)), 23));
+	}
+	SIMD_EXP_F32
+	SIMD_KERNEL_ALGORITHMS
+};
+#ifdef MAT_SIMD_GNUC
+#pragma GCC pop_options
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+#endif
+/*
+ * AVX-512的不带掩码的内在函数(max、min、extract、slli、cvt……)在GCC 12中以_mm512_undefined_xx()作为透传值，
+ * 每次展开都会报"may be used uninitialized"；这里改用全1掩码的形式并显式给出透传值，生成的指令相同
+ */
+template<>
+struct simd_avx512<double>
+{
+	using elem_t = double;
+	using reg_t = __m512d;
+	static constexpr int W = 8;
+	static reg_t v_load(const double* p) { return _mm512_loadu_pd(p); }
+	static void v_store(double* p, reg_t v) { _mm512_storeu_pd(p, v); }
+	static reg_t v_load_u8(const unsigned char* p) { return _mm512_mask_cvtepi32_pd(_mm512_setzero_pd(), 0xff, _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)))); }
+	static reg_t v_set1(double v) { return _mm512_set1_pd(v); }
+	static reg_t v_add(reg_t a, reg_t b) { return _mm512_add_pd(a, b); }
+	static reg_t v_sub(reg_t a, reg_t b) { return _mm512_sub_pd(a, b); }
+	static reg_t v_mul(reg_t a, reg_t b) { return _mm512_mul_pd(a, b); }
+	static reg_t v_div(reg_t a, reg_t b) { return _mm512_div_pd(a, b); }
+	static reg_t v_sqrt(reg_t a) { return _mm512_mask_sqrt_pd(a, 0xff, a); }
+	static reg_t v_max(reg_t a, reg_t b) { return _mm512_mask_max_pd(a, 0xff, a, b); }
+	static reg_t v_min(reg_t a, reg_t b) { return _mm512_mask_min_pd(a, 0xff, a, b); }
+	static reg_t v_abs(reg_t a) { return _mm512_castsi512_pd(_mm512_and_epi64(_mm512_castpd_si512(a), _mm512_set1_epi64(0x7fffffffffffffffLL))); }
+	/* i_half为0取低256位，为1取高256位 */
+	static __m256d v_half(reg_t a, const int i_half)
+	{
+		return i_half == 0 ? _mm512_mask_extractf64x4_pd(_mm256_setzero_pd(), 0xf, a, 0) : _mm512_mask_extractf64x4_pd(_mm256_setzero_pd(), 0xf, a, 1);
+	}
+	static double v_hsum(reg_t a)
+	{
+		__m256d v4 = _mm256_add_pd(v_half(a, 0), v_half(a, 1));
+		__m128d v = _mm_add_pd(_mm256_castpd256_pd128(v4), _mm256_extractf128_pd(v4, 1));
+		return _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v)));
+	}
+	static double v_hmax(reg_t a)
+	{
+		__m256d v4 = _mm256_max_pd(v_half(a, 0), v_half(a, 1));
+		__m128d v = _mm_max_pd(_mm256_castpd256_pd128(v4), _mm256_extractf128_pd(v4, 1));
+		return _mm_cvtsd_f64(_mm_max_sd(v, _mm_unpackhi_pd(v, v)));
+	}
+	static reg_t v_lt_blend(reg_t x, reg_t lim, reg_t a, reg_t b) { return _mm512_mask_blend_pd(_mm512_cmp_pd_mask(x, lim, _CMP_LT_OQ), b, a); }
+	static reg_t v_gt_blend(reg_t x, reg_t lim, reg_t a, reg_t b) { return _mm512_mask_blend_pd(_mm512_cmp_pd_mask(x, lim, _CMP_GT_OQ), b, a); }
+	static reg_t v_nan_blend(reg_t x, reg_t a, reg_t b) { return _mm512_mask_blend_pd(_mm512_cmp_pd_mask(x, x, _CMP_UNORD_Q), b, a); }
+	static reg_t v_pow2n(reg_t t)
+	{
+		const __m512i e = _mm512_add_epi64(_mm512_castpd_si512(t), _mm512_set1_epi64(1023));
+		return _mm512_castsi512_pd(_mm512_mask_slli_epi64(e, 0xff, e, 52));
+	}
+	SIMD_EXP_F64
+	SIMD_KERNEL_ALGORITHMS
+};
+template<>
+struct simd_avx512<float>
+{
+	using elem_t = float;
+	using reg_t = __m512;
+	static constexpr int W = 16;
+	static reg_t v_load(const float* p) { return _mm512_loadu_ps(p); }
+	static void v_store(float* p, reg_t v) { _mm512_storeu_ps(p, v); }
+	static reg_t v_load_u8(const unsigned char* p)
+	{
+		const __m512i v = _mm512_mask_cvtepu8_epi32(_mm512_setzero_si512(), 0xffff, _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+		return _mm512_mask_cvtepi32_ps(_mm512_setzero_ps(), 0xffff, v);
+	}
+	static reg_t v_set1(float v) { return _mm512_set1_ps(v); }
+	static reg_t v_add(reg_t a, reg_t b) { return _mm512_add_ps(a, b); }
+	static reg_t v_sub(reg_t a, reg_t b) { return _mm512_sub_ps(a, b); }
+	static reg_t v_mul(reg_t a, reg_t b) { return _mm512_mul_ps(a, b); }
+	static reg_t v_div(reg_t a, reg_t b) { return _mm512_div_ps(a, b); }
+	static reg_t v_sqrt(reg_t a) { return _mm512_mask_sqrt_ps(a, 0xffff, a); }
+	static reg_t v_max(reg_t a, reg_t b) { return _mm512_mask_max_ps(a, 0xffff, a, b); }
+	static reg_t v_min(reg_t a, reg_t b) { return _mm512_mask_min_ps(a, 0xffff, a, b); }
+	static reg_t v_abs(reg_t a) { return _mm512_castsi512_ps(_mm512_and_epi32(_mm512_castps_si512(a), _mm512_set1_epi32(0x7fffffff))); }
+	static __m256 v_half(reg_t a, const int i_half)
+	{
+		return _mm256_castpd_ps(simd_avx512<double>::v_half(_mm512_castps_pd(a), i_half));
+	}
+	static float v_hsum(reg_t a)
+	{
+		__m256 v8 = _mm256_add_ps(v_half(a, 0), v_half(a, 1));
+		__m128 v = _mm_add_ps(_mm256_castps256_ps128(v8), _mm256_extractf128_ps(v8, 1));
+		v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+		return _mm_cvtss_f32(_mm_add_ss(v, _mm_shuffle_ps(v, v, 1)));
+	}
+	static float v_hmax(reg_t a)
+	{
+		__m256 v8 = _mm256_max_ps(v_half(a, 0), v_half(a, 1));
+		__m128 v = _mm_max_ps(_mm256_castps256_ps128(v8), _mm256_extractf128_ps(v8, 1));
+		v = _mm_max_ps(v, _mm_movehl_ps(v, v));
+		return _mm_cvtss_f32(_mm_max_ss(v, _mm_shuffle_ps(v, v, 1)));
+	}
+	static reg_t v_lt_blend(reg_t x, reg_t lim, reg_t a, reg_t b) { return _mm512_mask_blend_ps(_mm512_cmp_ps_mask(x, lim, _CMP_LT_OQ), b, a); }
+	static reg_t v_gt_blend(reg_t x, reg_t lim, reg_t a, reg_t b) { return _mm512_mask_blend_ps(_mm512_cmp_ps_mask(x, lim, _CMP_GT_OQ), b, a); }
+	static reg_t v_nan_blend(reg_t x, reg_t a, reg_t b) { return _mm512_mask_blend_ps(_mm512_cmp_ps_mask(x, x, _CMP_UNORD_Q), b, a); }
+	static reg_t v_pow2n(reg_t t)
+	{
+		const __m512i e = _mm512_add_epi32(_mm512_castps_si512(t), _mm512_set1_epi32(127));
+		return _mm512_castsi512_ps(_mm512_mask_slli_epi32(e, 0xffff, e, 23));
+	}
+	SIMD_EXP_F32
+	SIMD_KERNEL_ALGORITHMS
+};
+#ifdef MAT_SIMD_GNUC
+#pragma GCC pop_options
+#endif
+
+#undef SIMD_KERNEL_ALGORITHMS
+#undef SIMD_EXP_F32
+#undef SIMD_EXP_F64
+#undef SIMD_SCALAR_KERNEL
+#undef SIMD_BINARY_KERNEL
+
+#endif
+
+/* 内核函数表，mat_m的归约和表达式的分块求值都通过它调用 */
+template<typename val_t>
+struct simd_kernels
+{
+	void (*add)(const val_t*, const val_t*, val_t*, int);
+	void (*sub)(const val_t*, const val_t*, val_t*, int);
+	void (*mul)(const val_t*, const val_t*, val_t*, int);
+	void (*div)(const val_t*, const val_t*, val_t*, int);
+	void (*add_s)(const val_t*, val_t, val_t*, int);
+	void (*sub_s)(const val_t*, val_t, val_t*, int);
+	void (*rsub_s)(const val_t*, val_t, val_t*, int);
+	void (*mul_s)(const val_t*, val_t, val_t*, int);
+	void (*div_s)(const val_t*, val_t, val_t*, int);
+	void (*rdiv_s)(const val_t*, val_t, val_t*, int);
+	void (*mul_add_s)(const val_t*, val_t, val_t*, int);
+	void (*from_u8)(const unsigned char*, val_t, val_t*, int);
+	void (*exp)(const val_t*, val_t*, int);
+	void (*sqrt)(const val_t*, val_t*, int);
+	void (*abs)(const val_t*, val_t*, int);
+	val_t (*sum)(const val_t*, int);
+	val_t (*max)(const val_t*, int);
+	val_t (*max_abs)(const val_t*, int);
+	int (*argmax)(const val_t*, int);
+	void (*softmax)(const val_t*, val_t*, int);
+	void (*softmax_cols)(const val_t*, val_t*, int, int);
+	int level;
+
+	template<typename isa_t>
+	void bind(const int& i_level)
+	{
+		add = &isa_t::add; sub = &isa_t::sub; mul = &isa_t::mul; div = &isa_t::div;
+		add_s = &isa_t::add_s; sub_s = &isa_t::sub_s; rsub_s = &isa_t::rsub_s;
+		mul_s = &isa_t::mul_s; div_s = &isa_t::div_s; rdiv_s = &isa_t::rdiv_s; mul_add_s = &isa_t::mul_add_s;
+		from_u8 = &isa_t::from_u8;
+		exp = &isa_t::exp; sqrt = &isa_t::sqrt; abs = &isa_t::abs;
+		sum = &isa_t::sum; max = &isa_t::max; max_abs = &isa_t::max_abs; argmax = &isa_t::argmax;
+		softmax = &isa_t::softmax; softmax_cols = &isa_t::softmax_cols;
+		level = i_level;
+	}
+
+	/* 选择不超过i_level且CPU支持的最高一级，返回实际使用的级别 */
+	int use_level(int i_level)
+	{
+		static const int i_detected = simd_detect_level();
+		i_level = i_level < i_detected ? i_level : i_detected;
+		bind<simd_scalar<val_t> >(SIMD_SCALAR);
+#ifdef MAT_SIMD_X86
+		if constexpr (std::is_same<val_t, double>::value || std::is_same<val_t, float>::value)
+		{
+			if (i_level >= SIMD_AVX512)
+				bind<simd_avx512<val_t> >(SIMD_AVX512);
+			else if (i_level >= SIMD_AVX2)
+				bind<simd_avx2<val_t> >(SIMD_AVX2);
+			else if (i_level >= SIMD_SSE2)
+				bind<simd_sse2<val_t> >(SIMD_SSE2);
+		}
+#endif
+		return level;
+	}
+
+	static simd_kernels& get()
+	{
+		static simd_kernels k = make();
+		return k;
+	}
+
+private:
+	static simd_kernels make()
+	{
+		simd_kernels k;
+		k.use_level(SIMD_AVX512);
+		return k;
+	}
+};
+
+/*
+ * 字节序翻转：n个宽度为i_width(2/4/8)字节的元素原地翻转，序列化时文件端序与本机不同才需要
+ * 与元素类型无关，只按宽度区分；AVX2可用时每次用vpshufb翻转32字节，剩下的尾部和其它平台逐个翻转
+ */
+template<int i_width>
+struct simd_bswap_scalar
+{
+	static void run(unsigned char* p, size_t n)
+	{
+		for (size_t i = 0; i < n; ++i, p += i_width)
+		{
+			if constexpr (i_width == 2)
+			{
+				uint16_t v;
+				memcpy(&v, p, 2);
+				v = static_cast<uint16_t>((v >> 8) | (v << 8));
+				memcpy(p, &v, 2);
+			}
+			else if constexpr (i_width == 4)
+			{
+				uint32_t v;
+				memcpy(&v, p, 4);
+#if defined(__GNUC__) || defined(__clang__)
+				v = __builtin_bswap32(v);
+#else
+				v = (v >> 24) | ((v >> 8) & 0xff00u) | ((v << 8) & 0xff0000u) | (v << 24);
+#endif
+				memcpy(p, &v, 4);
+			}
+			else
+			{
+				uint64_t v;
+				memcpy(&v, p, 8);
+#if defined(__GNUC__) || defined(__clang__)
+				v = __builtin_bswap64(v);
+#else
+				uint64_t r = 0;
+				for (int k = 0; k < 8; ++k, v >>= 8)
+					r = (r << 8) | (v & 0xff);
+				v = r;
+#endif
+				memcpy(p, &v, 8);
+			}
+		}
+	}
+};
+
+#ifdef MAT_SIMD_X86
+#ifdef MAT_SIMD_GNUC
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+template<int i_width>
+struct simd_bswap_avx2
+{
+	static void run(unsigned char* p, size_t n)
+	{
+		alignas(32) unsigned char sz_mask[32];
+		for (int j = 0; j < 32; ++j)
+			sz_mask[j] = static_cast<unsigned char>((j % 16) / i_width * i_width + (i_width - 1 - j % i_width));
+		const __m256i mask = _mm256_load_si256(reinterpret_cast<const __m256i*>(sz_mask));
+		const size_t u_bytes = n * i_width;
+		size_t i = 0;
+		for (; i + 32 <= u_bytes; i += 32)
+		{
+			__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(p + i), _mm256_shuffle_epi8(v, mask));
+		}
+		simd_bswap_scalar<i_width>::run(p + i, (u_bytes - i) / i_width);
+	}
+};
+#ifdef MAT_SIMD_GNUC
+#pragma GCC pop_options
+#endif
+#endif
+
+inline void simd_bswap(void* p, const size_t& n, const int& i_width)
+{
+	using bswap_t = void (*)(unsigned char*, size_t);
+	struct bswap_table
+	{
+		bswap_t sz_func[3];
+		bswap_table()
+		{
+			sz_func[0] = &simd_bswap_scalar<2>::run;
+			sz_func[1] = &simd_bswap_scalar<4>::run;
+			sz_func[2] = &simd_bswap_scalar<8>::run;
+#ifdef MAT_SIMD_X86
+			if (simd_detect_level() >= SIMD_AVX2)
+			{
+				sz_func[0] = &simd_bswap_avx2<2>::run;
+				sz_func[1] = &simd_bswap_avx2<4>::run;
+				sz_func[2] = &simd_bswap_avx2<8>::run;
+			}
+#endif
+		}
+	};
+	static const bswap_table table;
+	unsigned char* p_byte = static_cast<unsigned char*>(p);
+	switch (i_width)
+	{
+	case 2: table.sz_func[0](p_byte, n); break;
+	case 4: table.sz_func[1](p_byte, n); break;
+	case 8: table.sz_func[2](p_byte, n); break;
+	default: break;
+	}
+}
+
+
+/* CRC32C(Castagnoli多项式，与SSE4.2的crc32指令相同)，用于校验模型文件中的张量数据；crc传入上一段的结果可以分段计算 */
+struct simd_crc32c_scalar
+{
+	static uint32_t run(const unsigned char* p, size_t n, uint32_t crc)
+	{
+		struct crc_table
+		{
+			uint32_t sz[256];
+			crc_table()
+			{
+				for (uint32_t i = 0; i < 256; ++i)
+				{
+					uint32_t c = i;
+					for (int k = 0; k < 8; ++k)
+						c = (c & 1) ? (c >> 1) ^ 0x82f63b78u : c >> 1;
+					sz[i] = c;
+				}
+			}
+		};
+		static const crc_table table;
+		crc = ~crc;
+		for (size_t i = 0; i < n; ++i)
+			crc = table.sz[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+		return ~crc;
+	}
+};
+
+#if defined(MAT_SIMD_X86) && (defined(__x86_64__) || defined(_M_X64))
+#ifdef MAT_SIMD_GNUC
+#pragma GCC push_options
+#pragma GCC target("sse4.2")
+#endif
+struct simd_crc32c_sse42
+{
+	static uint32_t run(const unsigned char* p, size_t n, uint32_t crc)
+	{
+		uint64_t c = ~crc;
+		size_t i = 0;
+		for (; i + 8 <= n; i += 8)
+		{
+			uint64_t v;
+			memcpy(&v, p + i, 8);
+			c = _mm_crc32_u64(c, v);
+		}
+		uint32_t c32 = static_cast<uint32_t>(c);
+		for (; i < n; ++i)
+			c32 = _mm_crc32_u8(c32, p[i]);
+		return ~c32;
+	}
+};
+#ifdef MAT_SIMD_GNUC
+#pragma GCC pop_options
+#endif
+#define MAT_SIMD_CRC32C 1
+#endif
+
+inline uint32_t simd_crc32c(const void* p, const size_t& n, const uint32_t& crc = 0)
+{
+	using crc_t = uint32_t (*)(const unsigned char*, size_t, uint32_t);
+	struct crc_func
+	{
+		crc_t f;
+		crc_func() :f(&simd_crc32c_scalar::run)
+		{
+#if defined(MAT_SIMD_CRC32C) && defined(MAT_SIMD_GNUC)
+			__builtin_cpu_init();
+			if (__builtin_cpu_supports("sse4.2"))
+				f = &simd_crc32c_sse42::run;
+#elif defined(MAT_SIMD_CRC32C)
+			int sz_info[4] = { 0 };
+			__cpuid(sz_info, 1);
+			if (sz_info[2] & (1 << 20))
+				f = &simd_crc32c_sse42::run;
+#endif
+		}
+	};
+	static const crc_func func;
+	return func.f(static_cast<const unsigned char*>(p), n, crc);
+}
+
+#endif
@@ -0,0 +1,421 @@
+#ifndef _TENSOR_FILE_HPP_
+#define _TENSOR_FILE_HPP_
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "base_function.hpp"
+
+/*
+ * 自描述的张量目录格式：write_file/read_file写出的是没有头部、按位置排列的字节流，
+ * 读取时必须用完全相同的模板类型从头到尾依次解析；这里每个张量按名字登记在目录中，可以只读其中一部分
+ *
+ * 文件布局(偏移都相对于头部起点，整数按头部中记录的端序存放)：
+ *   头部64字节：
+ *     char[8] "HTTENSOR" | u8 端序(ht_memory::endian) | u8[3] 0 | u32 版本 | u32 张量个数 | u32 目录的CRC32C
+ *     | u64 目录长度 | u64 第一段数据的偏移 | u64 文件总长度 | 补0到64字节
+ *   目录(紧跟头部)，每个张量一项：
+ *     u16 名字长度 | 名字 | u8 元素类型(tensor_dtype) | u8 维数 | u32 各维长度 | u64 数据偏移 | u64 数据字节数 | u32 数据的CRC32C
+ *   数据：每段从64的倍数开始，按行主序紧密排列，段后补0对齐到64；从ht_mapped_memory读取时矩阵直接引用映射中的数据
+ *
+ * 模型通过visit_tensors(obj, prefix, v)列出自己的矩阵，对每个矩阵调用v(名字, 矩阵)，名字是prefix加上成员在模型中的路径：
+ *   bp的第i层 "{i}.weight" "{i}.bias"，RBM "W" "a" "b"，dbn_t的第i层RBM "rbm{i}."，最后的预测网络 "predict."，
+ *   predict_net_t的第i个预测头 "head{i}.bp." "head{i}.softmax."，mha_t的第i个头 "head{i}.Wq." ...，输出层 "WReLu."
+ * 元素本身是矩阵的矩阵(例如mha_t的WReLu)按外层、内层的维数依次展开成一个张量
+ * 写入：write_tensor_file(model, mry)
+ * 读取：tensor_file tf; tf.open(mry); tf.read("rbm1.", dbn.layer<1>());  只解析头部和目录，只读需要的那几段数据
+ *   bp中单独的第i层：tf.read_tensors([&](auto&& v) { visit_tensors(layer, "", v, i); });
+ */
+enum tensor_dtype
+{
+	TENSOR_UINT8 = 1,
+	TENSOR_INT8 = 2,
+	TENSOR_INT16 = 3,
+	TENSOR_INT32 = 4,
+	TENSOR_INT64 = 5,
+	TENSOR_FLOAT32 = 6,
+	TENSOR_FLOAT64 = 7,
+};
+
+enum tensor_file_error
+{
+	TF_OK = 0,
+	TF_BAD_FORMAT = -1,			// 不是张量目录文件、版本不支持或者目录损坏
+	TF_NOT_FOUND = -2,			// 目录中没有这个名字
+	TF_DTYPE_MISMATCH = -3,
+	TF_SHAPE_MISMATCH = -4,
+	TF_CHECKSUM = -5,			// 数据的CRC32C与目录中的不同
+};
+
+constexpr uint32_t TENSOR_FILE_VERSION = 1;
+constexpr size_t TENSOR_FILE_ALIGN = 64;
+constexpr size_t TENSOR_FILE_HEADER_SIZE = 64;
+constexpr int TENSOR_FILE_MAX_DIM = 8;
+/* 目录中一项至少占的字节数(名字为空、0维) */
+constexpr size_t TENSOR_FILE_MIN_ENTRY_SIZE = 2 + 2 + 8 + 8 + 4;
+
+template<typename T>
+struct tensor_dtype_of
+{
+	static_assert(std::is_arithmetic<T>::value && sizeof(T) <= 8 && !std::is_same<T, long double>::value, "tensor_dtype_of: unsupported element type");
+	static constexpr int value = std::is_floating_point<T>::value ? (sizeof(T) == 4 ? TENSOR_FLOAT32 : TENSOR_FLOAT64)
+		: sizeof(T) == 1 ? (std::is_signed<T>::value ? TENSOR_INT8 : TENSOR_UINT8)
+		: sizeof(T) == 2 ? TENSOR_INT16 : sizeof(T) == 4 ? TENSOR_INT32 : TENSOR_INT64;
+};
+
+/* 算术类型或(嵌套的)mat展开成张量后的元素类型、维数、元素个数，以及按行主序整块读写 */
+template<typename T, typename = void>
+struct tensor_traits
+{
+	using elem_t = T;
+	static constexpr int ndim = 0;
+	static constexpr size_t num = 1;
+	static void dims(uint32_t*)
+	{
+	}
+	static void write(const T& v, ht_memory& mry)
+	{
+		mry.write_array(&v, 1);
+	}
+	static void read(const unsigned char*& p, const bool& b_swap, T& v)
+	{
+		memcpy(&v, p, sizeof(T));
+		if (sizeof(T) > 1 && b_swap)
+			simd_bswap(&v, 1, sizeof(T));
+		p += sizeof(T);
+	}
+};
+
+template<int row_num, int col_num, typename val_t, template<int, typename> class storage_tpl>
+struct tensor_traits<mat<row_num, col_num, val_t, storage_tpl> >
+{
+	using mat_t = mat<row_num, col_num, val_t, storage_tpl>;
+	using inner_t = tensor_traits<val_t>;
+	using elem_t = typename inner_t::elem_t;
+	static constexpr int ndim = 2 + inner_t::ndim;
+	static constexpr size_t num = static_cast<size_t>(row_num) * col_num * inner_t::num;
+	static_assert(ndim <= TENSOR_FILE_MAX_DIM, "tensor_traits: too many dimensions");
+
+	static void dims(uint32_t* p)
+	{
+		p[0] = row_num;
+		p[1] = col_num;
+		inner_t::dims(p + 2);
+	}
+	static void write(const mat_t& mt, ht_memory& mry)
+	{
+		if constexpr (std::is_arithmetic<val_t>::value)
+		{
+			mry.write_array(mt.pval->p, row_num * col_num);
+		}
+		else
+		{
+			for (int i = 0; i < row_num * col_num; ++i)
+				inner_t::write(mt.pval->p[i], mry);
+		}
+	}
+	static void read(const unsigned char*& p, const bool& b_swap, mat_t& mt)
+	{
+		if constexpr (std::is_arithmetic<val_t>::value)
+		{
+			memcpy(mt.pval->p, p, sizeof(val_t) * row_num * col_num);
+			if (sizeof(val_t) > 1 && b_swap)
+				simd_bswap(mt.pval->p, row_num * col_num, sizeof(val_t));
+			p += sizeof(val_t) * row_num * col_num;
+		}
+		else
+		{
+			for (int i = 0; i < row_num * col_num; ++i)
+				inner_t::read(p, b_swap, mt.pval->p[i]);
+		}
+	}
+};
+
+/* 单个矩阵就是一个张量，名字就是prefix */
+template<int row_num, int col_num, typename val_t, template<int, typename> class storage_tpl, typename visitor_t>
+void visit_tensors(mat<row_num, col_num, val_t, storage_tpl>& mt, const std::string& prefix, visitor_t&& v)
+{
+	v(prefix, mt);
+}
+
+struct tensor_entry
+{
+	std::string				str_name;
+	int						i_dtype = 0;
+	std::vector<uint32_t>	vec_dims;
+	uint64_t				u_offset = 0;		// 相对于头部起点
+	uint64_t				u_bytes = 0;
+	uint32_t				u_crc = 0;
+};
+
+inline size_t tensor_file_round_up(const size_t& u, const size_t& u_align)
+{
+	return (u + u_align - 1) / u_align * u_align;
+}
+
+/* 目录项按头部的端序写入mry */
+inline void write_tensor_entry(const tensor_entry& e, ht_memory& mry)
+{
+	mry << static_cast<uint16_t>(e.str_name.size());
+	mry.write(e.str_name.data(), e.str_name.size());
+	mry << static_cast<uint8_t>(e.i_dtype) << static_cast<uint8_t>(e.vec_dims.size());
+	for (const uint32_t& u_dim : e.vec_dims)
+		mry << u_dim;
+	mry << static_cast<unsigned long long>(e.u_offset) << static_cast<unsigned long long>(e.u_bytes) << e.u_crc;
+}
+
+inline size_t tensor_entry_size(const tensor_entry& e)
+{
+	return 2 + e.str_name.size() + 2 + 4 * e.vec_dims.size() + 8 + 8 + 4;
+}
+
+/*
+ * 把model的所有矩阵按张量目录格式写到mry的写位置，端序与mry相同
+ * 数据段相对于头部起点对齐，mry为空(或已写长度是64的倍数)时映射后的地址也是对齐的
+ * 名字重复或mry的空间不够(例如buf_stable)时返回TF_BAD_FORMAT，mry的写位置保持调用前的样子
+ */
+template<typename model_t>
+int write_tensor_file(const model_t& model, ht_memory& mry, const std::string& prefix = "")
+{
+	std::vector<tensor_entry> vec_entry;
+	std::vector<std::function<void(ht_memory&)> > vec_write;
+	std::unordered_map<std::string, size_t> map_name;
+	bool b_dup = false;
+	/* 只读取矩阵，不修改模型 */
+	visit_tensors(const_cast<model_t&>(model), prefix, [&](const std::string& str_name, auto& mt) {
+		using traits_t = tensor_traits<std::decay_t<decltype(mt)> >;
+		using elem_t = typename traits_t::elem_t;
+		b_dup = b_dup || !map_name.emplace(str_name, vec_entry.size()).second;
+		tensor_entry e;
+		e.str_name = str_name;
+		e.i_dtype = tensor_dtype_of<elem_t>::value;
+		e.vec_dims.resize(traits_t::ndim);
+		traits_t::dims(e.vec_dims.data());
+		e.u_bytes = traits_t::num * sizeof(elem_t);
+		vec_entry.push_back(std::move(e));
+		const auto* p_mt = &mt;
+		vec_write.push_back([p_mt](ht_memory& mry_out) { traits_t::write(*p_mt, mry_out); });
+	});
+	if (b_dup)
+		return TF_BAD_FORMAT;
+	size_t u_dir_size = 0;
+	for (const auto& e : vec_entry)
+		u_dir_size += tensor_entry_size(e);
+	const size_t u_data_begin = tensor_file_round_up(TENSOR_FILE_HEADER_SIZE + u_dir_size, TENSOR_FILE_ALIGN);
+	size_t u_end = u_data_begin;
+	for (auto& e : vec_entry)
+	{
+		e.u_offset = u_end;
+		u_end = tensor_file_round_up(u_end + e.u_bytes, TENSOR_FILE_ALIGN);
+	}
+
+	/* 先留出头部和目录的位置写数据，算出每段的CRC32C后再填头部和目录 */
+	static const char sz_zero[TENSOR_FILE_ALIGN] = { 0 };
+	const size_t u_base = mry.write_size();
+	mry.reserve(u_end);
+	for (size_t u = 0; u < u_data_begin; u += TENSOR_FILE_ALIGN)
+		mry.write(sz_zero, TENSOR_FILE_ALIGN);
+	for (size_t i = 0; i < vec_entry.size(); ++i)
+	{
+		auto& e = vec_entry[i];
+		vec_write[i](mry);
+		if (mry.write_size() != u_base + e.u_offset + e.u_bytes)
+			break;
+		e.u_crc = simd_crc32c(mry.origin_buf() + u_base + e.u_offset, e.u_bytes);
+		const size_t u_next = i + 1 < vec_entry.size() ? vec_entry[i + 1].u_offset : u_end;
+		mry.write(sz_zero, u_next - e.u_offset - e.u_bytes);
+	}
+	if (mry.write_size() != u_base + u_end)
+	{
+		mry.rewind_write(u_base);
+		return TF_BAD_FORMAT;
+	}
+
+	ht_memory mry_dir(mry.get_endian());
+	mry_dir.reserve(u_dir_size);
+	for (const auto& e : vec_entry)
+		write_tensor_entry(e, mry_dir);
+	ht_memory mry_head(mry.get_endian());
+	mry_head.write("HTTENSOR", 8);
+	mry_head << static_cast<uint8_t>(mry.get_endian()) << uint8_t(0) << uint8_t(0) << uint8_t(0);
+	mry_head << TENSOR_FILE_VERSION << static_cast<uint32_t>(vec_entry.size()) << simd_crc32c(mry_dir.buf(), mry_dir.size());
+	mry_head << static_cast<unsigned long long>(u_dir_size) << static_cast<unsigned long long>(u_data_begin) << static_cast<unsigned long long>(u_end);
+	memcpy(mry.origin_buf() + u_base, mry_head.buf(), mry_head.size());
+	if (mry_dir.size() != 0)
+		memcpy(mry.origin_buf() + u_base + TENSOR_FILE_HEADER_SIZE, mry_dir.buf(), mry_dir.size());
+	return TF_OK;
+}
+
+/*
+ * 张量目录文件的读取端：open只解析头部和目录并检查每一项的范围，数据段在read时才按目录中的偏移直接访问
+ * 读取的内存区(mry)必须比本对象存活得久；从ht_mapped_memory读取时，没有访问的数据段不会被读进内存，
+ * 端序与本机相同的堆上算术类型矩阵直接引用映射中的数据
+ */
+class tensor_file
+{
+	unsigned char*							p_base = nullptr;		// 头部起点
+	size_t									u_len = 0;
+	bool									b_swap = false;
+	std::shared_ptr<void>					sp_owner;
+	std::vector<tensor_entry>				vec_entry;
+	std::unordered_map<std::string, size_t>	map_entry;
+
+	/* 检查元素类型和形状，b_verify时再核对CRC32C */
+	template<typename mat_t>
+	int check_entry(const std::string& str_name, const bool& b_verify, const tensor_entry*& p_e) const
+	{
+		using traits_t = tensor_traits<mat_t>;
+		p_e = find(str_name);
+		if (!p_e)
+			return TF_NOT_FOUND;
+		if (p_e->i_dtype != tensor_dtype_of<typename traits_t::elem_t>::value)
+			return TF_DTYPE_MISMATCH;
+		uint32_t sz_dims[TENSOR_FILE_MAX_DIM] = { 0 };
+		traits_t::dims(sz_dims);
+		if (p_e->vec_dims.size() != static_cast<size_t>(traits_t::ndim) || !std::equal(p_e->vec_dims.begin(), p_e->vec_dims.end(), sz_dims))
+			return TF_SHAPE_MISMATCH;
+		if (b_verify && simd_crc32c(p_base + p_e->u_offset, p_e->u_bytes) != p_e->u_crc)
+			return TF_CHECKSUM;
+		return TF_OK;
+	}
+
+	template<typename mat_t>
+	void load_entry(const tensor_entry& e, mat_t& mt) const
+	{
+		if constexpr (is_mappable_mat<mat_t>::value)
+		{
+			unsigned char* p = p_base + e.u_offset;
+			if (sp_owner && !b_swap && reinterpret_cast<uintptr_t>(p) % mat_t::mat_m_t::alignment == 0)
+			{
+				mt.pval = typename mat_t::storage_t(mat_m_ref<mat_t::r * mat_t::c, typename mat_t::type>::make(reinterpret_cast<typename mat_t::type*>(p), sp_owner));
+				return;
+			}
+		}
+		const unsigned char* p = p_base + e.u_offset;
+		tensor_traits<mat_t>::read(p, b_swap, mt);
+	}
+
+public:
+	/* 从mry的读位置解析头部和目录，不移动读位置 */
+	int open(const ht_memory& mry)
+	{
+		p_base = nullptr;
+		u_len = 0;
+		vec_entry.clear();
+		map_entry.clear();
+		unsigned char* p = mry.buf();
+		const size_t u_avail = mry.size();
+		if (u_avail < TENSOR_FILE_HEADER_SIZE || memcmp(p, "HTTENSOR", 8) != 0 || p[8] > ht_memory::little_endian)
+			return TF_BAD_FORMAT;
+		const ht_memory::endian e_file = static_cast<ht_memory::endian>(p[8]);
+		ht_memory mry_view(e_file);
+		mry_view.load(p, u_avail, ht_memory::buf_stable);
+		mry_view.skip(12);
+		uint32_t u_version = 0, u_num = 0, u_dir_crc = 0;
+		unsigned long long ull_dir_size = 0, ull_data_begin = 0, ull_len = 0;
+		mry_view >> u_version >> u_num >> u_dir_crc >> ull_dir_size >> ull_data_begin >> ull_len;
+		if (u_version != TENSOR_FILE_VERSION || ull_len > u_avail || ull_data_begin > ull_len
+			|| ull_dir_size > ull_data_begin - TENSOR_FILE_HEADER_SIZE || ull_data_begin < TENSOR_FILE_HEADER_SIZE)
+			return TF_BAD_FORMAT;
+		if (simd_crc32c(p + TENSOR_FILE_HEADER_SIZE, ull_dir_size) != u_dir_crc)
+			return TF_BAD_FORMAT;
+		/* 只在目录范围内解析；先按每项的最小长度检查张量个数，不为损坏的个数分配内存 */
+		if (u_num > ull_dir_size / TENSOR_FILE_MIN_ENTRY_SIZE)
+			return TF_BAD_FORMAT;
+		mry_view.load(p + TENSOR_FILE_HEADER_SIZE, ull_dir_size, ht_memory::buf_stable);
+		vec_entry.resize(u_num);
+		for (auto& e : vec_entry)
+		{
+			uint16_t u_name_len = 0;
+			uint8_t u_dtype = 0, u_ndim = 0;
+			if (!mry_view.try_get(u_name_len) || mry_view.size() < u_name_len)
+				return TF_BAD_FORMAT;
+			e.str_name.assign(reinterpret_cast<const char*>(mry_view.buf()), u_name_len);
+			mry_view.skip(u_name_len);
+			if (!mry_view.try_get(u_dtype) || !mry_view.try_get(u_ndim) || u_dtype < TENSOR_UINT8 || u_dtype > TENSOR_FLOAT64 || u_ndim > TENSOR_FILE_MAX_DIM)
+				return TF_BAD_FORMAT;
+			e.i_dtype = u_dtype;
+			e.vec_dims.resize(u_ndim);
+			uint64_t u_num_elem = 1;
+			for (uint32_t& u_dim : e.vec_dims)
+			{
+				/* 元素个数不会超过文件长度，每次相乘前按它检查，避免溢出 */
+				if (!mry_view.try_get(u_dim) || (u_dim != 0 && u_num_elem > ull_len / u_dim))
+					return TF_BAD_FORMAT;
+				u_num_elem *= u_dim;
+			}
+			unsigned long long ull_offset = 0, ull_bytes = 0;
+			if (!mry_view.try_get(ull_offset) || !mry_view.try_get(ull_bytes) || !mry_view.try_get(e.u_crc))
+				return TF_BAD_FORMAT;
+			e.u_offset = ull_offset;
+			e.u_bytes = ull_bytes;
+			const size_t u_elem_size = u_dtype == TENSOR_UINT8 || u_dtype == TENSOR_INT8 ? 1 : u_dtype == TENSOR_INT16 ? 2
+				: u_dtype == TENSOR_INT32 || u_dtype == TENSOR_FLOAT32 ? 4 : 8;
+			if (e.u_offset % TENSOR_FILE_ALIGN != 0 || e.u_offset < ull_data_begin || e.u_offset > ull_len || e.u_bytes > ull_len - e.u_offset
+				|| e.u_bytes != u_num_elem * u_elem_size || !map_entry.emplace(e.str_name, map_entry.size()).second)
+				return TF_BAD_FORMAT;
+		}
+		p_base = p;
+		u_len = static_cast<size_t>(ull_len);
+		b_swap = e_file != system_endian();
+		sp_owner = mry.buf_owner();
+		return TF_OK;
+	}
+
+	const std::vector<tensor_entry>& entries() const
+	{
+		return vec_entry;
+	}
+
+	const tensor_entry* find(const std::string& str_name) const
+	{
+		auto itr = map_entry.find(str_name);
+		return itr == map_entry.end() ? nullptr : &vec_entry[itr->second];
+	}
+
+	/* 只按目录检查obj的每个矩阵都在文件中且元素类型、形状一致，不访问数据段 */
+	template<typename obj_t>
+	int check(const std::string& prefix, obj_t& obj) const
+	{
+		int i_ret = TF_OK;
+		visit_tensors(obj, prefix, [&](const std::string& str_name, auto& mt) {
+			const tensor_entry* p_e = nullptr;
+			if (i_ret == TF_OK)
+				i_ret = check_entry<std::decay_t<decltype(mt)> >(str_name, false, p_e);
+		});
+		return i_ret;
+	}
+
+	/* 读取obj的所有矩阵，名字是prefix加上成员路径 */
+	template<typename obj_t>
+	int read(const std::string& prefix, obj_t& obj, const bool& b_verify = true) const
+	{
+		return read_tensors([&](auto&& v) { visit_tensors(obj, prefix, v); }, b_verify);
+	}
+
+	/*
+	 * 读取fn_visit(v)列出的矩阵(对每个矩阵调用v(名字, 矩阵))，其它数据段不访问
+	 * 先检查全部矩阵的类型、形状(b_verify时还有CRC32C)，有任何一个不符时矩阵都保持不变
+	 */
+	template<typename visit_func_t>
+	int read_tensors(visit_func_t&& fn_visit, const bool& b_verify = true) const
+	{
+		if (!p_base)
+			return TF_BAD_FORMAT;
+		int i_ret = TF_OK;
+		fn_visit([&](const std::string& str_name, auto& mt) {
+			const tensor_entry* p_e = nullptr;
+			if (i_ret == TF_OK)
+				i_ret = check_entry<std::decay_t<decltype(mt)> >(str_name, b_verify, p_e);
+		});
+		if (i_ret != TF_OK)
+			return i_ret;
+		fn_visit([&](const std::string& str_name, auto& mt) {
+			load_entry(*find(str_name), mt);
+		});
+		return TF_OK;
+	}
+};
+
+#endif
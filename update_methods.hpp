@@ -2,6 +2,8 @@
 #define _UPDATE_METHODS_HPP_
 
 #include <math.h>
+#include <cmath>
+#include <type_traits>
 
 #include "mat.hpp"
 
@@ -15,6 +17,12 @@ struct gd
 		return mt_cur - lr * mt_grad;
 	}
 
+	/* ԭظ²ֱдmt_curڴ */
+	void step(target_t& mt_cur, const target_t& mt_grad)
+	{
+		mt_cur -= lr * mt_grad;
+	}
+
 	gd(const double& lr_i = 0.001) :lr(lr_i)
 	{}
 
@@ -22,23 +30,51 @@ struct gd
 	{}
 };
 
-template<>
-struct gd<double>
+/* 汾doublefloatãfloatѧϰʵȲҲfloat棬ٻdouble */
+template<typename val_t>
+struct gd_scalar
 {
-	using target_t = double;
-	double lr;
+	using target_t = val_t;
+	val_t lr;
 	target_t update(const target_t& mt_cur, const target_t& mt_grad)
 	{
 		return mt_cur - lr * mt_grad;		// ʹݶ½w = w - lr * gradСķƶ
 	}
 
-	gd(const double& lr_i = 0.001) :lr(lr_i)
+	void step(target_t& mt_cur, const target_t& mt_grad)
+	{
+		mt_cur -= lr * mt_grad;
+	}
+
+	gd_scalar(const double& lr_i = 0.001) :lr(static_cast<val_t>(lr_i))
 	{}
 
 	void update_inert()
 	{}
 };
 
+template<>
+struct gd<double> : gd_scalar<double>
+{
+	using gd_scalar<double>::gd_scalar;
+};
+
+template<>
+struct gd<float> : gd_scalar<float>
+{
+	using gd_scalar<float>::gd_scalar;
+};
+
+/* Ŀfloatֱfloat汾doubleԭsqrtl */
+template<typename val_t>
+inline auto scalar_sqrt(const val_t& v)
+{
+	if constexpr (std::is_same<val_t, float>::value)
+		return std::sqrt(v);
+	else
+		return sqrtl(v);
+}
+
 template<typename target_t>
 struct adam
 {
@@ -54,13 +90,22 @@ struct adam
 	type lr;
 
 	target_t update(const target_t& mt_cur, const target_t& mt_grad)
+	{
+		target_t mt_ret = mt_cur;
+		step(mt_ret, mt_grad);
+		return mt_ret;
+	}
+
+	/* ԭظ²ֱдظԵڴ */
+	void step(target_t& mt_cur, const target_t& mt_grad)
 	{
 		type one(1.);
 		if (t == 0)
 		{
 			mtv = mt_grad;
 			mts = mt_grad;
-			return mt_cur - lr * mtv;
+			mt_cur -= lr * mtv;
+			return;
 		}
 		t++;
 		dsbt = dsbt * dsb;
@@ -71,7 +116,7 @@ struct adam
 		mtv = (dvb * mtv + (one - dvb) * mt_grad);
 		auto mtv_ = mtv / (one - dvbt); // һ׶ΪݶȵָȨƽֵ:m_{t+1} = beta_1 * m_t + (1 - beta_1) * g_t
 
-		return mt_cur - (lr * mtv_) / (sqrtl(mts_) + dep);// ²w_{t+1} = w_t - lr * m_{t+1} / (sqrt(m_{t+1}) + eps)
+		mt_cur -= (lr * mtv_) / (sqrtl(mts_) + dep);// ²w_{t+1} = w_t - lr * m_{t+1} / (sqrt(m_{t+1}) + eps)
 	}
 
 	adam(const type& lr_i = 0.001, const type& dvb_i = 0.9, const type& dsb_i = 0.999, const type& dep_i = 1e-8)
@@ -86,11 +131,11 @@ struct adam
 	}
 };
 
-template<>
-struct adam<double>
+template<typename val_t>
+struct adam_scalar
 {
-	using type = double;
-	using target_t = double;
+	using type = val_t;
+	using target_t = val_t;
 	int t;
 	target_t mtv;
 	type dvb;
@@ -102,13 +147,21 @@ struct adam<double>
 	type lr;
 
 	target_t update(const target_t& mt_cur, const target_t& mt_grad)
+	{
+		target_t mt_ret = mt_cur;
+		step(mt_ret, mt_grad);
+		return mt_ret;
+	}
+
+	void step(target_t& mt_cur, const target_t& mt_grad)
 	{
 		type one(1.);
 		if (t == 0)
 		{
 			mtv = mt_grad;
 			mts = mt_grad;
-			return mt_cur - lr * mtv;
+			mt_cur -= lr * mtv;
+			return;
 		}
 		t++;
 		dsbt = dsbt * dsb;
@@ -119,10 +172,10 @@ struct adam<double>
 		mtv = (dvb * mtv + (one - dvb) * mt_grad);
 		auto mtv_ = mtv / (one - dvbt);
 
-		return mt_cur - (lr * mtv_) / (sqrtl(mts_) + dep);
+		mt_cur -= (lr * mtv_) / (scalar_sqrt(mts_) + dep);
 	}
 
-	adam(const type& lr_i = 0.001, const type& dvb_i = 0.9, const type& dsb_i = 0.999, const type& dep_i = 1e-8)
+	adam_scalar(const type& lr_i = 0.001, const type& dvb_i = 0.9, const type& dsb_i = 0.999, const type& dep_i = 1e-8)
 		:t(0), lr(lr_i), dvb(dvb_i), dvbt(dvb_i), dsb(dsb_i), dsbt(dsb_i), dep(dep_i)
 	{}
 
@@ -134,6 +187,18 @@ struct adam<double>
 	}
 };
 
+template<>
+struct adam<double> : adam_scalar<double>
+{
+	using adam_scalar<double>::adam_scalar;
+};
+
+template<>
+struct adam<float> : adam_scalar<float>
+{
+	using adam_scalar<float>::adam_scalar;
+};
+
 template<typename target_t>
 struct nadam
 {
@@ -149,13 +214,21 @@ struct nadam
 	type lr;
 
 	target_t update(const target_t& mt_cur, const target_t& mt_grad)
+	{
+		target_t mt_ret = mt_cur;
+		step(mt_ret, mt_grad);
+		return mt_ret;
+	}
+
+	void step(target_t& mt_cur, const target_t& mt_grad)
 	{
 		type one(1.);
 		if (t == 0)
 		{
 			mtv = mt_grad;
 			mts = mt_grad;
-			return mt_cur - lr * mtv;
+			mt_cur -= lr * mtv;
+			return;
 		}
 		t++;
 		dsbt = dsbt * dsb;
@@ -167,7 +240,7 @@ struct nadam
 		auto mtv_ = mtv / (one - dvbt);
 
 		auto mtv_n = lr * (dvb * mtv_ / (one - dvbt * dvb) + (one - dvb) / (one - dvbt) * mt_grad);
-		return mt_cur - mtv_n / (sqrtl(mts_) + dep);
+		mt_cur -= mtv_n / (sqrtl(mts_) + dep);
 	}
 
 	nadam(const type& lr_i = 0.002, const type& dvb_i = 0.9, const type& dsb_i = 0.999, const type& dep_i = 1e-8)
@@ -183,11 +256,11 @@ struct nadam
 	}
 };
 
-template<>
-struct nadam<double>
+template<typename val_t>
+struct nadam_scalar
 {
-	using type = double;
-	using target_t = double;
+	using type = val_t;
+	using target_t = val_t;
 	int t;
 	target_t mtv;
 	type dvb;
@@ -199,13 +272,21 @@ struct nadam<double>
 	type lr;
 
 	target_t update(const target_t& mt_cur, const target_t& mt_grad)
+	{
+		target_t mt_ret = mt_cur;
+		step(mt_ret, mt_grad);
+		return mt_ret;
+	}
+
+	void step(target_t& mt_cur, const target_t& mt_grad)
 	{
 		type one(1.);
 		if (t == 0)
 		{
 			mtv = mt_grad;
 			mts = mt_grad;
-			return mt_cur - lr * mtv;
+			mt_cur -= lr * mtv;
+			return;
 		}
 		t++;
 		dsbt = dsbt * dsb;
@@ -217,10 +298,10 @@ struct nadam<double>
 		auto mtv_ = mtv / (one - dvbt);
 
 		auto mtv_n = lr * (dvb * mtv_ / (one - dvbt * dvb) + (one - dvb) / (one - dvbt) * mt_grad);
-		return mt_cur - mtv_n / (sqrtl(mts_) + dep);
+		mt_cur -= mtv_n / (scalar_sqrt(mts_) + dep);
 	}
 
-	nadam(const type& lr_i = 0.002, const type& dvb_i = 0.9, const type& dsb_i = 0.999, const type& dep_i = 1e-8)
+	nadam_scalar(const type& lr_i = 0.002, const type& dvb_i = 0.9, const type& dsb_i = 0.999, const type& dep_i = 1e-8)
 		:t(0), lr(lr_i), dvb(dvb_i), dvbt(dvb_i), dsb(dsb_i), dsbt(dsb_i), dep(dep_i)
 	{
 		
@@ -234,4 +315,16 @@ struct nadam<double>
 	}
 };
 
+template<>
+struct nadam<double> : nadam_scalar<double>
+{
+	using nadam_scalar<double>::nadam_scalar;
+};
+
+template<>
+struct nadam<float> : nadam_scalar<float>
+{
+	using nadam_scalar<float>::nadam_scalar;
+};
+
 #endif
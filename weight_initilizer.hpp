@@ -3,6 +3,7 @@
 #include <random>
 
 #include "mat.hpp"
+#include "dmat.hpp"
 
 static std::default_random_engine ge;
 
@@ -15,10 +16,10 @@ struct do_init
 	}
 };
 
-template<int row_num, int col_num, typename val_t, typename rand_distrib_t>
-struct do_init<mat<row_num, col_num, val_t>, rand_distrib_t >
+template<int row_num, int col_num, typename val_t, template<int, typename> class storage_tpl, typename rand_distrib_t>
+struct do_init<mat<row_num, col_num, val_t, storage_tpl>, rand_distrib_t >
 {
-	static void cal(mat<row_num, col_num, val_t>& mt, rand_distrib_t& ud)
+	static void cal(mat<row_num, col_num, val_t, storage_tpl>& mt, rand_distrib_t& ud)
 	{
 		for (int i = 0; i < row_num; ++i)
 		{
@@ -30,93 +31,154 @@ struct do_init<mat<row_num, col_num, val_t>, rand_distrib_t >
 	}
 };
 
+/* dmat的形状在运行时才知道，分布的参数随形状变化，不能像mat版本那样用static的分布对象 */
+template<typename val_t, typename rand_distrib_t>
+void init_dmat(dmat<val_t>& mt, rand_distrib_t& ud)
+{
+	for (int i = 0; i < mt.row_num; ++i)
+	{
+		for (int j = 0; j < mt.col_num; ++j)
+		{
+			do_init<val_t, rand_distrib_t>::cal(mt.get(i, j), ud);
+		}
+	}
+}
+
+/* 各初始化方法按矩阵最内层的元素类型(mat_unite_type)生成随机数，float矩阵直接得到float，不经过double */
 template<typename init_name_t>
 struct weight_initilizer 
 {
-	template<int row_num, int col_num, typename val_t>
-	static void cal(mat<row_num, col_num, val_t>& mt, const double& d1 = 0., const double& d2 = 1.)
+	template<int row_num, int col_num, typename val_t, template<int, typename> class storage_tpl>
+	static void cal(mat<row_num, col_num, val_t, storage_tpl>& mt, const double& d1 = 0., const double& d2 = 1.)
 	{
-		static std::uniform_real_distribution <double> ud(d1, d2);
+		using rand_t = typename mat_unite_type<val_t>::type;
+		static std::uniform_real_distribution<rand_t> ud(d1, d2);
 		for (int i = 0; i < row_num; ++i)
 		{
 			for (int j = 0; j < col_num; ++j)
 			{
-				do_init<val_t, std::uniform_real_distribution<double> >::cal(mt.get(i, j), ud);
+				do_init<val_t, std::uniform_real_distribution<rand_t> >::cal(mt.get(i, j), ud);
 			}
 		}
 	}
+
+	template<typename val_t>
+	static void cal(dmat<val_t>& mt, const double& d1 = 0., const double& d2 = 1.)
+	{
+		using rand_t = typename mat_unite_type<val_t>::type;
+		static std::uniform_real_distribution<rand_t> ud(d1, d2);
+		init_dmat(mt, ud);
+	}
 };
 
 template<>
 struct weight_initilizer<class XavierGaussian>
 {
-	template<int row_num, int col_num, typename val_t>
-	static void cal(mat<row_num, col_num, val_t>& mt) 
+	template<int row_num, int col_num, typename val_t, template<int, typename> class storage_tpl>
+	static void cal(mat<row_num, col_num, val_t, storage_tpl>& mt) 
 	{
-		static std::normal_distribution <double> ud(0., sqrtl(2. / (row_num + col_num)));
+		using rand_t = typename mat_unite_type<val_t>::type;
+		static std::normal_distribution<rand_t> ud(0., sqrtl(2. / (row_num + col_num)));
 
 		for (int i = 0; i < row_num; ++i)
 		{
 			for (int j = 0; j < col_num; ++j)
 			{
-				do_init<val_t, std::normal_distribution<double> >::cal(mt.get(i, j), ud);
+				do_init<val_t, std::normal_distribution<rand_t> >::cal(mt.get(i, j), ud);
 			}
 		}
 	}
+
+	template<typename val_t>
+	static void cal(dmat<val_t>& mt)
+	{
+		using rand_t = typename mat_unite_type<val_t>::type;
+		std::normal_distribution<rand_t> ud(0., sqrtl(2. / (mt.row_num + mt.col_num)));
+		init_dmat(mt, ud);
+	}
 };
 
 template<>
 struct weight_initilizer<class XavierMean>
 {
-	template<int row_num, int col_num, typename val_t>
-	static void cal(mat<row_num, col_num, val_t>& mt)
+	template<int row_num, int col_num, typename val_t, template<int, typename> class storage_tpl>
+	static void cal(mat<row_num, col_num, val_t, storage_tpl>& mt)
 	{
+		using rand_t = typename mat_unite_type<val_t>::type;
 		double r = sqrtl(6. / (row_num + col_num));
-		static std::uniform_real_distribution<double> ud(-r, r);
+		static std::uniform_real_distribution<rand_t> ud(-r, r);
 		for (int i = 0; i < row_num; ++i)
 		{
 			for (int j = 0; j < col_num; ++j)
 			{
-				do_init<val_t, std::uniform_real_distribution<double> >::cal(mt.get(i, j), ud);
+				do_init<val_t, std::uniform_real_distribution<rand_t> >::cal(mt.get(i, j), ud);
 			}
 		}
 	}
+
+	template<typename val_t>
+	static void cal(dmat<val_t>& mt)
+	{
+		using rand_t = typename mat_unite_type<val_t>::type;
+		double r = sqrtl(6. / (mt.row_num + mt.col_num));
+		std::uniform_real_distribution<rand_t> ud(-r, r);
+		init_dmat(mt, ud);
+	}
 };
 
 template<>
 struct weight_initilizer<class HeGaussian>
 {
-	template<int row_num, int col_num, typename val_t>
-	static void cal(mat<row_num, col_num, val_t>& mt)
+	template<int row_num, int col_num, typename val_t, template<int, typename> class storage_tpl>
+	static void cal(mat<row_num, col_num, val_t, storage_tpl>& mt)
 	{
+		using rand_t = typename mat_unite_type<val_t>::type;
 		static std::default_random_engine e;
-		static std::normal_distribution <double> ud(0., sqrtl(2. / col_num));
+		static std::normal_distribution<rand_t> ud(0., sqrtl(2. / col_num));
 		for (int i = 0; i < row_num; ++i)
 		{
 			for (int j = 0; j < col_num; ++j)
 			{
-				do_init<val_t, std::normal_distribution<double> >::cal(mt.get(i, j), ud);
+				do_init<val_t, std::normal_distribution<rand_t> >::cal(mt.get(i, j), ud);
 			}
 		}
 	}
+
+	template<typename val_t>
+	static void cal(dmat<val_t>& mt)
+	{
+		using rand_t = typename mat_unite_type<val_t>::type;
+		std::normal_distribution<rand_t> ud(0., sqrtl(2. / mt.col_num));
+		init_dmat(mt, ud);
+	}
 };
 
 template<>
 struct weight_initilizer<class HeMean>
 {
-	template<int row_num, int col_num, typename val_t>
-	static void cal(mat<row_num, col_num, val_t>& mt)
+	template<int row_num, int col_num, typename val_t, template<int, typename> class storage_tpl>
+	static void cal(mat<row_num, col_num, val_t, storage_tpl>& mt)
 	{
+		using rand_t = typename mat_unite_type<val_t>::type;
 		double r = sqrtl(6. / col_num);
-		static std::uniform_real_distribution<double> ud(-r, r);
+		static std::uniform_real_distribution<rand_t> ud(-r, r);
 		for (int i = 0; i < row_num; ++i)
 		{
 			for (int j = 0; j < col_num; ++j)
 			{
-				do_init<val_t, std::uniform_real_distribution<double> >::cal(mt.get(i, j), ud);
+				do_init<val_t, std::uniform_real_distribution<rand_t> >::cal(mt.get(i, j), ud);
 			}
 		}
 	}
+
+	template<typename val_t>
+	static void cal(dmat<val_t>& mt)
+	{
+		using rand_t = typename mat_unite_type<val_t>::type;
+		double r = sqrtl(6. / mt.col_num);
+		std::uniform_real_distribution<rand_t> ud(-r, r);
+		init_dmat(mt, ud);
+	}
 };
 
 #endif